@@ -0,0 +1,142 @@
+#include "Allocator.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "Numa.h"
+
+#if defined(__linux__) && !defined(ZEDBOARD)
+#include <linux/mempolicy.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define ML_HAVE_MADVISE
+#endif
+
+namespace ML {
+
+namespace {
+
+const std::size_t PAGE_BYTES = 4096;
+
+// Touch one byte per page so the pages are faulted in now instead of during inference
+void prefaultPages(void* ptr, const std::size_t bytes) {
+    volatile char* p = (volatile char*)ptr;
+    for (std::size_t i = 0; i < bytes; i += PAGE_BYTES) p[i] = 0;
+}
+
+AlignedAllocator& alignedDefault() {
+    static AlignedAllocator allocator;
+    return allocator;
+}
+
+Allocator* defaultAllocator = nullptr;
+
+}  // namespace
+
+Allocator& Allocator::getDefault() {
+    return defaultAllocator ? *defaultAllocator : alignedDefault();
+}
+
+void Allocator::setDefault(Allocator& allocator) {
+    defaultAllocator = &allocator;
+}
+
+// Over-allocate and keep the original pointer right before the aligned block, this works without posix_memalign
+void* AlignedAllocator::allocate(const std::size_t bytes) {
+    void* raw = std::malloc(bytes + alignment + sizeof(void*));
+    if (!raw) throw std::bad_alloc();
+
+    std::uintptr_t start = (std::uintptr_t)raw + sizeof(void*);
+    std::uintptr_t aligned = (start + alignment - 1) & ~(std::uintptr_t)(alignment - 1);
+    ((void**)aligned)[-1] = raw;
+
+    if (prefault) prefaultPages((void*)aligned, bytes);
+    return (void*)aligned;
+}
+
+void AlignedAllocator::deallocate(void* ptr, const std::size_t) {
+    if (ptr) std::free(((void**)ptr)[-1]);
+}
+
+std::size_t AlignedAllocator::footprint(const std::size_t bytes) const {
+    return bytes + alignment + sizeof(void*);
+}
+
+void* HugePageAllocator::allocate(const std::size_t bytes) {
+#ifdef ML_HAVE_MADVISE
+    if (bytes >= threshold) {
+        // Round up to whole huge pages so the tail of the buffer is huge page backed as well
+        std::size_t length = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+        void* ptr = nullptr;
+        if (posix_memalign(&ptr, HUGE_PAGE_SIZE, length) != 0) throw std::bad_alloc();
+        madvise(ptr, length, MADV_HUGEPAGE);  // Only a hint, THP may be disabled on the host
+        if (prefault) prefaultPages(ptr, length);
+        return ptr;
+    }
+#endif
+    return small.allocate(bytes);
+}
+
+void HugePageAllocator::deallocate(void* ptr, const std::size_t bytes) {
+#ifdef ML_HAVE_MADVISE
+    if (bytes >= threshold) {
+        std::free(ptr);
+        return;
+    }
+#endif
+    small.deallocate(ptr, bytes);
+}
+
+std::size_t HugePageAllocator::footprint(const std::size_t bytes) const {
+#ifdef ML_HAVE_MADVISE
+    if (bytes >= threshold) return (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+#endif
+    return small.footprint(bytes);
+}
+
+void* NumaAllocator::allocate(const std::size_t bytes) {
+#ifdef ML_HAVE_MADVISE
+    if (bytes >= threshold) {
+        std::size_t length = (bytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+        void* ptr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) throw std::bad_alloc();
+
+        // The policy only applies to pages faulted in after it is set, and nothing has touched these yet
+        const NumaTopology& topology = NumaTopology::host();
+        if (policy != Policy::FIRST_TOUCH && topology.nodes.size() > 1) {
+            unsigned long mask = 0;
+            if (policy == Policy::INTERLEAVE) {
+                for (const NumaTopology::Node& n : topology.nodes) mask |= n.id < 64 ? 1UL << n.id : 0;
+            } else {
+                mask = node < 64 ? 1UL << node : 0;
+            }
+            // Only a placement hint, a failure (e.g. seccomp) leaves the default first touch placement
+            if (mask) syscall(SYS_mbind, ptr, length, policy == Policy::INTERLEAVE ? MPOL_INTERLEAVE : MPOL_PREFERRED, &mask, sizeof(mask) * 8 + 1, 0);
+            prefaultPages(ptr, length);
+        }
+        return ptr;
+    }
+#endif
+    return small.allocate(bytes);
+}
+
+void NumaAllocator::deallocate(void* ptr, const std::size_t bytes) {
+#ifdef ML_HAVE_MADVISE
+    if (bytes >= threshold) {
+        if (ptr) munmap(ptr, (bytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES);
+        return;
+    }
+#endif
+    small.deallocate(ptr, bytes);
+}
+
+std::size_t NumaAllocator::footprint(const std::size_t bytes) const {
+#ifdef ML_HAVE_MADVISE
+    if (bytes >= threshold) return (bytes + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+#endif
+    return small.footprint(bytes);
+}
+
+}  // namespace ML
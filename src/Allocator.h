@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Config.h"
+
+namespace ML {
+
+// Memory backing for LayerData buffers
+class Allocator {
+   public:
+    virtual ~Allocator() {}
+
+    virtual void* allocate(const std::size_t bytes) = 0;
+    virtual void deallocate(void* ptr, const std::size_t bytes) = 0;
+
+    // Bytes an allocation of `bytes` takes from the system, padding and rounding included (MemoryAccount)
+    virtual std::size_t footprint(const std::size_t bytes) const { return bytes; }
+
+    // Allocator used by LayerData buffers that were not given one explicitly
+    static Allocator& getDefault();
+    static void setDefault(Allocator& allocator);
+};
+
+// Heap allocation aligned to `alignment` bytes (Config::BUFFER_ALIGNMENT by default)
+// With prefault, every page is touched right away so the first inference doesn't take the page faults
+class AlignedAllocator : public Allocator {
+   public:
+    explicit AlignedAllocator(const std::size_t alignment = Config::BUFFER_ALIGNMENT, const bool prefault = false)
+        : alignment(alignment), prefault(prefault) {}
+
+    virtual void* allocate(const std::size_t bytes) override;
+    virtual void deallocate(void* ptr, const std::size_t bytes) override;
+    virtual std::size_t footprint(const std::size_t bytes) const override;
+
+   private:
+    std::size_t alignment;
+    bool prefault;
+};
+
+// Buffers of at least `threshold` bytes are 2 MB aligned and backed by transparent huge pages (Linux only),
+// cutting TLB misses on large weights and activations. Smaller buffers fall back to aligned allocation
+class HugePageAllocator : public Allocator {
+   public:
+    static constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    explicit HugePageAllocator(const std::size_t threshold = HUGE_PAGE_SIZE / 2, const bool prefault = true)
+        : threshold(threshold), prefault(prefault), small(Config::BUFFER_ALIGNMENT, prefault) {}
+
+    virtual void* allocate(const std::size_t bytes) override;
+    virtual void deallocate(void* ptr, const std::size_t bytes) override;
+    virtual std::size_t footprint(const std::size_t bytes) const override;
+
+   private:
+    std::size_t threshold;
+    bool prefault;
+    AlignedAllocator small;
+};
+
+// Buffers of at least `threshold` bytes are mapped page aligned with a NUMA placement (Linux only):
+//   FIRST_TOUCH  pages are left untouched and land on the node of the thread that writes them first, so a buffer
+//                filled by its worker (LayerData::localize) is local to it
+//   INTERLEAVE   pages alternate over every node, for data read by threads on all sockets (shared weights)
+//   NODE         pages are placed on `node` (a NumaTopology::Node::id) while it has free memory, for per node replicas
+// On a single node host the policies change nothing and no syscall is made. Smaller buffers use aligned allocation
+class NumaAllocator : public Allocator {
+   public:
+    enum class Policy { FIRST_TOUCH, INTERLEAVE, NODE };
+
+    explicit NumaAllocator(const Policy policy = Policy::FIRST_TOUCH, const unsigned node = 0, const std::size_t threshold = 64 * 1024)
+        : policy(policy), node(node), threshold(threshold) {}
+
+    virtual void* allocate(const std::size_t bytes) override;
+    virtual void deallocate(void* ptr, const std::size_t bytes) override;
+    virtual std::size_t footprint(const std::size_t bytes) const override;
+
+   private:
+    Policy policy;
+    unsigned node;
+    std::size_t threshold;
+    AlignedAllocator small;
+};
+
+}  // namespace ML
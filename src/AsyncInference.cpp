@@ -0,0 +1,199 @@
+#include "AsyncInference.h"
+
+#ifndef ZEDBOARD
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+namespace ML {
+
+namespace {
+
+double microseconds(const AsyncInference::Clock::duration& duration) {
+    return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+}  // namespace
+
+AsyncInference::AsyncInference(const std::vector<Model*>& models, TaskScheduler& pool, const Options& options)
+    : options(options), pool(pool), inputParams(sizeof(fp32), {}), outputParams(sizeof(fp32), {}), idle(models) {
+    if (models.empty()) throw std::runtime_error("Async inference needs at least one model");
+    if (pool.numThreads() < 2) throw std::runtime_error("Async inference needs a scheduler with a worker besides its caller");
+    for (Model* model : models) {
+        if (!model || model->getNumLayers() == 0) throw std::runtime_error("Async inference needs models with layers");
+    }
+    queueMemory = &models[0]->getScratchMemory();
+    inputParams = (*models[0])[0].getInputParams();
+    outputParams = models[0]->getOutputLayer().getOutputParams();
+    for (Model* model : models) {
+        if (!(*model)[0].getInputParams().isCompatible(inputParams) || !model->getOutputLayer().getOutputParams().isCompatible(outputParams)) {
+            throw std::runtime_error("Async inference models must have the same input and output shapes");
+        }
+    }
+}
+
+AsyncInference::~AsyncInference() {
+    std::deque<std::unique_ptr<Request>> left;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        left.swap(queue);
+    }
+    for (std::unique_ptr<Request>& request : left) complete(*request, empty(Status::CANCELLED, *request));
+
+    std::unique_lock<std::mutex> lock(mutex);
+    drained.wait(lock, [this] { return active == 0; });
+}
+
+AsyncInference::Ticket AsyncInference::submit(const LayerData& image, Callback onDone, const Clock::time_point deadline) {
+    if (!inputParams.isCompatible(image.getParams())) throw std::runtime_error("Async inference input does not match the model input");
+
+    std::unique_ptr<Request> request(new Request{LayerData(image), std::move(onDone), deadline, Clock::now(),
+                                                 std::make_shared<std::atomic<bool>>(false), std::promise<Result>()});
+    request->image.setAccount(queueMemory, MemoryKind::SCRATCH);
+    Ticket ticket;
+    ticket.future = request->promise.get_future().share();
+    ticket.cancelled = request->cancelled;
+
+    bool rejected;
+    Model* model = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        counters.submitted++;
+        rejected = stopping || queue.size() >= options.queueCapacity;
+        if (!rejected) {
+            queue.push_back(std::move(request));
+            // An idle model starts a job, a busy one picks the request up when it is done with the ones before it
+            if (!idle.empty()) {
+                model = idle.back();
+                idle.pop_back();
+                active++;
+            }
+        }
+    }
+    if (rejected) {
+        complete(*request, empty(Status::REJECTED, *request));
+    } else if (model) {
+        pool.post([this, model] { drain(*model); });
+    }
+    return ticket;
+}
+
+void AsyncInference::drain(Model& model) {
+    while (true) {
+        std::unique_ptr<Request> request;
+        std::vector<std::unique_ptr<Request>> stale;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stale = takeDropped();
+            if (!stopping && !queue.empty()) {
+                request = std::move(queue.front());
+                queue.pop_front();
+            } else {
+                // Checked under the lock submit() takes, so a request queued after this starts a new job
+                idle.push_back(&model);
+            }
+        }
+        for (std::unique_ptr<Request>& old : stale) complete(*old, empty(dropped(*old), *old));
+        if (!request) break;
+
+        Clock::time_point taken = Clock::now();
+        Result result = run(model, *request);
+        result.queueUs = microseconds(taken - request->submitted);
+        result.runUs = microseconds(Clock::now() - taken);
+        complete(*request, std::move(result));
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    active--;
+    drained.notify_all();
+}
+
+AsyncInference::Result AsyncInference::run(Model& model, Request& request) {
+    Status status = dropped(request);
+    if (status != Status::DONE) return empty(status, request);
+
+    try {
+        std::size_t stoppedAt = model.getNumLayers();
+        const LayerData* output = model.inference(request.image, options.infType, [&](const std::size_t layer) {
+            if (dropped(request) == Status::DONE) return true;
+            stoppedAt = layer;
+            return false;
+        });
+        if (!output) {
+            std::lock_guard<std::mutex> lock(mutex);
+            counters.layersSkipped += model.getNumLayers() - stoppedAt;
+            return empty(dropped(request), request);
+        }
+
+        Result result = empty(Status::DONE, request);
+        result.output.allocData();
+        std::memcpy(result.output.raw(), output->raw(), outputParams.byte_size());
+        return result;
+    } catch (const std::exception& e) {
+        Result result = empty(Status::FAILED, request);
+        result.error = e.what();
+        return result;
+    }
+}
+
+AsyncInference::Status AsyncInference::dropped(const Request& request) const {
+    if (*request.cancelled) return Status::CANCELLED;
+    if (Clock::now() >= request.deadline) return Status::EXPIRED;
+    return Status::DONE;
+}
+
+std::vector<std::unique_ptr<AsyncInference::Request>> AsyncInference::takeDropped() {
+    std::vector<std::unique_ptr<Request>> stale;
+    for (auto it = queue.begin(); it != queue.end();) {
+        if (dropped(**it) != Status::DONE) {
+            stale.push_back(std::move(*it));
+            it = queue.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return stale;
+}
+
+AsyncInference::Result AsyncInference::empty(const Status status, const Request& request) const {
+    double waited = microseconds(Clock::now() - request.submitted);
+    return Result{status, LayerData(outputParams), "", waited, 0};
+}
+
+void AsyncInference::complete(Request& request, Result&& result) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        switch (result.status) {
+        case Status::DONE: counters.done++; break;
+        case Status::CANCELLED: counters.cancelled++; break;
+        case Status::EXPIRED: counters.expired++; break;
+        case Status::REJECTED: counters.rejected++; break;
+        case Status::FAILED: counters.failed++; break;
+        }
+    }
+
+    // The callback sees the result before anyone waiting on the future
+    if (request.onDone) {
+        try {
+            request.onDone(result);
+        } catch (...) {
+        }
+    }
+    request.promise.set_value(std::move(result));
+}
+
+AsyncInference::Stats AsyncInference::stats() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return counters;
+}
+
+std::string AsyncInference::Stats::toString() const {
+    std::ostringstream oss;
+    oss << submitted << " requests: " << done << " done, " << cancelled << " cancelled, " << expired << " expired, " << rejected << " rejected, "
+        << failed << " failed (" << layersSkipped << " layers skipped)";
+    return oss.str();
+}
+
+}  // namespace ML
+#endif
@@ -0,0 +1,138 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Model.h"
+#include "Scheduler.h"
+
+namespace ML {
+
+// Non-blocking inference for hosts running an event loop. submit() queues a copy of the image and returns at once with
+// a Ticket, whose future (and optional callback, called on the worker thread) delivers a copy of the output. The
+// requests run as jobs on the workers of a shared TaskScheduler (TaskScheduler::post), one job per model at a time
+// working through the queue, so there is no thread per request.
+//
+// A request that is cancelled or misses its deadline while queued is completed without running any layer, and a
+// running one stops at the next layer boundary. submit() never blocks: a request finding the queue full is rejected.
+//
+// Requests go through Model::inference, so the result cache and the exit heads apply as for a blocking inference.
+// Queued image copies are charged to the first model's scratch account, outputs belong to the caller. The scheduler
+// needs a worker besides its caller and must outlive this object.
+class AsyncInference {
+   public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        // Requests waiting for a worker, more are rejected
+        std::size_t queueCapacity = 64;
+        Layer::InfType infType = Layer::InfType::SIMD;
+    };
+
+    enum class Status { DONE, CANCELLED, EXPIRED, REJECTED, FAILED };
+
+    struct Result {
+        Status status;
+        // NHWC model output, allocated only when DONE
+        LayerData output;
+        // What a failed inference threw
+        std::string error;
+        // Time from submit until a worker took the request, and from then on
+        double queueUs, runUs;
+    };
+
+    // Called on the worker thread when a request completes (whatever its status), before its future becomes ready
+    using Callback = std::function<void(const Result&)>;
+
+    // A submitted request, copies refer to the same request
+    class Ticket {
+       public:
+        // The request's result, get() waits for it
+        const std::shared_future<Result>& result() const { return future; }
+
+        // Drop the request if it has not completed, its status becomes CANCELLED
+        void cancel() const { *cancelled = true; }
+
+       private:
+        friend class AsyncInference;
+        std::shared_future<Result> future;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+    };
+
+    struct Stats {
+        std::size_t submitted = 0, done = 0, cancelled = 0, expired = 0, rejected = 0, failed = 0;
+        // Layers not computed because their request was dropped while running
+        std::size_t layersSkipped = 0;
+
+        // e.g. "100 requests: 90 done, 6 cancelled, 2 expired, 2 rejected, 0 failed (31 layers skipped)"
+        std::string toString() const;
+    };
+
+    AsyncInference(const std::vector<Model*>& models, TaskScheduler& pool, const Options& options);
+    AsyncInference(Model& model, TaskScheduler& pool, const Options& options) : AsyncInference(std::vector<Model*>{&model}, pool, options) {}
+    AsyncInference(Model& model, TaskScheduler& pool) : AsyncInference(model, pool, Options()) {}
+
+    // Queued requests are completed as CANCELLED, running ones are finished first
+    ~AsyncInference();
+
+    AsyncInference(const AsyncInference&) = delete;
+    AsyncInference& operator=(const AsyncInference&) = delete;
+
+    // Queue an image (copied), the request expires at `deadline`
+    Ticket submit(const LayerData& image, Callback onDone = Callback(), const Clock::time_point deadline = Clock::time_point::max());
+
+    Stats stats() const;
+
+   private:
+    struct Request {
+        LayerData image;
+        Callback onDone;
+        Clock::time_point deadline, submitted;
+        std::shared_ptr<std::atomic<bool>> cancelled;
+        std::promise<Result> promise;
+    };
+
+    // Pool job: run queued requests on `model` until the queue is empty, then give the model back
+    void drain(Model& model);
+
+    // Run the inference, the status says whether the request was dropped on the way
+    Result run(Model& model, Request& request);
+
+    // Status of a queued or running request that should not continue, DONE if it should
+    Status dropped(const Request& request) const;
+
+    // Count the result, then hand it to the callback and the future
+    void complete(Request& request, Result&& result);
+
+    // Take the queued requests that were cancelled or expired out of the queue, with `mutex` held
+    std::vector<std::unique_ptr<Request>> takeDropped();
+
+    // Result without an output
+    Result empty(const Status status, const Request& request) const;
+
+    Options options;
+    TaskScheduler& pool;
+    LayerParams inputParams, outputParams;
+    MemoryAccount* queueMemory = nullptr;
+
+    mutable std::mutex mutex;
+    std::deque<std::unique_ptr<Request>> queue;
+    // Models without a job, and jobs not finished yet (the destructor waits for them)
+    std::vector<Model*> idle;
+    std::size_t active = 0;
+    std::condition_variable drained;
+    bool stopping = false;
+    Stats counters;
+};
+
+}  // namespace ML
+#endif
@@ -0,0 +1,60 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+
+namespace ML {
+
+// Blocking FIFO with a fixed capacity. push() waits while the queue is full, pop() waits while it is empty.
+// close() wakes everyone: pushes are dropped and pop() drains what is left, then returns false
+template <typename T> class BoundedQueue {
+   public:
+    explicit BoundedQueue(const std::size_t capacity) : capacity(capacity) {}
+
+    // Returns false if the queue was closed
+    bool push(T item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notFull.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) return false;
+        items.push_back(std::move(item));
+        notEmpty.notify_one();
+        return true;
+    }
+
+    // Returns false once the queue is closed and empty
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(mutex);
+        notEmpty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) return false;
+        item = std::move(items.front());
+        items.pop_front();
+        notFull.notify_one();
+        return true;
+    }
+
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        notFull.notify_all();
+        notEmpty.notify_all();
+    }
+
+    std::size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return items.size();
+    }
+
+   private:
+    const std::size_t capacity;
+    std::deque<T> items;
+    bool closed = false;
+
+    mutable std::mutex mutex;
+    std::condition_variable notFull, notEmpty;
+};
+
+}  // namespace ML
+#endif
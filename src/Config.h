@@ -1,14 +1,33 @@
 #pragma once
 
+#include <cstddef>
+
 // Disable all timers
 // #define DISABLE_TIMING
 
+// The bare metal zedboard build defines ZEDBOARD and has no threads. Everything that starts or synchronizes threads
+// (the scheduler, pipeline, servers, result cache, evaluation) is compiled out there with #ifndef ZEDBOARD, whole
+// headers for classes that only exist on the desktop
+
 namespace ML {
 namespace Config {
+// LayerData bounds and element size checks, only compiled into debug/checked builds (make build_debug / build_checked)
+#ifdef ML_BOUNDS_CHECK
+constexpr bool BOUNDS_CHECK = true;
+#else
+constexpr bool BOUNDS_CHECK = false;
+#endif
+
 constexpr bool ENABLE_SIMD = false;
 constexpr bool FANCY_LOGGING = true;
 
 // Floating Point Compare Epsilon
 constexpr float EPSILON = 0.001;
+
+// Alignment of LayerData buffers (one cache line, and a full AVX-512 vector)
+constexpr std::size_t BUFFER_ALIGNMENT = 64;
+
+// Back large buffers (dense weights) with prefaulted transparent huge pages where the OS supports it
+constexpr bool USE_HUGE_PAGES = true;
 } // namespace Config
 } // namespace ML::Config
\ No newline at end of file
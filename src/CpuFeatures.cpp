@@ -0,0 +1,56 @@
+#include "CpuFeatures.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#define ML_X86
+#endif
+
+namespace ML {
+
+namespace {
+
+#ifdef ML_X86
+// Register state enabled by the OS (XCR0), needs OSXSAVE
+unsigned long long xgetbv0() {
+    unsigned int eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+}
+#endif
+
+CpuFeatures detect() {
+    CpuFeatures f;
+#ifdef ML_X86
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return f;
+
+    f.sse42 = ecx & (1u << 20);
+    bool osxsave = ecx & (1u << 27);
+    bool cpu_avx = ecx & (1u << 28);
+    bool cpu_fma = ecx & (1u << 12);
+
+    // The OS must save the YMM (bits 1, 2) and for AVX-512 also the opmask/ZMM (bits 5, 6, 7) state
+    unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+    bool ymm_state = (xcr0 & 0x6) == 0x6;
+    bool zmm_state = (xcr0 & 0xE6) == 0xE6;
+
+    f.avx = cpu_avx && ymm_state;
+    f.fma = cpu_fma && f.avx;
+
+    if (__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        f.avx2 = (ebx & (1u << 5)) && f.avx;
+        f.avx512f = (ebx & (1u << 16)) && zmm_state;
+        f.avx512dq = (ebx & (1u << 17)) && zmm_state;
+    }
+#endif
+    return f;
+}
+
+}  // namespace
+
+const CpuFeatures& cpuFeatures() {
+    static const CpuFeatures features = detect();
+    return features;
+}
+
+}  // namespace ML
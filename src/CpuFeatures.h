@@ -0,0 +1,18 @@
+#pragma once
+
+namespace ML {
+
+// Instruction set extensions usable on the host, i.e. supported by the CPU and with their register state enabled by the OS
+struct CpuFeatures {
+    bool sse42 = false;
+    bool avx = false;
+    bool avx2 = false;
+    bool fma = false;
+    bool avx512f = false;
+    bool avx512dq = false;
+};
+
+// Detected once on first use (CPUID + XGETBV on x86, nothing elsewhere)
+const CpuFeatures& cpuFeatures();
+
+}  // namespace ML
@@ -0,0 +1,130 @@
+#include "DeltaInference.h"
+
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+namespace ML {
+
+DeltaInference::DeltaInference(const Model& model, const Options& options)
+    : model(model), options(options), previous(model[0].getInputParams()) {
+    if (model.getNumLayers() == 0) throw std::runtime_error("Delta inference needs a model with layers");
+    if (model[0].getInputParams().dims.size() != 3) throw std::runtime_error("Delta inference needs [height][width][channels] frames");
+    for (std::size_t i = 0; i < model.getNumLayers(); i++) {
+        if (model[i].layoutFor(options.infType) != Layout::NHWC) {
+            throw std::runtime_error("Delta inference needs NHWC activations, L" + std::to_string(i) + " has a blocked layout (Model::resetLayouts)");
+        }
+    }
+    previous.setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+    previous.allocData();
+}
+
+Region DeltaInference::changedRegion(const LayerData& frame) const {
+    const dimVec& dims = frame.getParams().dims;
+    std::size_t height = dims[ParamIndex::HEIGHT], width = dims[ParamIndex::WIDTH], channels = dims[ParamIndex::CHANNELS];
+    const fp32* a = frame.ptr<fp32>();
+    const fp32* b = previous.ptr<fp32>();
+
+    Region region = {height, 0, width, 0};
+    for (std::size_t h = 0; h < height; h++) {
+        for (std::size_t w = 0; w < width; w++) {
+            const fp32* pa = a + (h * width + w) * channels;
+            const fp32* pb = b + (h * width + w) * channels;
+            bool changed = false;
+            for (std::size_t c = 0; c < channels && !changed; c++) changed = !(std::fabs(pa[c] - pb[c]) <= options.tolerance);
+            if (!changed) continue;
+            region.h0 = std::min(region.h0, h);
+            region.h1 = std::max(region.h1, h + 1);
+            region.w0 = std::min(region.w0, w);
+            region.w1 = std::max(region.w1, w + 1);
+        }
+    }
+    return region.empty() ? Region{0, 0, 0, 0} : region;
+}
+
+const LayerData& DeltaInference::inferFull(const LayerData& frame) {
+    const dimVec& dims = frame.getParams().dims;
+    dirty = {0, dims[ParamIndex::HEIGHT], 0, dims[ParamIndex::WIDTH]};
+    counters.fullFrames++;
+
+    Layout layout = Layout::NHWC;
+    output = &model.inferenceRange(frame, layout, 0, model.getNumLayers(), options.infType, stage);
+    return *output;
+}
+
+const LayerData& DeltaInference::infer(const LayerData& frame) {
+    if (!model[0].getInputParams().isCompatible(frame.getParams())) throw std::runtime_error("Frame does not match the model input");
+    counters.frames++;
+
+    const dimVec& dims = frame.getParams().dims;
+    std::size_t frameArea = dims[ParamIndex::HEIGHT] * dims[ParamIndex::WIDTH];
+    Region changed = valid ? changedRegion(frame) : Region{0, dims[ParamIndex::HEIGHT], 0, dims[ParamIndex::WIDTH]};
+
+    const LayerData* result;
+    if (changed.empty()) {
+        dirty = changed;
+        counters.unchangedFrames++;
+        result = output;
+    } else if (!valid || changed.area() > options.maxDirtyFraction * frameArea) {
+        result = &inferFull(frame);
+    } else {
+        dirty = changed;
+        counters.deltaFrames++;
+
+        // Spatial layers recompute their dirty region, or everything once it is too large
+        Region region = changed;
+        const LayerData* data = &frame;
+        bool whole = false;
+        std::size_t i = 0;
+        for (; i < model.getNumLayers() && model[i].supportsRegions(); i++) {
+            const Layer& layer = model[i];
+            const dimVec& out = layer.getOutputParams().dims;
+            Region all = {0, out[ParamIndex::HEIGHT], 0, out[ParamIndex::WIDTH]};
+            region = whole ? all : layer.outputRegion(region);
+
+            whole = whole || region.area() > options.maxDirtyFraction * all.area();
+            if (whole) {
+                Layout layout = Layout::NHWC;
+                model.inferenceRange(*data, layout, i, i + 1, options.infType, stage);
+            } else {
+                layer.computeRegion(*data, region);
+            }
+            counters.pixelsComputed += region.area();
+            counters.pixelsTotal += all.area();
+            data = &layer.getOutputData();
+        }
+
+        // Layers without a spatial structure see the whole changed activation
+        if (i < model.getNumLayers()) {
+            Layout layout = Layout::NHWC;
+            data = &model.inferenceRange(*data, layout, i, model.getNumLayers(), options.infType, stage);
+        }
+        output = data;
+        result = output;
+    }
+
+    remember(frame, dirty);
+    valid = true;
+    return *result;
+}
+
+void DeltaInference::remember(const LayerData& frame, const Region& region) {
+    const dimVec& dims = frame.getParams().dims;
+    std::size_t width = dims[ParamIndex::WIDTH], channels = dims[ParamIndex::CHANNELS];
+    for (std::size_t h = region.h0; h < region.h1; h++) {
+        std::size_t offset = (h * width + region.w0) * channels;
+        std::memcpy(previous.ptr<fp32>() + offset, frame.ptr<fp32>() + offset, (region.w1 - region.w0) * channels * sizeof(fp32));
+    }
+}
+
+std::string DeltaInference::Stats::toString() const {
+    std::ostringstream oss;
+    oss << frames << " frames: " << fullFrames << " full, " << deltaFrames << " delta";
+    if (pixelsTotal) oss << " (" << std::fixed << std::setprecision(1) << 100.0 * pixelsComputed / pixelsTotal << "% of the spatial outputs recomputed)";
+    oss << ", " << unchangedFrames << " unchanged";
+    return oss.str();
+}
+
+}  // namespace ML
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Model.h"
+
+namespace ML {
+
+// Incremental inference for a stream of frames that mostly stay the same (a fixed camera). Each frame is compared with
+// the previous one and the bounding box of the changed pixels is pushed through the spatial layers (convolution, max
+// pooling): every layer maps the dirty region through its receptive fields (Layer::outputRegion) and recomputes only
+// those output pixels, the rest of its output buffer still holds the previous frame's activations. From the first
+// layer without region support (flatten, dense) on, the model runs normally.
+//
+// A frame changing more than `maxDirtyFraction` of the input runs a full inference, and a layer whose dirty region
+// grows past that fraction of its output is computed whole with the regular backend (everything after it as well).
+//
+// The layer outputs are the cache, so the model must run in NHWC (Model::resetLayouts), and another inference between
+// two frames needs a reset() before the next frame.
+class DeltaInference {
+   public:
+    struct Options {
+        // Pixels with every channel within this of the previous frame count as unchanged
+        fp32 tolerance = 0;
+        // Dirty area (fraction of the input, or of a layer's output) above which everything is recomputed
+        double maxDirtyFraction = 0.5;
+        // Backend of full passes and of the layers after the spatial ones
+        Layer::InfType infType = Layer::InfType::SIMD;
+    };
+
+    struct Stats {
+        std::size_t frames = 0, fullFrames = 0, deltaFrames = 0, unchangedFrames = 0;
+        // Output pixels of the spatial layers recomputed, out of all of them, over the delta frames
+        std::size_t pixelsComputed = 0, pixelsTotal = 0;
+
+        // e.g. "12 frames: 1 full, 10 delta (6.2% of the spatial outputs recomputed), 1 unchanged"
+        std::string toString() const;
+    };
+
+    DeltaInference(const Model& model, const Options& options);
+    explicit DeltaInference(const Model& model) : DeltaInference(model, Options()) {}
+
+    // Output (NHWC) for the next frame, valid until the next call
+    const LayerData& infer(const LayerData& frame);
+
+    // Forget the previous frame, the next one runs a full inference
+    void reset() { valid = false; }
+
+    // Changed input region of the last frame (the whole frame for a full inference)
+    const Region& lastDirty() const { return dirty; }
+    const Stats& stats() const { return counters; }
+
+   private:
+    // Bounding box of the pixels that differ from the previous frame
+    Region changedRegion(const LayerData& frame) const;
+
+    const LayerData& inferFull(const LayerData& frame);
+
+    // Copy the pixels of `region` into `previous`, which always holds the input the cached activations were computed from
+    void remember(const LayerData& frame, const Region& region);
+
+    const Model& model;
+    Options options;
+
+    // Reference for the next comparison. Pixels that drift within the tolerance are not copied, so a slow drift still
+    // adds up to a change against the input the layers last saw
+    LayerData previous;
+    bool valid = false;
+    const LayerData* output = nullptr;
+    Region dirty = {0, 0, 0, 0};
+
+    std::vector<std::unique_ptr<LayerData>> stage;
+    Stats counters;
+};
+
+}  // namespace ML
@@ -0,0 +1,282 @@
+#include "Evaluation.h"
+
+#ifndef ZEDBOARD
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace ML {
+
+namespace {
+
+const char* backendName(const Layer::InfType infType) {
+    switch (infType) {
+    case Layer::InfType::NAIVE: return "naive";
+    case Layer::InfType::THREADED: return "threaded";
+    case Layer::InfType::TILED: return "tiled";
+    case Layer::InfType::SIMD: return "simd";
+    }
+    return "?";
+}
+
+const char* layerTypeName(const Layer::LayerType type) {
+    switch (type) {
+    case Layer::LayerType::CONVOLUTIONAL: return "conv";
+    case Layer::LayerType::DENSE: return "dense";
+    case Layer::LayerType::SOFTMAX: return "softmax";
+    case Layer::LayerType::MAX_POOLING: return "maxpool";
+    case Layer::LayerType::FLATTEN: return "flatten";
+    default: return "layer";
+    }
+}
+
+bool fileExists(const std::string& path) {
+    return std::ifstream(path).good();
+}
+
+// Model layers [first, last) producing one golden output
+struct Step {
+    std::size_t first, last;
+};
+
+// The golden outputs were saved per layer of the reference model, where the softmax is the activation of the last
+// dense layer, so a layer followed by a softmax shares its golden output with it
+std::vector<Step> goldenSteps(const Model& model) {
+    std::vector<Step> steps;
+    for (std::size_t i = 0; i < model.getNumLayers(); i++) {
+        bool merged = i + 1 < model.getNumLayers() && model[i + 1].getLType() == Layer::LayerType::SOFTMAX;
+        steps.push_back({i, merged ? i + 2 : i + 1});
+        if (merged) i++;
+    }
+    return steps;
+}
+
+std::string stepName(const Model& model, const Step& step) {
+    std::ostringstream oss;
+    oss << "L" << step.first;
+    if (step.last - step.first > 1) oss << "-L" << step.last - 1;
+    for (std::size_t i = step.first; i < step.last; i++) oss << (i == step.first ? " " : "+") << layerTypeName(model[i].getLType());
+    return oss.str();
+}
+
+// Test image with a golden output per step
+struct TestImage {
+    std::unique_ptr<LayerData> input;
+    std::vector<std::unique_ptr<LayerData>> golden;
+};
+
+// Outputs are pre-filled with a NaN marker, so a backend that is not implemented cannot pass on stale results and
+// shows up as a layer whose output is still all marker
+const std::uint32_t marker = 0x7FC0DEAD;
+
+void fillOutputs(const Model& model, const Step& step) {
+    for (std::size_t i = step.first; i < step.last; i++) {
+        LayerData& out = model[i].getOutputData();
+        if (model[i].isView() || !out.isAlloced()) continue;
+        std::uint32_t* bits = (std::uint32_t*)out.raw();
+        std::fill(bits, bits + out.getParams().flat_count(), marker);
+    }
+}
+
+bool stepImplemented(const Model& model, const Step& step) {
+    for (std::size_t i = step.first; i < step.last; i++) {
+        const LayerData& out = model[i].getOutputData();
+        if (model[i].isView() || !out.isAlloced()) continue;
+        const std::uint32_t* bits = (const std::uint32_t*)out.raw();
+        if (std::all_of(bits, bits + out.getParams().flat_count(), [](std::uint32_t b) { return b == marker; })) return false;
+    }
+    return true;
+}
+
+// Run layers [first, last) on an NHWC input, returns the NHWC output
+const LayerData& runStep(const Model& model, const Step& step, const LayerData& in, const Layer::InfType infType,
+                         std::vector<std::unique_ptr<LayerData>>& stage, std::unique_ptr<LayerData>& nhwc) {
+    fillOutputs(model, step);
+    Layout layout = Layout::NHWC;
+    const LayerData& out = model.inferenceRange(in, layout, step.first, step.last, infType, stage);
+    if (layout == Layout::NHWC) return out;
+
+    const dimVec& dims = out.getParams().dims;
+    if (!nhwc || nhwc->getParams().dims != dims) {
+        nhwc.reset(new LayerData(out.getParams()));
+        nhwc->setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+        nhwc->allocData();
+    }
+    reorder(out.ptr<fp32>(), layout, nhwc->ptr<fp32>(), Layout::NHWC, dims[ParamIndex::HEIGHT], dims[ParamIndex::WIDTH], dims[ParamIndex::CHANNELS]);
+    return *nhwc;
+}
+
+}  // namespace
+
+EvalReport evaluate(const ModelDesc& desc, const Path& dataDir, const EvalOptions& options) {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point begin = Clock::now();
+
+    EvalReport report;
+    report.backends = options.backends;
+    report.minSimilarity = options.minSimilarity;
+
+    for (std::size_t n = 0; fileExists(dataDir + "/image_" + std::to_string(n) + ".bin"); n++) report.images.push_back(n);
+    if (report.images.empty()) throw std::runtime_error("No test images (image_0.bin, ...) in " + dataDir);
+
+    std::size_t jobs = report.images.size() * report.backends.size();
+    std::size_t threads = options.threads ? options.threads : std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    report.threads = std::max<std::size_t>(std::min(threads, jobs), 1);
+
+    // Every worker gets its own model, whose buffers and weights the worker allocates itself (first touch places them
+    // on its node). The loads take turns so their logs do not interleave
+    // With an explicit weight placement every worker gets its own allocator, for NODE bound to the worker's node
+    const NumaTopology& topology = NumaTopology::host();
+    std::vector<std::unique_ptr<NumaAllocator>> weightAllocators;
+    std::vector<std::unique_ptr<Model>> models;
+    for (std::size_t w = 0; w < report.threads; w++) {
+        models.emplace_back(new Model(buildModel(desc)));
+        models.back()->setLayerTimers(false);
+        if (options.weights != NumaAllocator::Policy::FIRST_TOUCH) {
+            int cpu = options.affinity.cpuFor(w, topology);
+            unsigned node = topology.nodes[cpu < 0 ? 0 : topology.nodeOf(cpu)].id;
+            weightAllocators.emplace_back(new NumaAllocator(options.weights, node));
+            models.back()->setWeightAllocator(*weightAllocators.back());
+        }
+    }
+    std::mutex loading;
+
+    const Model& reference = *models[0];
+    std::vector<Step> steps = goldenSteps(reference);
+    for (const Step& step : steps) report.steps.push_back(stepName(reference, step));
+    report.steps.push_back("End to end");
+
+    std::vector<TestImage> images(report.images.size());
+    for (std::size_t i = 0; i < images.size(); i++) {
+        Path base = dataDir / ("image_" + std::to_string(report.images[i]));
+        images[i].input.reset(new LayerData(reference[0].getInputParams(), base + ".bin"));
+        images[i].input->loadData();
+        for (std::size_t k = 0; k < steps.size(); k++) {
+            Path golden = base + "_data/layer_" + std::to_string(k) + "_output.bin";
+            if (!fileExists(golden)) throw std::runtime_error("Missing golden output " + golden);
+            images[i].golden.emplace_back(new LayerData(reference[steps[k].last - 1].getOutputParams(), golden));
+            images[i].golden.back()->loadData();
+        }
+    }
+
+    report.similarity.assign(images.size(), std::vector<std::vector<fp32>>(report.backends.size(), std::vector<fp32>(report.steps.size(), 0)));
+    report.implemented.assign(images.size(), std::vector<std::vector<bool>>(report.backends.size(), std::vector<bool>(report.steps.size(), true)));
+
+    // Workers take (image, backend) jobs until there are none left
+    std::atomic<std::size_t> next(0);
+    std::vector<std::exception_ptr> errors(report.threads);
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < report.threads; w++) {
+        workers.emplace_back([&, w] {
+            Model& model = *models[w];
+            std::vector<std::unique_ptr<LayerData>> stage;
+            std::unique_ptr<LayerData> nhwc;
+            try {
+                pinThread(options.affinity.cpuFor(w));
+                {
+                    std::lock_guard<std::mutex> lock(loading);
+                    model.allocLayers();
+                }
+                if (options.planLayouts) model.planLayouts(Layer::InfType::SIMD);
+
+                for (std::size_t job = next++; job < jobs; job = next++) {
+                    const TestImage& image = images[job / report.backends.size()];
+                    Layer::InfType infType = report.backends[job % report.backends.size()];
+                    std::vector<fp32>& result = report.similarity[job / report.backends.size()][job % report.backends.size()];
+                    std::vector<bool>& implemented = report.implemented[job / report.backends.size()][job % report.backends.size()];
+
+                    for (std::size_t k = 0; k < steps.size(); k++) {
+                        const LayerData& in = k == 0 ? *image.input : *image.golden[k - 1];
+                        result[k] = runStep(model, steps[k], in, infType, stage, nhwc).compare<fp32>(*image.golden[k]);
+                        implemented[k] = stepImplemented(model, steps[k]);
+                    }
+                    Step all{0, model.getNumLayers()};
+                    result.back() = runStep(model, all, *image.input, infType, stage, nhwc).compare<fp32>(*image.golden.back());
+                    implemented.back() = stepImplemented(model, all);
+                }
+            } catch (...) {
+                errors[w] = std::current_exception();
+            }
+        });
+    }
+    for (std::thread& worker : workers) worker.join();
+    for (std::exception_ptr& error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+
+    report.memory = models[0]->memoryReport();
+    for (std::unique_ptr<Model>& model : models) model->freeLayers();
+    report.seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+    return report;
+}
+
+std::size_t EvalReport::failures() const {
+    std::size_t count = 0;
+    for (std::size_t i = 0; i < similarity.size(); i++) {
+        for (std::size_t b = 0; b < similarity[i].size(); b++) {
+            for (std::size_t k = 0; k < similarity[i][b].size(); k++) count += implemented[i][b][k] && !(similarity[i][b][k] >= minSimilarity);
+        }
+    }
+    return count;
+}
+
+std::string EvalReport::table() const {
+    std::ostringstream oss;
+    const int stepWidth = 24, cellWidth = 12;
+
+    oss << std::left << std::setw(stepWidth) << "Layer";
+    for (Layer::InfType backend : backends) oss << " | " << std::setw(cellWidth) << backendName(backend);
+    oss << "\n" << std::string(stepWidth, '-');
+    for (std::size_t b = 0; b < backends.size(); b++) oss << "-+-" << std::string(cellWidth, '-');
+    oss << "\n";
+
+    std::ostringstream failed, missing;
+    for (std::size_t k = 0; k < steps.size(); k++) {
+        oss << std::left << std::setw(stepWidth) << steps[k];
+        for (std::size_t b = 0; b < backends.size(); b++) {
+            fp32 worst = 1;
+            std::ostringstream failing;
+            std::size_t numFailing = 0, numMissing = 0;
+            for (std::size_t i = 0; i < images.size(); i++) {
+                if (!implemented[i][b][k]) {
+                    numMissing++;
+                    continue;
+                }
+                fp32 s = similarity[i][b][k];
+                worst = std::min(worst, s);
+                if (!(s >= minSimilarity)) failing << (numFailing++ ? ", " : "") << images[i] << " (" << s << ")";
+            }
+            bool fail = numFailing > 0;
+
+            // Cells failing on every image speak for themselves, only list the images when some pass
+            if (fail && numFailing < images.size()) failed << "  " << backendName(backends[b]) << " " << steps[k] << ": images " << failing.str() << "\n";
+
+            if (numMissing) missing << " [" << backendName(backends[b]) << " " << steps[k] << "]";
+
+            std::ostringstream cell;
+            if (numMissing == images.size()) cell << "n/a";
+            else cell << std::fixed << std::setprecision(4) << worst << (fail ? " !" : "");
+            oss << " | " << std::setw(cellWidth) << cell.str();
+        }
+        oss << "\n";
+    }
+
+    oss << images.size() << " images x " << backends.size() << " backends on " << threads << " threads in " << std::fixed << std::setprecision(2)
+        << seconds << "s, worst image per cell, ! below " << std::setprecision(4) << minSimilarity << "\n";
+    if (!missing.str().empty()) oss << "Not implemented (output left untouched):" << missing.str() << "\n";
+    if (failures()) oss << failures() << " image results below the threshold\n" << failed.str();
+    oss << "\nMemory per worker:\n" << memory;
+    return oss.str();
+}
+
+}  // namespace ML
+#endif
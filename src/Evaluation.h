@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <string>
+#include <vector>
+
+#include "Allocator.h"
+#include "ModelLoader.h"
+#include "Numa.h"
+
+namespace ML {
+
+// Accuracy evaluation of every backend over every test image in a data directory (data/image_N.bin with its
+// data/image_N_data/layer_K_output.bin golden outputs). Each golden output is checked on its own, starting from the
+// previous golden output, so an error shows up at the layer that causes it, plus one end to end run per image.
+// The (image, backend) runs are spread over worker threads, each with its own copy of the model (buffers and layout
+// plan), so validating a kernel change over all images takes one pass per core instead of a serial loop. Every worker
+// loads its copy itself, after pinning, so its weights and activations are on its own NUMA node.
+struct EvalOptions {
+    std::vector<Layer::InfType> backends = {Layer::InfType::NAIVE, Layer::InfType::THREADED, Layer::InfType::TILED, Layer::InfType::SIMD};
+    // Worker threads, 0 picks one per hardware thread
+    std::size_t threads = 0;
+    // Run the SIMD backend with the blocked layout plan (Model::planLayouts)
+    bool planLayouts = true;
+    // Similarities below this are reported as failures
+    fp32 minSimilarity = 0.999f;
+    // Worker w runs on affinity.cpuFor(w)
+    Affinity affinity;
+    // Placement of each worker's weights: FIRST_TOUCH leaves them on the node of the worker, which loads them itself,
+    // INTERLEAVE spreads them over every node, NODE places a replica on the worker's node wherever it is loaded from
+    NumaAllocator::Policy weights = NumaAllocator::Policy::FIRST_TOUCH;
+};
+
+struct EvalReport {
+    // Golden steps (model layer ranges with a golden output) and the end to end run, which is always last
+    std::vector<std::string> steps;
+    std::vector<Layer::InfType> backends;
+    std::vector<std::size_t> images;
+
+    // similarity[image][backend][step], the repo's length weighted cosine similarity (LayerData::compare)
+    std::vector<std::vector<std::vector<fp32>>> similarity;
+    // implemented[image][backend][step] is false when a layer of the step left its output untouched (the backend does
+    // not implement it yet, as in Verify), those results are listed apart instead of counted as failures
+    std::vector<std::vector<std::vector<bool>>> implemented;
+    fp32 minSimilarity;
+    std::size_t threads;
+    double seconds;
+    // Buffers of one worker's model after its last job (Model::memoryReport), each worker holds as much
+    std::string memory;
+
+    // Implemented (image, backend, step) results below minSimilarity
+    std::size_t failures() const;
+
+    // One row per step, one column per backend with the worst image, failing cells are marked with the failing images
+    std::string table() const;
+};
+
+// Images are found by probing image_0.bin, image_1.bin, ... in dataDir. Throws if there is none
+EvalReport evaluate(const ModelDesc& desc, const Path& dataDir, const EvalOptions& options);
+
+}  // namespace ML
+#endif
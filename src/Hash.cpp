@@ -0,0 +1,78 @@
+#include "Hash.h"
+
+#include <cstring>
+
+namespace ML {
+
+namespace {
+
+const std::uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+const std::uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+const std::uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+const std::uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+const std::uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+inline std::uint64_t rotl(const std::uint64_t x, const int r) { return (x << r) | (x >> (64 - r)); }
+
+inline std::uint64_t read64(const unsigned char* p) {
+    std::uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint32_t read32(const unsigned char* p) {
+    std::uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline std::uint64_t round(std::uint64_t acc, const std::uint64_t lane) {
+    acc += lane * PRIME2;
+    return rotl(acc, 31) * PRIME1;
+}
+
+inline std::uint64_t merge(std::uint64_t hash, const std::uint64_t acc) {
+    hash ^= round(0, acc);
+    return hash * PRIME1 + PRIME4;
+}
+
+}  // namespace
+
+std::uint64_t hash64(const void* data, const std::size_t bytes, const std::uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    const unsigned char* end = p + bytes;
+    std::uint64_t hash;
+
+    if (bytes >= 32) {
+        std::uint64_t acc1 = seed + PRIME1 + PRIME2, acc2 = seed + PRIME2, acc3 = seed, acc4 = seed - PRIME1;
+        for (; p + 32 <= end; p += 32) {
+            acc1 = round(acc1, read64(p));
+            acc2 = round(acc2, read64(p + 8));
+            acc3 = round(acc3, read64(p + 16));
+            acc4 = round(acc4, read64(p + 24));
+        }
+        hash = rotl(acc1, 1) + rotl(acc2, 7) + rotl(acc3, 12) + rotl(acc4, 18);
+        hash = merge(merge(merge(merge(hash, acc1), acc2), acc3), acc4);
+    } else {
+        hash = seed + PRIME5;
+    }
+    hash += bytes;
+
+    // Tail of up to 31 bytes
+    for (; p + 8 <= end; p += 8) hash = rotl(hash ^ round(0, read64(p)), 27) * PRIME1 + PRIME4;
+    if (p + 4 <= end) {
+        hash = rotl(hash ^ (read32(p) * PRIME1), 23) * PRIME2 + PRIME3;
+        p += 4;
+    }
+    for (; p < end; p++) hash = rotl(hash ^ (*p * PRIME5), 11) * PRIME1;
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+}  // namespace ML
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace ML {
+
+// 64 bit non-cryptographic hash of a byte range (the XXH64 algorithm). Four independent accumulators each take one
+// 8 byte lane of every 32 byte stripe, so the multiplies of neighbouring lanes overlap and a 48KB image hashes in a few
+// microseconds. Equal inputs and seeds always give equal hashes, on any little endian target
+std::uint64_t hash64(const void* data, const std::size_t bytes, const std::uint64_t seed = 0);
+
+}  // namespace ML
@@ -0,0 +1,107 @@
+#include "Layout.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ML {
+
+std::size_t channelBlock(const Layout layout) {
+    switch (layout) {
+    case Layout::NHWC: return 1;
+    case Layout::NCHW8c: return 8;
+    case Layout::NCHW16c: return 16;
+    }
+    return 1;
+}
+
+Layout blockedLayout(const std::size_t block) {
+    switch (block) {
+    case 8: return Layout::NCHW8c;
+    case 16: return Layout::NCHW16c;
+    }
+    throw std::runtime_error("No blocked layout with " + std::to_string(block) + " channels per block");
+}
+
+const char* layoutName(const Layout layout) {
+    switch (layout) {
+    case Layout::NHWC: return "NHWC";
+    case Layout::NCHW8c: return "NCHW8c";
+    case Layout::NCHW16c: return "NCHW16c";
+    }
+    return "unknown";
+}
+
+bool layoutFits(const Layout layout, const dimVec& dims) {
+    if (layout == Layout::NHWC) return true;
+    return dims.size() == 3 && dims[2] % channelBlock(layout) == 0;
+}
+
+namespace {
+
+// NHWC -> blocked, the inner copy is one block of contiguous channels
+void toBlocked(const fp32* src, fp32* dst, const std::size_t pixels, const std::size_t channels, const std::size_t block) {
+    for (std::size_t b = 0; b < channels / block; b++) {
+        fp32* plane = dst + b * pixels * block;
+        for (std::size_t i = 0; i < pixels; i++) {
+            std::memcpy(plane + i * block, src + i * channels + b * block, block * sizeof(fp32));
+        }
+    }
+}
+
+// Blocked -> NHWC
+void fromBlocked(const fp32* src, fp32* dst, const std::size_t pixels, const std::size_t channels, const std::size_t block) {
+    for (std::size_t b = 0; b < channels / block; b++) {
+        const fp32* plane = src + b * pixels * block;
+        for (std::size_t i = 0; i < pixels; i++) {
+            std::memcpy(dst + i * channels + b * block, plane + i * block, block * sizeof(fp32));
+        }
+    }
+}
+
+}  // namespace
+
+void reorder(const fp32* src, const Layout from, fp32* dst, const Layout to, const std::size_t height, const std::size_t width,
+             const std::size_t channels, MemoryAccount& scratch) {
+    const std::size_t pixels = height * width;
+    const std::size_t from_block = channelBlock(from), to_block = channelBlock(to);
+    if (channels % from_block != 0 || channels % to_block != 0) throw std::runtime_error("Channels are not a multiple of the layout's block");
+
+    if (from == to) {
+        std::memcpy(dst, src, pixels * channels * sizeof(fp32));
+    } else if (from == Layout::NHWC) {
+        toBlocked(src, dst, pixels, channels, to_block);
+    } else if (to == Layout::NHWC) {
+        fromBlocked(src, dst, pixels, channels, from_block);
+    } else {
+        // Between two blocked layouts through NHWC
+        std::vector<fp32> nhwc(pixels * channels);
+        MemoryCharge charge(scratch, MemoryKind::SCRATCH, nhwc.size() * sizeof(fp32));
+        fromBlocked(src, nhwc.data(), pixels, channels, from_block);
+        toBlocked(nhwc.data(), dst, pixels, channels, to_block);
+    }
+}
+
+void copyWindow(const fp32* src, const std::size_t height, const std::size_t width, const std::size_t channels, const long row, const long col,
+                const std::size_t rows, const std::size_t cols, const fp32 fill, fp32* dst) {
+    // Columns [col_begin, col_end) of the window are inside the tensor
+    std::size_t col_begin = (std::size_t)std::min(std::max(-col, 0L), (long)cols);
+    std::size_t col_end = (std::size_t)std::max(std::min((long)width - col, (long)cols), (long)col_begin);
+
+    for (std::size_t r = 0; r < rows; r++) {
+        fp32* line = dst + r * cols * channels;
+        long h = row + (long)r;
+        if (h < 0 || h >= (long)height) {
+            std::fill(line, line + cols * channels, fill);
+            continue;
+        }
+        std::fill(line, line + col_begin * channels, fill);
+        std::memcpy(line + col_begin * channels, src + ((std::size_t)h * width + (std::size_t)(col + (long)col_begin)) * channels,
+                    (col_end - col_begin) * channels * sizeof(fp32));
+        std::fill(line + col_end * channels, line + cols * channels, fill);
+    }
+}
+
+}  // namespace ML
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+
+#include "Memory.h"
+#include "Types.h"
+
+namespace ML {
+
+// Memory layout of a [height][width][channels] activation
+//   NHWC     channels innermost, what the model files and the naive kernels use
+//   NCHW8c   [channels / 8][height][width][8], each channel block is a small NHWC image
+//   NCHW16c  same with blocks of 16 channels
+// Blocked layouts are only used when the channel count is a multiple of the block, so every layout of a
+// tensor has the same size
+enum class Layout { NHWC, NCHW8c, NCHW16c };
+
+// Channels per block, 1 for NHWC
+std::size_t channelBlock(const Layout layout);
+
+// Blocked layout for a channel block size (8 or 16)
+Layout blockedLayout(const std::size_t block);
+
+const char* layoutName(const Layout layout);
+
+// Whether a tensor with these dims can be stored in the layout (3-D with whole channel blocks, anything in NHWC)
+bool layoutFits(const Layout layout, const dimVec& dims);
+
+// Copy a [height][width][channels] tensor from one layout into another. Two blocked layouts convert through an NHWC
+// temporary, charged to `scratch` as MemoryKind::SCRATCH
+void reorder(const fp32* src, const Layout from, fp32* dst, const Layout to, const std::size_t height, const std::size_t width,
+             const std::size_t channels, MemoryAccount& scratch = MemoryAccount::process());
+
+// Copy rows [row, row + rows) x columns [col, col + cols) of an NHWC tensor into a contiguous [rows][cols][channels]
+// buffer. The window may reach past the tensor's edges (padding), those pixels are set to `fill`
+void copyWindow(const fp32* src, const std::size_t height, const std::size_t width, const std::size_t channels, const long row, const long col,
+                const std::size_t rows, const std::size_t cols, const fp32 fill, fp32* dst);
+
+}  // namespace ML
@@ -0,0 +1,103 @@
+#include "LinAlg.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace ML {
+namespace LinAlg {
+
+// Compute C = A^T * A for a row-major (rows x cols) matrix A, C is (cols x cols)
+void gram(const fp32* a, const std::size_t rows, const std::size_t cols, std::vector<fp64>& c) {
+    c.assign(cols * cols, 0.0);
+
+    // Accumulate one rank-1 update per row so the inner loop walks contiguous memory
+    for (std::size_t r = 0; r < rows; r++) {
+        const fp32* row = a + r * cols;
+        for (std::size_t i = 0; i < cols; i++) {
+            const fp64 ri = row[i];
+            if (ri == 0) continue;
+            fp64* c_row = c.data() + i * cols;
+            for (std::size_t j = i; j < cols; j++) {
+                c_row[j] += ri * row[j];
+            }
+        }
+    }
+
+    // Mirror the upper triangle
+    for (std::size_t i = 0; i < cols; i++) {
+        for (std::size_t j = 0; j < i; j++) {
+            c[i * cols + j] = c[j * cols + i];
+        }
+    }
+}
+
+// Eigen decomposition of a symmetric (n x n) row-major matrix using cyclic Jacobi rotations
+void symmetricEigen(std::vector<fp64>& a, const std::size_t n, std::vector<fp64>& eigenvalues, std::vector<fp64>& eigenvectors) {
+    std::vector<fp64> v(n * n, 0.0);
+    for (std::size_t i = 0; i < n; i++) v[i * n + i] = 1.0;
+
+    const std::size_t max_sweeps = 64;
+    for (std::size_t sweep = 0; sweep < max_sweeps; sweep++) {
+        // Converged once the off diagonal mass is negligible compared to the diagonal
+        fp64 off = 0, diag = 0;
+        for (std::size_t i = 0; i < n; i++) {
+            diag += a[i * n + i] * a[i * n + i];
+            for (std::size_t j = i + 1; j < n; j++) off += a[i * n + j] * a[i * n + j];
+        }
+        if (off <= 1e-22 * diag) break;
+
+        for (std::size_t p = 0; p < n; p++) {
+            for (std::size_t q = p + 1; q < n; q++) {
+                const fp64 apq = a[p * n + q];
+                if (std::fabs(apq) < 1e-300) continue;
+
+                // Rotation angle that zeroes a[p][q]
+                const fp64 theta = (a[q * n + q] - a[p * n + p]) / (2 * apq);
+                const fp64 t = (theta >= 0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1));
+                const fp64 c = 1 / std::sqrt(t * t + 1);
+                const fp64 s = t * c;
+
+                // A' = J^T A J applied to rows and columns p, q
+                for (std::size_t k = 0; k < n; k++) {
+                    const fp64 akp = a[k * n + p];
+                    const fp64 akq = a[k * n + q];
+                    a[k * n + p] = c * akp - s * akq;
+                    a[k * n + q] = s * akp + c * akq;
+                }
+                for (std::size_t k = 0; k < n; k++) {
+                    const fp64 apk = a[p * n + k];
+                    const fp64 aqk = a[q * n + k];
+                    a[p * n + k] = c * apk - s * aqk;
+                    a[q * n + k] = s * apk + c * aqk;
+                }
+
+                // Accumulate the rotation into the eigenvectors
+                for (std::size_t k = 0; k < n; k++) {
+                    const fp64 vkp = v[k * n + p];
+                    const fp64 vkq = v[k * n + q];
+                    v[k * n + p] = c * vkp - s * vkq;
+                    v[k * n + q] = s * vkp + c * vkq;
+                }
+            }
+        }
+    }
+
+    // Sort eigenpairs by descending eigenvalue
+    std::vector<std::size_t> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](std::size_t i, std::size_t j) { return a[i * n + i] > a[j * n + j]; });
+
+    eigenvalues.resize(n);
+    eigenvectors.resize(n * n);
+    for (std::size_t col = 0; col < n; col++) {
+        const std::size_t src = order[col];
+        eigenvalues[col] = a[src * n + src];
+        for (std::size_t k = 0; k < n; k++) {
+            eigenvectors[k * n + col] = v[k * n + src];
+        }
+    }
+}
+
+}  // namespace LinAlg
+}  // namespace ML
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <vector>
+
+#include "Types.h"
+
+namespace ML {
+namespace LinAlg {
+
+// Compute C = A^T * A for a row-major (rows x cols) matrix A, C is (cols x cols)
+void gram(const fp32* a, const std::size_t rows, const std::size_t cols, std::vector<fp64>& c);
+
+// Eigen decomposition of a symmetric (n x n) row-major matrix using cyclic Jacobi rotations
+// eigenvalues are sorted in descending order and column i of eigenvectors (row-major, n x n) belongs to eigenvalue i
+// The input matrix is destroyed, the rotations accumulate in an n x n workspace
+void symmetricEigen(std::vector<fp64>& a, const std::size_t n, std::vector<fp64>& eigenvalues, std::vector<fp64>& eigenvectors);
+
+}  // namespace LinAlg
+}  // namespace ML
@@ -1,11 +1,27 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
 #include <sstream>
 #include <vector>
 
+#include "Allocator.h"
+#include "AsyncInference.h"
 #include "Config.h"
+#include "DeltaInference.h"
 #include "Model.h"
+#include "ModelLoader.h"
+#include "Numa.h"
+#include "Evaluation.h"
+#include "Hash.h"
+#include "ParallelInference.h"
+#include "Pipeline.h"
+#include "ResultCache.h"
+#include "Scheduler.h"
+#include "Server.h"
+#include "Verify.h"
 #include "Types.h"
 #include "Utils.h"
+#include "kernels/Kernels.h"
 #include "layers/Convolutional.h"
 #include "layers/Dense.h"
 #include "layers/Layer.h"
@@ -15,138 +31,36 @@
 
 #ifdef ZEDBOARD
 #include <file_transfer/file_transfer.h>
+#else
+#include <atomic>
+#include <thread>
 #endif
 
 namespace ML {
 
-// Build our ML toy model
-Model buildToyModel(const Path modelPath) {
-    Model model;
-    logInfo("--- Building Toy Model ---");
-
-    // --- Conv 1: L0 ---
-    // Input shape: 64x64x3
-    // Output shape: 60x60x32
-    model.addLayer<ConvolutionalLayer>(
-        LayerParams{sizeof(fp32), {64, 64, 3}},                                    // Input Data
-        LayerParams{sizeof(fp32), {60, 60, 32}},                                   // Output Data
-        LayerParams{sizeof(fp32), {5, 5, 3, 32}, modelPath / "conv1_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {32}, modelPath / "conv1_biases.bin"}            // Bias
-    );
-
-    // --- Conv 2: L1 ---
-    // Input shape: 60x60x32
-    // Output shape: 56x56x32
-    model.addLayer<ConvolutionalLayer>(
-        LayerParams{sizeof(fp32), {60, 60, 32}},                                    // Input Data
-        LayerParams{sizeof(fp32), {56, 56, 32}},                                   // Output Data
-        LayerParams{sizeof(fp32), {5, 5, 32, 32}, modelPath / "conv2_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {32}, modelPath / "conv2_biases.bin"}            // Bias
-    );
-
-    // --- MPL 1: L2 ---
-    // Input shape: 56x56x32
-    // Output shape: 28x28x32
-    model.addLayer<MaxPoolingLayer>(
-        LayerParams{sizeof(fp32), {56, 56, 32}},                                    // Input Data
-        LayerParams{sizeof(fp32), {28, 28, 32}}                                   // Output Data
-    );
-
-    // --- Conv 3: L3 ---
-    // Input shape: 28x28x32
-    // Output shape: 26x26x64
-    model.addLayer<ConvolutionalLayer>(
-        LayerParams{sizeof(fp32), {28, 28, 32}},                                    // Input Data
-        LayerParams{sizeof(fp32), {26, 26, 64}},                                   // Output Data
-        LayerParams{sizeof(fp32), {3, 3, 32, 64}, modelPath / "conv3_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {64}, modelPath / "conv3_biases.bin"}            // Bias
-    );
-
-    // --- Conv 4: L4 ---
-    // Input shape: 26x26x64
-    // Output shape: 24x24x64
-    model.addLayer<ConvolutionalLayer>(
-        LayerParams{sizeof(fp32), {26, 26, 64}},                                    // Input Data
-        LayerParams{sizeof(fp32), {24, 24, 64}},                                   // Output Data
-        LayerParams{sizeof(fp32), {3, 3, 64, 64}, modelPath / "conv4_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {64}, modelPath / "conv4_biases.bin"}            // Bias
-    );
-
-    // --- MPL 2: L5 ---
-    // Input shape: 24x24x64
-    // Output shape: 12x12x64
-    model.addLayer<MaxPoolingLayer>(
-        LayerParams{sizeof(fp32), {24, 24, 64}},                                    // Input Data
-        LayerParams{sizeof(fp32), {12, 12, 64}}                                   // Output Data
-    );
-
-    // --- Conv 5: L6 ---
-    // Input shape: 12x12x64
-    // Output shape: 10x10x64
-    model.addLayer<ConvolutionalLayer>(
-        LayerParams{sizeof(fp32), {12, 12, 64}},                                    // Input Data
-        LayerParams{sizeof(fp32), {10, 10, 64}},                                   // Output Data
-        LayerParams{sizeof(fp32), {3, 3, 64, 64}, modelPath / "conv5_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {64}, modelPath / "conv5_biases.bin"}            // Bias
-    );
-
-    // --- Conv 6: L7 ---
-    // Input shape: 10x10x64
-    // Output shape: 8x8x128
-    model.addLayer<ConvolutionalLayer>(
-        LayerParams{sizeof(fp32), {10, 10, 64}},                                    // Input Data
-        LayerParams{sizeof(fp32), {8, 8, 128}},                                   // Output Data
-        LayerParams{sizeof(fp32), {3, 3, 64, 128}, modelPath / "conv6_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {128}, modelPath / "conv6_biases.bin"}            // Bias
-    );
-
-    // --- MPL 3: L8 ---
-    // Input shape: 8x8x128
-    // Output shape: 4x4x128
-    model.addLayer<MaxPoolingLayer>(
-        LayerParams{sizeof(fp32), {8, 8, 128}},                                    // Input Data
-        LayerParams{sizeof(fp32), {4, 4, 128}}                                   // Output Data
-    );
-
-    // --- Flatten 1: L9 ---
-    // Input shape: 4x4x128
-    // Output shape: 2048
-    model.addLayer<Flatten>(
-        LayerParams{sizeof(fp32), {4, 4, 128}},                                    // Input Data
-        LayerParams{sizeof(fp32), {2048}}                                   // Output Data
-    );
-
-    // --- Dense 1: L10 ---
-    // Input shape: 2048
-    // Output shape: 256
-    model.addLayer<DenseLayer>(
-        LayerParams{sizeof(fp32), {2048}},                                    // Input Data
-        LayerParams{sizeof(fp32), {256}},                                   // Output Data
-        LayerParams{sizeof(fp32), {2048, 256}, modelPath / "dense1_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {256}, modelPath / "dense1_biases.bin"}            // Bias
-    );
-
-    // --- Dense 2: L11 ---
-    // Input shape: 256
-    // Output shape: 200
-    model.addLayer<DenseLayer>(
-        LayerParams{sizeof(fp32), {256}},                                    // Input Data
-        LayerParams{sizeof(fp32), {200}},                                   // Output Data
-        LayerParams{sizeof(fp32), {256, 200}, modelPath / "dense2_weights.bin"}, // Weights
-        LayerParams{sizeof(fp32), {200}, modelPath / "dense2_biases.bin"},           // Bias
-        false                                                                    // Do not use Relu on last layer
-    );
-
-    // --- Softmax 1: L12 ---
-    // Input shape: 200
-    // Output shape: 200
-    model.addLayer<SoftMaxLayer>(
-        LayerParams{sizeof(fp32), {200}},                                    // Input Data
-        LayerParams{sizeof(fp32), {200}}                                   // Output Data
-    );
-
-    return model;
-}
+// Input and reference output of the end-to-end tests (image_0 and the last layer's golden output). The model's layer
+// timers are off while the fixture lives, so tests timing whole inferences do not log every layer
+struct ImageFixture {
+    ImageFixture(Model& model, const Path& basePath)
+        : img(model[0].getInputParams(), basePath / "image_0.bin"),
+          expected(model.getOutputLayer().getOutputParams(), basePath / "image_0_data" / "layer_11_output.bin"),
+          model(model),
+          layerTimers(model.hasLayerTimers()) {
+        img.loadData();
+        expected.loadData();
+        model.setLayerTimers(false);
+    }
+    ~ImageFixture() { model.setLayerTimers(layerTimers); }
+
+    ImageFixture(const ImageFixture&) = delete;
+    ImageFixture& operator=(const ImageFixture&) = delete;
+
+    LayerData img, expected;
+
+   private:
+    Model& model;
+    bool layerTimers;
+};
 
 void runBasicTest(const Model& model, const Path& basePath) {
     logInfo("--- Running Basic Test ---");
@@ -177,7 +91,7 @@ void runBasicTest(const Model& model, const Path& basePath) {
     img.compareWithinPrint<fp32>(imgCopy);
 }
 
-void runLayerTest(const std::size_t layerNum, const Model& model, const Path& basePath) {
+void runLayerTest(const std::size_t layerNum, const Model& model, const Path& basePath, const Layer::InfType infType = Layer::InfType::NAIVE) {
     // Load an image
     logInfo(std::string("--- Running Layer Test ") + std::to_string(layerNum) + "---");
 
@@ -201,7 +115,7 @@ void runLayerTest(const std::size_t layerNum, const Model& model, const Path& ba
 
     // Run inference on the model
     timer.start();
-    const LayerData& output = model.inferenceLayer(img, layerNum, Layer::InfType::NAIVE);
+    const LayerData& output = model.inferenceLayer(img, layerNum, infType);
     timer.stop();
 
     // Compare the output
@@ -246,6 +160,28 @@ void runLastLayerTest(const Model& model, const Path& basePath) {
     output2.compareWithinPrint<fp32>(expected);
 }
 
+void runSoftMaxTest(const Model& model, const Path& basePath) {
+    const std::size_t layerNum = 12;
+    logInfo("--- Running SoftMax SIMD Test ---");
+
+    // Dense L11 output (the logits) is not saved, so produce it from the saved L10 output
+    LayerData img({sizeof(fp32), model[layerNum - 1].getInputParams().dims, basePath / "image_0_data/layer_10_output.bin"});
+    img.loadData();
+    const LayerData& logits = model.inferenceLayer(img, layerNum - 1, Layer::InfType::NAIVE);
+
+    LayerData expected(model.inferenceLayer(logits, layerNum, Layer::InfType::NAIVE));
+    const LayerData& output = model.inferenceLayer(logits, layerNum, Layer::InfType::SIMD);
+    output.compareWithinPrint<fp32>(expected);
+
+    // Fused top-5 straight from the logits
+    const SoftMaxLayer& softmax = static_cast<const SoftMaxLayer&>(model[layerNum]);
+    std::cout << "Top-5:";
+    for (const Prediction& p : softmax.computeTopK(logits, 5)) {
+        std::cout << " " << p.index << " (" << p.score << ")";
+    }
+    std::cout << std::endl;
+}
+
 void runInferenceTest(const Model& model, const Path& basePath) {
     // Load an image
     logInfo("--- Running Inference Test ---");
@@ -268,12 +204,632 @@ void runInferenceTest(const Model& model, const Path& basePath) {
     output.compareWithinPrint<fp32>(expected);
 }
 
+void runLowRankTest(Model& model, const Path& basePath) {
+    const std::size_t layerNum = 10;
+    const fp32 budget = 0.99f;
+
+    logInfo("--- Running Low-Rank Dense Test ---");
+    DenseLayer& dense = static_cast<DenseLayer&>(model[layerNum]);
+    std::size_t fullBytes = dense.weightBytes();
+    std::size_t fullMacs = dense.macCount();
+
+    const Path data = basePath / "image_0_data";
+    LayerData in({sizeof(fp32), dense.getInputParams().dims, data / ("layer_" + std::to_string(layerNum - 1) + "_output.bin")});
+    in.loadData();
+    LayerData expected(dense.getOutputParams(), data / ("layer_" + std::to_string(layerNum) + "_output.bin"));
+    expected.loadData();
+    std::size_t rank = dense.tuneRank(in, expected, budget);
+    dense.releaseFullWeights();
+
+    std::cout << "L" << layerNum << " rank " << rank << "/" << dense.getMaxRank() << " (similarity budget " << budget << "): "
+              << "weights " << fullBytes << " -> " << dense.weightBytes() << " bytes, "
+              << "MACs " << fullMacs << " -> " << dense.macCount() << std::endl;
+
+    // End-to-end accuracy with the factorized layer
+    runInferenceTest(model, basePath);
+
+    // The same factorization from a model file attribute
+    ModelDesc desc = loadModelDesc(basePath / "model" / "toy.model");
+    desc.layers[layerNum].attrs["rank"] = std::to_string(rank);
+    Model fromFile = buildModel(desc);
+    fromFile.allocLayers();
+    const DenseLayer& loaded = static_cast<const DenseLayer&>(fromFile[layerNum]);
+    bool pass = loaded.isLowRank() && loaded.getRank() == rank && !loaded.getWeightData().isAlloced();
+    fromFile.freeLayers();
+
+    // Back to full rank, so later tests measure the model as loaded
+    dense.clearLowRank();
+    pass = pass && !dense.isLowRank() && dense.weightBytes() == fullBytes;
+    std::cout << "Low-rank dense: " << (pass ? "True" : "False") << std::endl;
+}
+
+// Single pass compare against the scalar double loop on an array large enough to be split over threads
+void runCompareTest() {
+    logInfo("--- Running Compare Test ---");
+    const std::size_t count = 1 << 20;
+    LayerData a(LayerParams(sizeof(fp32), {count}));
+    LayerData b(LayerParams(sizeof(fp32), {count}));
+    a.allocData();
+    b.allocData();
+    for (std::size_t i = 0; i < count; i++) {
+        a.get<fp32>(i) = (fp32)((i * 2654435761u) % 1000) / 500.0f - 1.0f;
+        b.get<fp32>(i) = a.get<fp32>(i) + (fp32)(i % 7) * 1e-4f;
+    }
+    const std::size_t worst = count - 3;
+    b.get<fp32>(worst) += 0.5f;
+
+    Timer scalarTimer("Scalar compare");
+    scalarTimer.start();
+    double dot = 0, aSq = 0, bSq = 0, diffSq = 0;
+    for (std::size_t i = 0; i < count; i++) {
+        fp32 x = a.get<fp32>(i), y = b.get<fp32>(i);
+        dot += x * y;
+        aSq += x * x;
+        bSq += y * y;
+        diffSq += (x - y) * (x - y);
+    }
+    scalarTimer.stop();
+
+    Timer timer("Single pass compare");
+    timer.start();
+    CompareResult result = a.compareResult(b);
+    timer.stop();
+
+    fp32 cosine = dot / std::max(aSq, bSq);
+    fp32 rmse = std::sqrt(diffSq / count);
+    bool match = std::fabs(result.cosine - cosine) < 1e-5f && std::fabs(result.rmse - rmse) < 1e-5f * rmse && result.worstIndex == worst;
+    std::cout << "Compare: " << (match ? "True" : "False") << " cosine " << result.cosine << " (" << cosine << "), rmse " << result.rmse << " (" << rmse
+              << "), max diff " << result.maxAbsDiff << " at " << result.worstIndex << " (" << worst << ")" << std::endl;
+    if (!match) logError("Single pass compare does not match the scalar loop");
+}
+
+// Run (and time) the SIMD layers on every kernel level this CPU supports, then go back to the default one
+void runKernelIsaTest(const Model& model, const Path& basePath) {
+    const Kernels::Isa defaultIsa = Kernels::active().isa;
+    const Kernels::Isa levels[] = {Kernels::Isa::SCALAR, Kernels::Isa::GENERIC, Kernels::Isa::SSE42, Kernels::Isa::AVX2, Kernels::Isa::AVX512};
+
+    for (Kernels::Isa isa : levels) {
+        if (!Kernels::isAvailable(isa)) continue;
+        Kernels::select(isa);
+        logInfo(std::string("--- Kernel level: ") + Kernels::isaName(isa) + " ---");
+        runLayerTest(1, model, basePath, Layer::InfType::SIMD);
+        runLayerTest(10, model, basePath, Layer::InfType::SIMD);
+    }
+
+    Kernels::select(defaultIsa);
+}
+
+// Plan blocked layouts for the SIMD backends and check the layers and the full model against the NHWC reference
+void runLayoutTest(Model& model, const Path& basePath) {
+    logInfo("--- Running Layout Test ---");
+    model.planLayouts(Layer::InfType::SIMD);
+    std::cout << "SIMD layouts: " << model.layoutPlanString(Layer::InfType::SIMD) << std::endl;
+
+    runLayerTest(1, model, basePath, Layer::InfType::SIMD);
+    runLayerTest(2, model, basePath, Layer::InfType::SIMD);
+
+    ImageFixture fixture(model, basePath);
+    Timer timer("Full SIMD Inference");
+    timer.start();
+    const LayerData& output = model.inference(fixture.img, Layer::InfType::SIMD);
+    timer.stop();
+    output.compareWithinPrint<fp32>(fixture.expected);
+
+    model.resetLayouts();
+}
+
+// A fixed camera: frames that change a small patch of the previous one, checked against full inference of each frame
+void runDeltaTest(Model& model, const Path& basePath) {
+    logInfo("--- Running Delta Inference Test ---");
+    ImageFixture fixture(model, basePath);
+    const LayerData& first = fixture.img;
+    LayerData second(model[0].getInputParams(), basePath / "image_1.bin");
+    second.loadData();
+
+    // Paste an 6x6 patch of the second image into a copy of the frame at (row, col)
+    auto paste = [&](const LayerData& frame, const std::size_t row, const std::size_t col) {
+        LayerData patched(frame);
+        const std::size_t width = frame.getParams().dims[ParamIndex::WIDTH], channels = frame.getParams().dims[ParamIndex::CHANNELS];
+        for (std::size_t h = row; h < row + 6; h++) {
+            std::size_t offset = (h * width + col) * channels;
+            std::copy(second.ptr<fp32>() + offset, second.ptr<fp32>() + offset + 6 * channels, patched.ptr<fp32>() + offset);
+        }
+        return patched;
+    };
+    std::vector<LayerData> frames;
+    frames.push_back(first);
+    frames.push_back(paste(frames.back(), 10, 12));
+    frames.push_back(paste(frames.back(), 40, 44));
+    frames.push_back(frames.back());
+    frames.push_back(second);
+
+    // The references run first, a full inference overwrites the activations the delta frames reuse
+    std::vector<LayerData> expected;
+    for (const LayerData& frame : frames) expected.push_back(model.inference(frame, Layer::InfType::SIMD));
+
+    DeltaInference delta(model);
+    std::size_t matching = 0;
+    for (std::size_t i = 0; i < frames.size(); i++) {
+        Timer timer("Frame " + std::to_string(i));
+        timer.start();
+        const LayerData& output = delta.infer(frames[i]);
+        timer.stop();
+        const Region& dirty = delta.lastDirty();
+        std::cout << "Frame " << i << " changed rows [" << dirty.h0 << ", " << dirty.h1 << ") cols [" << dirty.w0 << ", " << dirty.w1 << "): ";
+        matching += output.compareWithinPrint<fp32>(expected[i]) && output.compareResult(expected[i]).maxAbsDiff < 1e-5f;
+    }
+
+    // A pixel drifting by less than the tolerance per frame must still be picked up once the drift adds up
+    DeltaInference::Options tolerant;
+    tolerant.tolerance = 0.01f;
+    DeltaInference drifting(model, tolerant);
+    LayerData drifted(first);
+    drifting.infer(drifted);
+    drifted.get<fp32>(0) += 0.006f;
+    bool drift = drifting.infer(drifted).isAlloced() && drifting.lastDirty().empty();
+    drifted.get<fp32>(0) += 0.006f;
+    drift = drift && drifting.infer(drifted).isAlloced() && !drifting.lastDirty().empty();
+
+    std::cout << "Delta inference: " << delta.stats().toString() << std::endl;
+    if (matching != frames.size()) logError("Delta inference does not match full inference");
+    if (!drift) logError("Delta inference misses a drift within the tolerance");
+}
+
+// The toy model ships without trained exit heads, so this attaches its own classifier (L11 dense + softmax) after L10
+// as an exit: taken, it must give the full model's output, and the threshold decides whether it is taken
+void runExitTest(const Path& basePath) {
+    logInfo("--- Running Early Exit Test ---");
+    ModelDesc desc = loadModelDesc(basePath / "model" / "toy.model");
+    LayerDesc head = desc.layers[11];
+    head.type = "exit";
+    head.attrs.erase("relu");
+    desc.exits.push_back(ExitDesc{10, 0.0f, head});
+
+    Model model = buildModel(desc);
+    model.allocLayers();
+    ImageFixture fixture(model, basePath);
+    const LayerData& img = fixture.img;
+    const LayerData& expected = fixture.expected;
+
+    // Threshold 0 always exits, one above any probability never does
+    bool pass = true;
+    for (fp32 threshold : {0.0f, 2.0f}) {
+        model.setExitThreshold(0, threshold);
+        for (std::size_t i = 0; i < 4; i++) {
+            const LayerData& output = model.inference(img, Layer::InfType::SIMD);
+            pass = pass && output.compareResult(expected).cosine > 0.999f && model.getLastExit() == (threshold > 1 ? 1 : 0);
+        }
+    }
+    std::cout << model.exitReport();
+
+    // An exited result is cached like any other, but only served under the thresholds it was computed with
+#ifndef ZEDBOARD
+    ResultCache cache;
+    model.setResultCache(&cache, 1);
+    model.setExitThreshold(0, 0.0f);
+    LayerData exited = model.inference(img, Layer::InfType::SIMD);
+    model.setExitThreshold(0, 2.0f);
+    model.inference(img, Layer::InfType::SIMD);
+    pass = pass && cache.stats().hits == 0 && model.getLastExit() == 1;
+    model.setExitThreshold(0, 0.0f);
+    pass = pass && model.inference(img, Layer::InfType::SIMD).compareResult(exited).maxAbsDiff == 0 && cache.stats().hits == 1;
+    model.setResultCache(nullptr, 0);
+
+    // Async requests go through the same exits
+    {
+        TaskScheduler::Options poolOptions;
+        poolOptions.threads = 2;
+        TaskScheduler pool(poolOptions);
+        AsyncInference async(model, pool);
+        model.setExitThreshold(0, 0.0f);
+        AsyncInference::Ticket ticket = async.submit(img);
+        const AsyncInference::Result& result = ticket.result().get();
+        pass = pass && result.status == AsyncInference::Status::DONE && result.output.compareResult(exited).maxAbsDiff == 0 && model.getLastExit() == 0;
+    }
+#endif
+
+    model.freeLayers();
+    std::cout << "Early exit: " << (pass ? "True" : "False") << std::endl;
+}
+
+// Every layer is charged exactly its weights, biases, output and prepacked copies, per-call temporaries and result cache
+// entries are charged while they exist, a warm inference keeps nothing, and a freed model gives back all it held
+void runMemoryTest(Model& model, const Path& basePath) {
+    logInfo("--- Running Memory Accounting Test ---");
+    bool pass = true;
+    std::size_t layersTotal = 0;
+    for (std::size_t i = 0; i < model.getNumLayers(); i++) {
+        const Layer& layer = model[i];
+        const LayerData* weights = nullptr;
+        const LayerData* biases = nullptr;
+        std::size_t packed = 0;
+        if (layer.getLType() == Layer::LayerType::CONVOLUTIONAL) {
+            const ConvolutionalLayer& conv = static_cast<const ConvolutionalLayer&>(layer);
+            weights = &conv.getWeightData();
+            biases = &conv.getBiasData();
+            // Blocked weights hold the same values regrouped
+            packed = layer.getLayout() != Layout::NHWC ? conv.getWeightParams().byte_size() : 0;
+        } else if (layer.getLType() == Layer::LayerType::DENSE) {
+            const DenseLayer& dense = static_cast<const DenseLayer&>(layer);
+            weights = &dense.getWeightData();
+            biases = &dense.getBiasData();
+            packed = dense.isLowRank() ? dense.weightBytes() : 0;
+        }
+        MemoryUsage usage = layer.getMemory().current();
+        pass = pass && usage[MemoryKind::WEIGHTS] == (weights && weights->isAlloced() ? weights->getParams().byte_size() : 0);
+        pass = pass && usage[MemoryKind::BIASES] == (biases && biases->isAlloced() ? biases->getParams().byte_size() : 0);
+        pass = pass && usage[MemoryKind::ACTIVATIONS] == (layer.isView() ? 0 : layer.getOutputParams().byte_size());
+        pass = pass && usage[MemoryKind::PACKED] == packed && layer.getMemory().peakTotal() >= usage.total();
+        layersTotal += usage.total();
+    }
+    pass = pass && model.memoryUsage().total() == layersTotal + model.memoryUsage()[MemoryKind::SCRATCH];
+
+    ImageFixture fixture(model, basePath);
+    const LayerData& img = fixture.img;
+    model.inference(img, Layer::InfType::SIMD);
+    const std::size_t held = model.memoryUsage().total();
+    model.getMemory().resetPeak();
+    model.inference(img, Layer::InfType::SIMD);
+    pass = pass && model.memoryUsage().total() == held && model.getMemory().peakTotal() >= held;
+
+    // A region computation charges its input window and result to the layer only while it runs
+    MemoryAccount& first = model[0].getMemory();
+    const std::size_t firstHeld = first.current().total();
+    first.resetPeak();
+    model[0].computeRegion(img, Region{0, 1, 0, 1});
+    pass = pass && first.current().total() == firstHeld && first.peakTotal() > firstHeld;
+
+#ifndef ZEDBOARD
+    // Cache entries are the model's scratch while the cache is attached
+    {
+        ResultCache cache;
+        const std::size_t outBytes = model.getOutputLayer().getOutputParams().byte_size();
+        model.setResultCache(&cache, 1);
+        model.inference(img, Layer::InfType::SIMD);
+        const std::size_t attached = model.getScratchMemory().current().total();
+        std::cout << model.memoryReport();
+        model.setResultCache(nullptr, 0);
+        pass = pass && cache.getMemory().current()[MemoryKind::SCRATCH] == outBytes;
+        pass = pass && attached - model.getScratchMemory().current().total() == outBytes;
+    }
+#else
+    std::cout << model.memoryReport();
+#endif
+
+    const std::size_t before = MemoryAccount::process().current().total();
+    {
+        Model other = loadModel(basePath / "model" / "toy.model");
+        other.allocLayers();
+        pass = pass && MemoryAccount::process().current().total() - before == other.memoryUsage().total() && other.memoryUsage()[MemoryKind::WEIGHTS] > 0;
+        other.freeLayers();
+        pass = pass && other.memoryUsage().total() == 0 && other.getMemory().peakTotal() > 0;
+    }
+    pass = pass && MemoryAccount::process().current().total() == before;
+
+    std::cout << "Memory accounting: " << (pass ? "True" : "False") << std::endl;
+}
+
+#ifndef ZEDBOARD
+// Stream copies of an image through a pipelined model, every result must match the reference output
+void runPipelineTest(Model& model, const Path& basePath) {
+    const std::size_t numImages = 64;
+    logInfo("--- Running Pipeline Test ---");
+    ImageFixture fixture(model, basePath);
+    const LayerData& img = fixture.img;
+    const LayerData& expected = fixture.expected;
+
+    model.planLayouts(Layer::InfType::SIMD);
+    Pipeline::Options options;
+    options.stages = 4;
+    {
+        Pipeline pipeline(model, img, options);
+        std::cout << "Stages: " << pipeline.stagesString() << std::endl;
+
+        // A camera feed: one thread keeps pushing frames while this one consumes the results
+        std::thread feed([&] {
+            for (std::size_t i = 0; i < numImages; i++) pipeline.push(img);
+            pipeline.close();
+        });
+
+        std::size_t matching = 0;
+        LayerData result(expected.getParams());
+        while (pipeline.pull(result)) matching += result.compare<fp32>(expected) > 0.999f;
+        feed.join();
+
+        std::cout << "Pipeline: " << matching << "/" << numImages << " results match, " << pipeline.imagesPerSecond() << " images/s" << std::endl;
+        if (matching != numImages) logError("Pipeline results do not match the reference");
+    }
+    model.resetLayouts();
+}
+
+// Worker placement on a made up two node host, and a pipeline whose pinned stages moved their layers' buffers
+void runNumaTest(Model& model, const Path& basePath) {
+    logInfo("--- Running NUMA Placement Test ---");
+    std::cout << "Host: " << NumaTopology::host().toString() << std::endl;
+
+    NumaTopology twoNodes;
+    twoNodes.nodes = {{0, {0, 1, 2, 3}}, {1, {4, 5, 6, 7}}};
+    auto placement = [&](const std::string& text) {
+        std::string cpus;
+        for (std::size_t w = 0; w < 5; w++) cpus += (w ? " " : "") + std::to_string(Affinity::parse(text).cpuFor(w, twoNodes));
+        return cpus;
+    };
+    bool pass = placement("compact") == "0 1 2 3 4" && placement("scatter") == "0 4 1 5 2" && placement("6,1-2") == "6 1 2 6 1" &&
+                placement("none") == "-1 -1 -1 -1 -1" && twoNodes.nodeOf(5) == 1;
+    try {
+        Affinity::parse("2-1");
+        pass = false;
+    } catch (const std::runtime_error&) {
+    }
+
+    // Interleaving falls back to plain pages on a single node host, the memory must work either way
+    NumaAllocator interleave(NumaAllocator::Policy::INTERLEAVE);
+    const std::size_t count = 256 * 1024;
+    {
+        LayerData values({sizeof(fp32), {count}});
+        values.setAllocator(interleave);
+        values.allocData();
+        for (std::size_t i = 0; i < count; i++) values.get<fp32>(i) = (fp32)i;
+        pass = pass && values.get<fp32>(count - 1) == (fp32)(count - 1);
+    }
+
+    // Interleaved and per node weights must give the golden outputs
+    for (NumaAllocator::Policy weights : {NumaAllocator::Policy::INTERLEAVE, NumaAllocator::Policy::NODE}) {
+        EvalOptions eval;
+        eval.backends = {Layer::InfType::SIMD};
+        eval.threads = 2;
+        eval.affinity = Affinity::parse("scatter");
+        eval.weights = weights;
+        pass = pass && evaluate(loadModelDesc(basePath / "model" / "toy.model"), basePath, eval).failures() == 0;
+    }
+
+    ImageFixture fixture(model, basePath);
+    const LayerData& img = fixture.img;
+    const LayerData& expected = fixture.expected;
+    Pipeline::Options options;
+    options.stages = 2;
+    options.affinity = Affinity::parse("compact");
+    {
+        Pipeline pipeline(model, img, options);
+        for (std::size_t i = 0; i < 4; i++) pipeline.push(img);
+        pipeline.close();
+        LayerData result(expected.getParams());
+        while (pipeline.pull(result)) pass = pass && result.compare<fp32>(expected) > 0.999f;
+    }
+    pass = pass && model.inference(img, Layer::InfType::SIMD).compare<fp32>(expected) > 0.999f;
+
+    std::cout << "NUMA placement: " << (pass ? "True" : "False") << std::endl;
+}
+
+// Dependencies must hold under stealing, an exception must reach run(), and the tile graph must match the golden output
+void runSchedulerTest(Model& model, const Path& basePath) {
+    logInfo("--- Running Task Scheduler Test ---");
+    TaskScheduler::Options options;
+    options.threads = 4;
+    options.affinity = Affinity::parse("compact");
+    TaskScheduler scheduler(options);
+
+    // Rows of tasks, each waiting for its three neighbours in the row before
+    const std::size_t rows = 8, cols = 16;
+    std::vector<std::size_t> stamps(rows * cols);
+    std::atomic<std::size_t> clock(0);
+    TaskGraph grid;
+    for (std::size_t r = 0; r < rows; r++) {
+        for (std::size_t c = 0; c < cols; c++) {
+            std::vector<TaskGraph::TaskId> deps;
+            for (std::size_t d = c ? c - 1 : 0; r && d <= std::min(c + 1, cols - 1); d++) deps.push_back((r - 1) * cols + d);
+            grid.add([&, r, c] { stamps[r * cols + c] = ++clock; }, deps);
+        }
+    }
+    bool pass = true;
+    for (int run = 0; run < 3; run++) {
+        scheduler.run(grid);
+        for (std::size_t r = 1; r < rows; r++) {
+            for (std::size_t c = 0; c < cols; c++) {
+                for (std::size_t d = c ? c - 1 : 0; d <= std::min(c + 1, cols - 1); d++) pass = pass && stamps[(r - 1) * cols + d] < stamps[r * cols + c];
+            }
+        }
+    }
+
+    TaskGraph failing;
+    std::atomic<std::size_t> after(0);
+    TaskGraph::TaskId root = failing.add([] { throw std::runtime_error("task failed"); });
+    failing.add([&] { after++; }, {root});
+    try {
+        scheduler.run(failing);
+        pass = false;
+    } catch (const std::runtime_error&) {
+    }
+    pass = pass && after == 0;
+
+    {
+        ImageFixture fixture(model, basePath);
+        ParallelInference parallel(model, scheduler);
+        std::cout << "Graph: " << parallel.graphString() << std::endl;
+        for (int run = 0; run < 3; run++) pass = pass && parallel.infer(fixture.img).compare<fp32>(fixture.expected) > 0.999f;
+
+        Timer timer("Parallel inference (" + std::to_string(scheduler.numThreads()) + " workers)");
+        timer.start();
+        parallel.infer(fixture.img);
+        timer.stop();
+    }
+
+    TaskScheduler::Stats stats = scheduler.stats();
+    std::cout << "Scheduler: " << stats.runs << " runs, " << stats.tasks << " tasks, " << stats.steals << " steals" << std::endl;
+    std::cout << "Task scheduler: " << (pass ? "True" : "False") << std::endl;
+}
+
+// Futures and callbacks deliver the output, cancelled and expired requests never run, a full queue rejects
+void runAsyncTest(Model& model, const Path& basePath) {
+    logInfo("--- Running Async Inference Test ---");
+    using Status = AsyncInference::Status;
+    ImageFixture fixture(model, basePath);
+    const LayerData& img = fixture.img;
+    const LayerData& expected = fixture.expected;
+
+    // The scheduler's caller is worker 0, the async jobs need one more
+    TaskScheduler::Options poolOptions;
+    poolOptions.threads = 2;
+    TaskScheduler pool(poolOptions);
+
+    bool pass = true;
+    {
+        AsyncInference async(model, pool);
+        std::atomic<std::size_t> callbacks(0);
+        auto count = [&](const AsyncInference::Result&) { callbacks++; };
+
+        AsyncInference::Ticket first = async.submit(img, count);
+        AsyncInference::Ticket cancelled = async.submit(img, count);
+        cancelled.cancel();
+        AsyncInference::Ticket expired = async.submit(img, count, AsyncInference::Clock::now());
+        AsyncInference::Ticket last = async.submit(img, count);
+
+        const AsyncInference::Result& result = last.result().get();
+        pass = pass && first.result().get().status == Status::DONE && result.status == Status::DONE && result.output.compare<fp32>(expected) > 0.999f;
+        pass = pass && cancelled.result().get().status == Status::CANCELLED && expired.result().get().status == Status::EXPIRED && callbacks == 4;
+        std::cout << "Async: " << async.stats().toString() << ", last request queued " << result.queueUs / 1000 << "ms, ran " << result.runUs / 1000
+                  << "ms" << std::endl;
+        pass = pass && async.stats().layersSkipped == 0;
+    }
+    {
+        AsyncInference::Options full;
+        full.queueCapacity = 0;
+        AsyncInference async(model, pool, full);
+        pass = pass && async.submit(img).result().get().status == Status::REJECTED;
+    }
+
+    std::cout << "Async inference: " << (pass ? "True" : "False") << std::endl;
+}
+
+// Send a burst of requests for the test images through the batching server, every top-1 must match the reference
+void runServerTest(Model& model, const Path& basePath) {
+    const std::size_t numImages = 3, numRequests = 48;
+    logInfo("--- Running Batching Server Test ---");
+
+    std::vector<LayerData> images;
+    std::vector<std::size_t> expected;
+    for (std::size_t i = 0; i < numImages; i++) {
+        Path dir = basePath / ("image_" + std::to_string(i) + "_data");
+        images.emplace_back(model[0].getInputParams(), basePath / ("image_" + std::to_string(i) + ".bin"));
+        images.back().loadData();
+        LayerData reference(model.getOutputLayer().getOutputParams(), dir / "layer_11_output.bin");
+        reference.loadData();
+        expected.push_back(topK(reference, 1)[0].index);
+    }
+
+    BatchServer::Options options;
+    options.maxBatch = 4;
+    options.maxWaitUs = 1000;
+
+    std::size_t matching = 0;
+    {
+        BatchServer server(model, options, [&](const BatchServer::Response& response) {
+            matching += response.error.empty() && response.predictions[0].index == expected[response.id % numImages];
+        });
+        for (std::size_t i = 0; i < numRequests; i++) server.submit(i, images[i % numImages]);
+        server.close();
+        std::cout << server.statsString();
+    }
+
+    std::cout << "Server: " << matching << "/" << numRequests << " top-1 predictions match" << std::endl;
+    if (matching != numRequests) logError("Batched predictions do not match the reference");
+}
+
+// Repeated images come from the result cache, CLOCK keeps the entries that get hits, and concurrent use keeps entries intact
+void runCacheTest(Model& model, const Path& basePath) {
+    logInfo("--- Running Result Cache Test ---");
+    ImageFixture fixture(model, basePath);
+    const LayerData& first = fixture.img;
+    LayerData second(model[0].getInputParams(), basePath / "image_1.bin");
+    second.loadData();
+
+    ResultCache cache;
+    model.setResultCache(&cache, 1);
+    LayerData computed = model.inference(first, Layer::InfType::SIMD);
+    model.inference(second, Layer::InfType::SIMD);
+    Timer timer("Cached inference");
+    timer.start();
+    const LayerData& cached = model.inference(first, Layer::InfType::SIMD);
+    timer.stop();
+    bool pass = cached.compareResult(computed).maxAbsDiff == 0;
+    ResultCache::Stats stats = cache.stats();
+    pass = pass && stats.hits == 1 && stats.misses == 2;
+    std::cout << "Model: " << stats.toString() << std::endl;
+    model.setResultCache(nullptr, 0);
+
+    // One stripe with room for four outputs: key 0 is hit before the fifth insert, so key 1 is evicted instead
+    ResultCache::Options small;
+    small.stripes = 1;
+    LayerData out(LayerParams(sizeof(fp32), {200}));
+    out.allocData();
+    small.capacityBytes = 4 * (out.getParams().byte_size() + 128);
+    ResultCache clock(small);
+    for (std::uint64_t key = 0; key < 4; key++) clock.insert(key << 32, out);
+    clock.lookup(0, out);
+    clock.insert(std::uint64_t(4) << 32, out);
+    pass = pass && clock.lookup(0, out) && !clock.lookup(std::uint64_t(1) << 32, out) && clock.stats().evictions == 1;
+    std::cout << "Clock: " << clock.stats().toString() << std::endl;
+
+    // Threads share a cache smaller than their working set, every hit must hold its own key's values
+    ResultCache::Options shared;
+    shared.capacityBytes = 24 * (out.getParams().byte_size() + 128);
+    shared.stripes = 4;
+    ResultCache concurrent(shared);
+    std::atomic<std::size_t> corrupt(0);
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < 4; t++) {
+        threads.emplace_back([&, t] {
+            LayerData value(LayerParams(sizeof(fp32), {200}));
+            value.allocData();
+            for (std::size_t i = 0; i < 4000; i++) {
+                std::uint64_t id = (i * 7 + t * 13) % 64, key = hash64(&id, sizeof(id));
+                if (concurrent.lookup(key, value)) {
+                    for (std::size_t j = 0; j < 200; j++) corrupt += value.ptr<fp32>()[j] != (fp32)(id + j);
+                } else {
+                    for (std::size_t j = 0; j < 200; j++) value.ptr<fp32>()[j] = (fp32)(id + j);
+                    concurrent.insert(key, value);
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) thread.join();
+    pass = pass && corrupt == 0 && concurrent.stats().bytes <= shared.capacityBytes;
+    std::cout << "Concurrent: " << concurrent.stats().toString() << std::endl;
+
+    std::cout << "Result cache: " << (pass ? "True" : "False") << std::endl;
+    if (!pass) logError("Result cache test failed");
+}
+
+// Random layer shapes on every backend against the naive one
+void runVerifyTest() {
+    logInfo("--- Running Kernel Verification ---");
+    VerifyOptions options;
+    options.cases = 40;
+    VerifyReport report = verifyKernels(options);
+    std::cout << report.summary();
+    if (!report.failures.empty()) logError("Kernel verification failed");
+}
+
+// Every backend over every test image, one table
+void runEvaluation(const Path& basePath) {
+    logInfo("--- Running Evaluation ---");
+    EvalReport report = evaluate(loadModelDesc(basePath / "model" / "toy.model"), basePath, EvalOptions());
+    std::cout << report.table();
+}
+#endif
+
 void runTests() {
     // Base input data path (determined from current directory of where you are running the command)
     Path basePath("data");  // May need to be altered for zedboards loading from SD Cards
 
+    // Must be set before any buffer is allocated
+    static HugePageAllocator hugePages;
+    if (Config::USE_HUGE_PAGES) Allocator::setDefault(hugePages);
+
+    logInfo(std::string("SIMD kernels: ") + Kernels::active().name);
+
     // Build the model and allocate the buffers
-    Model model = buildToyModel(basePath / "model");
+    Model model = loadModel(basePath / "model" / "toy.model");
     model.allocLayers();
 
     // Run some framework tests as an example of loading data
@@ -282,16 +838,65 @@ void runTests() {
     // Run a layer inference test
     runLayerTest(0, model, basePath);
 
+    // Convolution backends
+    runLayerTest(1, model, basePath, Layer::InfType::TILED);
+    runLayerTest(1, model, basePath, Layer::InfType::SIMD);
+
+    // Max pooling backends
+    runLayerTest(2, model, basePath, Layer::InfType::TILED);
+    runLayerTest(2, model, basePath, Layer::InfType::SIMD);
+
     runLastLayerTest(model, basePath);
 
+    runSoftMaxTest(model, basePath);
+
+    runCompareTest();
+
+    runKernelIsaTest(model, basePath);
+
+    runLayoutTest(model, basePath);
+
+    runDeltaTest(model, basePath);
+
+    runExitTest(basePath);
+
+#ifndef ZEDBOARD
+    runPipelineTest(model, basePath);
+    runNumaTest(model, basePath);
+    runSchedulerTest(model, basePath);
+    runAsyncTest(model, basePath);
+    runServerTest(model, basePath);
+    runCacheTest(model, basePath);
+    runEvaluation(basePath);
+    runVerifyTest();
+#endif
+
     // Run an end-to-end inference test
     runInferenceTest(model, basePath);
 
+    // Factorize the large dense layer and check the end-to-end result again
+    runLowRankTest(model, basePath);
+
+    // Memory held by the model, per layer and in total
+    runMemoryTest(model, basePath);
+
     // Clean up
     model.freeLayers();
     std::cout << "\n\n----- ML::runTests() COMPLETE -----\n";
 }
 
+// Validate a model description without allocating anything, prints the inferred shapes
+int runCheck(const Path& modelPath) {
+    try {
+        ModelDesc desc = loadModelDesc(modelPath);
+        std::cout << desc.summary() << modelPath << ": OK, " << desc.layers.size() << " layers\n";
+        return 0;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << '\n';
+        return 1;
+    }
+}
+
 } // namespace ML
 
 #ifdef ZEDBOARD
@@ -310,7 +915,145 @@ int main() {
     FileServer::start_file_transfer_server();
 }
 #else
-int main() {
+namespace ML {
+// Batching server on stdin/stdout, see ML::serve for the protocol. Logs and statistics go to stderr
+int runServer(int argc, char** argv) {
+    Path modelPath("data/model/toy.model");
+    BatchServer::Options options;
+    std::size_t cacheMb = 0;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--model") {
+            modelPath = Path(std::string(argv[i + 1]));
+        } else if (flag == "--cache-mb") {
+            cacheMb = std::stoul(argv[i + 1]);
+        } else if (flag == "--max-batch") {
+            options.maxBatch = std::stoul(argv[i + 1]);
+        } else if (flag == "--max-wait-us") {
+            options.maxWaitUs = std::stoul(argv[i + 1]);
+        } else if (flag == "--top-k") {
+            options.topK = std::stoul(argv[i + 1]);
+        } else {
+            std::cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    // The protocol owns stdout
+    std::streambuf* stdoutBuf = std::cout.rdbuf(std::cerr.rdbuf());
+    ModelDesc desc = loadModelDesc(modelPath);
+    Model model = buildModel(desc);
+    model.allocLayers();
+    model.planLayouts(options.infType);
+    std::cout.rdbuf(stdoutBuf);
+
+    ResultCache::Options cacheOptions;
+    cacheOptions.capacityBytes = cacheMb << 20;
+    ResultCache cache(cacheOptions);
+    if (cacheMb) model.setResultCache(&cache, modelVersion(desc));
+
+    std::ostream out(stdoutBuf);
+    int status = serve(model, options, std::cin, out, std::cerr);
+    model.freeLayers();
+    return status;
+}
+
+// Evaluate the backends over every test image, exits non-zero if a result is below the threshold
+int runEval(int argc, char** argv) {
+    Path modelPath("data/model/toy.model"), dataPath("data");
+    EvalOptions options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--model") {
+            modelPath = Path(std::string(argv[i + 1]));
+        } else if (flag == "--data") {
+            dataPath = Path(std::string(argv[i + 1]));
+        } else if (flag == "--threads") {
+            options.threads = std::stoul(argv[i + 1]);
+        } else if (flag == "--affinity") {
+            options.affinity = Affinity::parse(argv[i + 1]);
+        } else if (flag == "--weights") {
+            std::string placement = argv[i + 1];
+            if (placement == "first-touch") {
+                options.weights = NumaAllocator::Policy::FIRST_TOUCH;
+            } else if (placement == "interleave") {
+                options.weights = NumaAllocator::Policy::INTERLEAVE;
+            } else if (placement == "node") {
+                options.weights = NumaAllocator::Policy::NODE;
+            } else {
+                std::cerr << "Unknown weight placement " << placement << "\n";
+                return 1;
+            }
+        } else if (flag == "--min-similarity") {
+            options.minSimilarity = std::stof(argv[i + 1]);
+        } else if (flag == "--backends") {
+            std::istringstream names(argv[i + 1]);
+            const std::vector<std::pair<std::string, Layer::InfType>> known = {
+                {"naive", Layer::InfType::NAIVE}, {"threaded", Layer::InfType::THREADED}, {"tiled", Layer::InfType::TILED}, {"simd", Layer::InfType::SIMD}};
+            options.backends.clear();
+            for (std::string name; std::getline(names, name, ',');) {
+                auto it = std::find_if(known.begin(), known.end(), [&](const std::pair<std::string, Layer::InfType>& k) { return k.first == name; });
+                if (it == known.end()) {
+                    std::cerr << "Unknown backend " << name << "\n";
+                    return 1;
+                }
+                options.backends.push_back(it->second);
+            }
+        } else {
+            std::cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    EvalReport report = evaluate(loadModelDesc(modelPath), dataPath, options);
+    std::cout << report.table();
+    return report.failures() ? 2 : 0;
+}
+
+// Differential test of the backends on random shapes, exits non-zero on a failure
+int runVerify(int argc, char** argv) {
+    VerifyOptions options;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        std::string flag = argv[i];
+        if (flag == "--cases") {
+            options.cases = std::stoul(argv[i + 1]);
+        } else if (flag == "--seed") {
+            options.seed = std::stoul(argv[i + 1]);
+        } else if (flag == "--max-failures") {
+            options.maxFailures = std::stoul(argv[i + 1]);
+        } else if (flag == "--scratch") {
+            options.scratchDir = argv[i + 1];
+        } else {
+            std::cerr << "Unknown option " << flag << "\n";
+            return 1;
+        }
+    }
+
+    std::cout << "Verifying with seed " << options.seed << "\n";
+    VerifyReport report = verifyKernels(options);
+    std::cout << report.summary();
+    return report.failures.empty() ? 0 : 2;
+}
+}  // namespace ML
+
+int main(int argc, char** argv) {
+    if (argc == 3 && std::string(argv[1]) == "check") return ML::runCheck(argv[2]);
+    if (argc >= 2 && argc % 2 == 0 && std::string(argv[1]) == "serve") return ML::runServer(argc, argv);
+    if (argc >= 2 && argc % 2 == 0 && std::string(argv[1]) == "eval") return ML::runEval(argc, argv);
+    if (argc >= 2 && argc % 2 == 0 && std::string(argv[1]) == "verify") return ML::runVerify(argc, argv);
+    if (argc != 1) {
+        std::cerr << "Usage: " << argv[0] << "                 run the framework tests\n"
+                  << "       " << argv[0] << " check <file.model>  validate a model description\n"
+                  << "       " << argv[0] << " serve [--model <file.model>] [--max-batch <n>] [--max-wait-us <us>] [--top-k <k>] [--cache-mb <mb>]\n"
+                  << "                       batching server on stdin/stdout (protocol in src/Server.h)\n"
+                  << "       " << argv[0] << " eval [--model <file.model>] [--data <dir>] [--threads <n>] [--min-similarity <s>]\n"
+                  << "                       [--backends naive,threaded,tiled,simd] [--affinity none|compact|scatter|<cpus>]\n"
+                  << "                       [--weights first-touch|interleave|node]\n"
+                  << "                       per layer similarity of every backend over every test image\n"
+                  << "       " << argv[0] << " verify [--cases <n>] [--seed <s>] [--max-failures <n>] [--scratch <dir>]\n"
+                  << "                       random layer shapes on every backend against computeNaive\n";
+        return 1;
+    }
     ML::runTests();
 }
 #endif
\ No newline at end of file
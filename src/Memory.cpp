@@ -0,0 +1,145 @@
+#include "Memory.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace ML {
+
+const char* memoryKindName(const MemoryKind kind) {
+    switch (kind) {
+    case MemoryKind::WEIGHTS: return "weights";
+    case MemoryKind::BIASES: return "biases";
+    case MemoryKind::ACTIVATIONS: return "activations";
+    case MemoryKind::PACKED: return "packed";
+    case MemoryKind::SCRATCH: return "scratch";
+    }
+    return "?";
+}
+
+std::size_t MemoryUsage::total() const {
+    std::size_t sum = 0;
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) sum += bytes[k];
+    return sum;
+}
+
+MemoryUsage& MemoryUsage::operator+=(const MemoryUsage& other) {
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) bytes[k] += other.bytes[k];
+    reserved += other.reserved;
+    return *this;
+}
+
+std::string MemoryUsage::toString() const {
+    std::ostringstream oss;
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) {
+        if (bytes[k]) oss << memoryKindName((MemoryKind)k) << " " << formatBytes(bytes[k]) << ", ";
+    }
+    oss << "total " << formatBytes(total()) << " (" << formatBytes(reserved) << " reserved)";
+    return oss.str();
+}
+
+std::string formatBytes(const std::size_t bytes) {
+    std::ostringstream oss;
+    if (bytes < 1024) {
+        oss << bytes << "B";
+    } else {
+        double value = bytes / 1024.0;
+        const char* unit = "KB";
+        if (value >= 1024) {
+            value /= 1024;
+            unit = "MB";
+        }
+        if (value >= 1024) {
+            value /= 1024;
+            unit = "GB";
+        }
+        oss << std::fixed << std::setprecision(1) << value << unit;
+    }
+    return oss.str();
+}
+
+MemoryAccount::MemoryAccount(MemoryAccount* parent) : parent(parent), reservedNow(0), reservedTop(0), totalNow(0), topTotal(0) {
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) now[k] = top[k] = 0;
+}
+
+MemoryAccount& MemoryAccount::process() {
+    static MemoryAccount root(nullptr);
+    return root;
+}
+
+void MemoryAccount::raise(std::atomic<std::size_t>& top, const std::size_t value) {
+    std::size_t seen = top;
+    while (value > seen && !top.compare_exchange_weak(seen, value)) {
+    }
+}
+
+void MemoryAccount::charge(const MemoryKind kind, const std::size_t bytes, const std::size_t reserved) {
+    std::size_t k = (std::size_t)kind;
+    raise(top[k], now[k] += bytes);
+    raise(reservedTop, reservedNow += reserved);
+    raise(topTotal, totalNow += bytes);
+    if (parent) parent->charge(kind, bytes, reserved);
+}
+
+void MemoryAccount::release(const MemoryKind kind, const std::size_t bytes, const std::size_t reserved) {
+    now[(std::size_t)kind] -= bytes;
+    reservedNow -= reserved;
+    totalNow -= bytes;
+    if (parent) parent->release(kind, bytes, reserved);
+}
+
+MemoryUsage MemoryAccount::current() const {
+    MemoryUsage usage;
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) usage.bytes[k] = now[k];
+    usage.reserved = reservedNow;
+    return usage;
+}
+
+MemoryUsage MemoryAccount::peak() const {
+    MemoryUsage usage;
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) usage.bytes[k] = top[k];
+    usage.reserved = reservedTop;
+    return usage;
+}
+
+void MemoryAccount::resetPeak() {
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) top[k] = now[k].load();
+    reservedTop = reservedNow.load();
+    topTotal = totalNow.load();
+}
+
+void MemoryAccount::setParent(MemoryAccount* newParent) {
+    if (newParent == parent) return;
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) {
+        std::size_t bytes = now[k];
+        // The reserved bytes move with the first kind, they are not tracked per kind
+        std::size_t reserved = k == 0 ? reservedNow.load() : 0;
+        if (parent) parent->release((MemoryKind)k, bytes, reserved);
+        if (newParent) newParent->charge((MemoryKind)k, bytes, reserved);
+    }
+    parent = newParent;
+}
+
+MemoryCharge::MemoryCharge(MemoryAccount& account, const MemoryKind kind, const std::size_t bytes) : account(&account), kind(kind), bytes(bytes) {
+    account.charge(kind, bytes, bytes);
+}
+
+MemoryCharge::MemoryCharge(MemoryCharge&& other) noexcept : account(other.account), kind(other.kind), bytes(other.bytes) {
+    other.account = nullptr;
+}
+
+MemoryCharge& MemoryCharge::operator=(MemoryCharge&& other) noexcept {
+    if (this == &other) return *this;
+    reset();
+    account = other.account;
+    kind = other.kind;
+    bytes = other.bytes;
+    other.account = nullptr;
+    return *this;
+}
+
+void MemoryCharge::reset() {
+    if (account) account->release(kind, bytes, bytes);
+    account = nullptr;
+}
+
+}  // namespace ML
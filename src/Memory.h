@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+namespace ML {
+
+// What a LayerData buffer holds
+enum class MemoryKind { WEIGHTS, BIASES, ACTIVATIONS, PACKED, SCRATCH };
+constexpr std::size_t MEMORY_KINDS = 5;
+
+const char* memoryKindName(const MemoryKind kind);
+
+// Buffer bytes by kind, plus what the allocators reserved for them (alignment padding, huge page rounding)
+struct MemoryUsage {
+    std::size_t bytes[MEMORY_KINDS] = {};
+    std::size_t reserved = 0;
+
+    std::size_t operator[](const MemoryKind kind) const { return bytes[(std::size_t)kind]; }
+    std::size_t total() const;
+    MemoryUsage& operator+=(const MemoryUsage& other);
+
+    // e.g. "weights 1.2MB, biases 1.0KB, activations 400.0KB, total 1.6MB (1.7MB reserved)", kinds without bytes skipped
+    std::string toString() const;
+};
+
+// Bytes (e.g. "1.5MB"), exact below a kilobyte
+std::string formatBytes(const std::size_t bytes);
+
+// Current and peak bytes of the buffers charged to an owner: a layer, a model's scratch buffers or the whole process.
+// Charges also go to the parent account, so a model's account covers its layers and every account ends up in
+// MemoryAccount::process(). The counts are the buffers' exact byte sizes (LayerParams::byte_size, or the size given to
+// a MemoryCharge) and what the allocator reserved for them (Allocator::footprint), updated as buffers are allocated
+// and freed.
+//
+// Accounts must outlive the buffers charged to them. The counters are atomic, buffers can be allocated from any thread
+class MemoryAccount {
+   public:
+    MemoryAccount() : MemoryAccount(&process()) {}
+
+    MemoryAccount(const MemoryAccount&) = delete;
+    MemoryAccount& operator=(const MemoryAccount&) = delete;
+
+    void charge(const MemoryKind kind, const std::size_t bytes, const std::size_t reserved);
+    void release(const MemoryKind kind, const std::size_t bytes, const std::size_t reserved);
+
+    MemoryUsage current() const;
+    // Highest value each count reached (the kinds peak independently) and the highest total
+    MemoryUsage peak() const;
+    std::size_t peakTotal() const { return topTotal; }
+
+    // Peaks restart from the current values
+    void resetPeak();
+
+    // Move the account, with what is charged to it now, under another parent
+    void setParent(MemoryAccount* newParent);
+
+    // Root of every account, buffers without an owner are charged here directly
+    static MemoryAccount& process();
+
+   private:
+    explicit MemoryAccount(MemoryAccount* parent);
+
+    static void raise(std::atomic<std::size_t>& top, const std::size_t value);
+
+    MemoryAccount* parent;
+    std::atomic<std::size_t> now[MEMORY_KINDS], top[MEMORY_KINDS];
+    std::atomic<std::size_t> reservedNow, reservedTop, totalNow, topTotal;
+};
+
+// Charge for memory that is not a LayerData buffer (a kernel's std::vector window, a cache entry, a factorization's
+// spectrum) while the object lives. The bytes count as reserved too, they come straight from the heap
+class MemoryCharge {
+   public:
+    MemoryCharge() : account(nullptr), kind(MemoryKind::SCRATCH), bytes(0) {}
+    MemoryCharge(MemoryAccount& account, const MemoryKind kind, const std::size_t bytes);
+    ~MemoryCharge() { reset(); }
+
+    MemoryCharge(const MemoryCharge&) = delete;
+    MemoryCharge& operator=(const MemoryCharge&) = delete;
+    MemoryCharge(MemoryCharge&& other) noexcept;
+    MemoryCharge& operator=(MemoryCharge&& other) noexcept;
+
+    // Release the charge now
+    void reset();
+
+   private:
+    MemoryAccount* account;
+    MemoryKind kind;
+    std::size_t bytes;
+};
+
+}  // namespace ML
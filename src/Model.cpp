@@ -1,35 +1,295 @@
 #include "Model.h"
 
+#include <algorithm>
 #include <cassert>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef ZEDBOARD
+#include <chrono>
+
+#include "Hash.h"
+#include "ResultCache.h"
+#endif
 
 namespace ML {
 
 // Run inference on the entire model using the inData and outputting the outData
 // infType can be used to determine the inference function to call
+// Data stays in each layer's planned layout between layers and is only reordered where the layout changes
 const LayerData& Model::inference(const LayerData& inData, const Layer::InfType infType) const {
+    return *inference(inData, infType, ProceedFn());
+}
+
+const LayerData* Model::inference(const LayerData& inData, const Layer::InfType infType, const ProceedFn& proceed) const {
     assert(layers.size() > 0 && "There must be at least 1 layer to perform inference");
-    inferenceLayer(inData, 0, infType);
+    inStage.resize(layers.size());
+    outStage.resize(layers.size());
+
+#ifndef ZEDBOARD
+    std::uint64_t key = 0;
+    if (resultCache) {
+        if (!cachedOut) {
+            cachedOut.reset(new LayerData(layers.back()->getOutputParams()));
+            cachedOut->setAccount(scratch.get(), MemoryKind::SCRATCH);
+            cachedOut->allocData();
+        }
+        // The exit thresholds decide which output an input gets, so they are part of the key
+        std::uint64_t version = cacheVersion;
+        for (const ExitHead& exit : exits) version = hash64(&exit.threshold, sizeof(exit.threshold), version);
+        key = ResultCache::keyOf(inData, version);
+        if (resultCache->lookup(key, *cachedOut)) return cachedOut.get();
+    }
+#endif
+
+#ifndef ZEDBOARD
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+#endif
+
+    // Run up to each exit in turn, the segments between exits continue from the layer outputs
+    Layout layout = Layout::NHWC;
+    const LayerData* data = &inData;
+    std::size_t next = 0, taken = exits.size();
+    for (std::size_t e = 0; e < exits.size() && taken == exits.size(); e++) {
+        const ExitHead& exit = exits[e];
+        data = runRange(*data, layout, next, exit.after + 1, infType, inStage, proceed);
+        if (!data) return nullptr;
+        next = exit.after + 1;
+
+        const LayerData* headIn = layout == Layout::NHWC ? data : &reorderInto(exit.stage, *data, layout, Layout::NHWC);
+        const LayerData& probs = exit.head->inference(*headIn, infType);
+        const fp32* p = probs.ptr<fp32>();
+        fp32 top = p[0];
+        for (std::size_t i = 1; i < probs.getParams().flat_count(); i++) top = p[i] > top ? p[i] : top;
+        if (top >= exit.threshold) {
+            data = &probs;
+            layout = Layout::NHWC;
+            taken = e;
+        }
+    }
+    if (taken == exits.size()) {
+        if (next < layers.size()) data = runRange(*data, layout, next, layers.size(), infType, inStage, proceed);
+        if (!data) return nullptr;
+        if (layout != Layout::NHWC) data = &reorderInto(outStage.back(), *data, layout, Layout::NHWC);
+    }
+
+    double seconds = 0;
+#ifndef ZEDBOARD
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    if (resultCache) resultCache->insert(key, *data);
+#endif
+    countExit(taken, seconds);
+    return data;
+}
+
+Model::~Model() {
+#ifndef ZEDBOARD
+    // A moved from model has no accounts, the cache went with the move
+    if (resultCache && scratch) resultCache->getMemory().setParent(&MemoryAccount::process());
+#endif
+}
+
+void Model::setResultCache(ResultCache* cache, const std::uint64_t version) {
+#ifndef ZEDBOARD
+    if (resultCache && resultCache != cache) resultCache->getMemory().setParent(&MemoryAccount::process());
+    if (cache) cache->getMemory().setParent(scratch.get());
+#endif
+    resultCache = cache;
+    cacheVersion = version;
+}
+
+void Model::addExitHead(const std::size_t after, Model&& head, const fp32 threshold) {
+    if (after + 1 >= layers.size()) throw std::runtime_error("An exit head must follow a layer before the output layer");
+    if (head.getNumLayers() == 0) throw std::runtime_error("An exit head needs layers");
+    if (!head[0].getInputParams().isCompatible(layers[after]->getOutputParams())) {
+        throw std::runtime_error("The exit head input does not match the output of L" + std::to_string(after));
+    }
+    if (!head.getOutputLayer().getOutputParams().isCompatible(getOutputLayer().getOutputParams())) {
+        throw std::runtime_error("The exit head output does not match the model output");
+    }
+    for (const ExitHead& exit : exits) {
+        if (exit.after == after) throw std::runtime_error("L" + std::to_string(after) + " already has an exit head");
+    }
+
+    head.setLayerTimers(layerTimers);
+    std::unique_ptr<Model> owned(new Model(std::move(head)));
+    owned->memory->setParent(memory.get());
+    auto pos = std::find_if(exits.begin(), exits.end(), [&](const ExitHead& exit) { return exit.after > after; });
+    exits.insert(pos, ExitHead{after, threshold, std::move(owned), nullptr, 0, 0});
+}
+
+void Model::countExit(const std::size_t exit, const double seconds) const {
+    lastExit = exit;
+    if (exit == exits.size()) {
+        fullTaken++;
+        fullSeconds += seconds;
+    } else {
+        exits[exit].taken++;
+        exits[exit].seconds += seconds;
+    }
+}
+
+void Model::resetExitStats() {
+    for (ExitHead& exit : exits) {
+        exit.taken = 0;
+        exit.seconds = 0;
+    }
+    fullTaken = 0;
+    fullSeconds = 0;
+}
+
+std::string Model::exitReport() const {
+    std::size_t total = fullTaken;
+    for (const ExitHead& exit : exits) total += exit.taken;
 
-    for (std::size_t i = 1; i < layers.size(); i++) {
-        inferenceLayer(layers[i - 1]->getOutputData(), i, infType);
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+    for (std::size_t e = 0; e <= exits.size(); e++) {
+        bool full = e == exits.size();
+        std::size_t taken = full ? fullTaken : exits[e].taken;
+
+        if (full) {
+            oss << "full model: ";
+        } else {
+            oss << "exit after L" << exits[e].after << " (threshold " << std::setprecision(2) << exits[e].threshold << std::setprecision(1) << "): ";
+        }
+        oss << taken << " of " << total << " (" << (total ? 100.0 * taken / total : 0) << "%)";
+#ifndef ZEDBOARD
+        double mean = taken ? (full ? fullSeconds : exits[e].seconds) / taken : 0;
+        double fullMean = fullTaken ? fullSeconds / fullTaken : 0;
+        if (taken) oss << ", mean " << std::setprecision(3) << 1e3 * mean << "ms" << std::setprecision(1);
+        if (!full && taken && fullTaken) oss << ", saves " << std::setprecision(3) << 1e3 * (fullMean - mean) << "ms" << std::setprecision(1);
+#endif
+        oss << "\n";
     }
+    return oss.str();
+}
 
-    return layers.back()->getOutputData();
+void Model::setWeightAllocator(Allocator& alloc) {
+    for (std::unique_ptr<Layer>& layer : layers) layer->setWeightAllocator(alloc);
+    for (ExitHead& exit : exits) exit.head->setWeightAllocator(alloc);
+}
+
+std::string Model::memoryReport() const {
+    std::ostringstream oss;
+    auto row = [&oss](const std::string& name, const MemoryUsage& now, const std::size_t peak) {
+        oss << std::left << std::setw(14) << name << std::right;
+        for (std::size_t k = 0; k < MEMORY_KINDS; k++) oss << std::setw(13) << (now.bytes[k] ? formatBytes(now.bytes[k]) : "-");
+        oss << std::setw(13) << formatBytes(now.total()) << std::setw(13) << formatBytes(peak) << std::setw(13) << formatBytes(now.reserved) << "\n";
+    };
+
+    oss << std::left << std::setw(14) << "" << std::right;
+    for (std::size_t k = 0; k < MEMORY_KINDS; k++) oss << std::setw(13) << memoryKindName((MemoryKind)k);
+    oss << std::setw(13) << "total" << std::setw(13) << "peak" << std::setw(13) << "reserved" << "\n";
+
+    for (std::size_t i = 0; i < layers.size(); i++) {
+        const MemoryAccount& account = layers[i]->getMemory();
+        row("L" + std::to_string(i), account.current(), account.peakTotal());
+    }
+    row("model buffers", scratch->current(), scratch->peakTotal());
+#ifndef ZEDBOARD
+    if (resultCache) row("  result cache", resultCache->getMemory().current(), resultCache->getMemory().peakTotal());
+#endif
+    for (const ExitHead& exit : exits) row("exit after L" + std::to_string(exit.after), exit.head->memoryUsage(), exit.head->getMemory().peakTotal());
+
+    row("model total", memory->current(), memory->peakTotal());
+    row("process", MemoryAccount::process().current(), MemoryAccount::process().peakTotal());
+    return oss.str();
+}
+
+const LayerData& Model::inferenceRange(const LayerData& inData, Layout& layout, const std::size_t first, const std::size_t last,
+                                       const Layer::InfType infType, std::vector<std::unique_ptr<LayerData>>& stage) const {
+    return *runRange(inData, layout, first, last, infType, stage, ProceedFn());
+}
+
+const LayerData* Model::runRange(const LayerData& inData, Layout& layout, const std::size_t first, const std::size_t last, const Layer::InfType infType,
+                                 std::vector<std::unique_ptr<LayerData>>& stage, const ProceedFn& proceed) const {
+    assert(first < last && last <= layers.size() && "Invalid layer range");
+    if (stage.size() < last) stage.resize(last);
+
+    const LayerData* data = &inData;
+    for (std::size_t i = first; i < last; i++) {
+        if (proceed && !proceed(i)) return nullptr;
+        Layout next = layers[i]->layoutFor(infType);
+        if (next != layout) data = &reorderInto(stage[i], *data, layout, next);
+
+        computeLayer(i, *data, infType);
+        data = &layers[i]->getOutputData();
+        layout = next;
+    }
+    return data;
+}
+
+std::vector<const LayerData*> Model::inferenceBatch(const std::vector<const LayerData*>& images, const Layer::InfType infType) const {
+    assert(layers.size() > 0 && "There must be at least 1 layer to perform inference");
+    const std::size_t batch = images.size();
+    if (batchOut.size() < batch) {
+        batchOut.resize(batch);
+        batchStage.resize(batch);
+    }
+
+    std::vector<const LayerData*> data(images);
+    std::vector<Layout> layouts(batch, Layout::NHWC);
+    for (std::size_t i = 0; i < layers.size(); i++) {
+        Layer& layer = *layers[i];
+        for (std::size_t b = 0; b < batch; b++) {
+            batchOut[b].resize(layers.size() + 1);
+            std::unique_ptr<LayerData>& out = batchOut[b][i];
+            if (!out) {
+                out.reset(new LayerData(layer.getOutputParams()));
+                out->setAccount(scratch.get(), MemoryKind::SCRATCH);
+                if (!layer.isView()) out->allocData();
+            }
+
+            // The layer computes (or, for a view, aliases) straight into the image's own buffer
+            std::swap(*out, layer.getOutputData());
+            try {
+                inferenceRange(*data[b], layouts[b], i, i + 1, infType, batchStage[b]);
+            } catch (...) {
+                std::swap(*out, layer.getOutputData());
+                throw;
+            }
+            std::swap(*out, layer.getOutputData());
+            data[b] = out.get();
+        }
+    }
+
+    for (std::size_t b = 0; b < batch; b++) {
+        if (layouts[b] != Layout::NHWC) data[b] = &reorderInto(batchOut[b].back(), *data[b], layouts[b], Layout::NHWC);
+    }
+    return data;
 }
 
 // Run inference on a single layer of the model using the inData and outputting the outData
 // infType can be used to determine the inference function to call
+// inData and the result are NHWC, a layer planned for another layout gets reordered data
 const LayerData& Model::inferenceLayer(const LayerData& inData, const int layerNum, const Layer::InfType infType) const {
+    inStage.resize(layers.size());
+    outStage.resize(layers.size());
+
+    Layout layout = layers[layerNum]->layoutFor(infType);
+    if (layout == Layout::NHWC) {
+        computeLayer(layerNum, inData, infType);
+        return layers[layerNum]->getOutputData();
+    }
+
+    computeLayer(layerNum, reorderInto(inStage[layerNum], inData, Layout::NHWC, layout), infType);
+    return reorderInto(outStage[layerNum], layers[layerNum]->getOutputData(), layout, Layout::NHWC);
+}
+
+void Model::computeLayer(const std::size_t layerNum, const LayerData& inData, const Layer::InfType infType) const {
     Layer& layer = *layers[layerNum];
 
     assert(layer.getInputParams().isCompatible(inData.getParams()) && "Input data is not compatible with layer");
-    assert(layer.isOutputBufferAlloced() && "Output buffer must be allocated prior to inference");
+    // View layers bind their output to the input buffer when computed instead of owning one
+    assert((layer.isView() || layer.isOutputBufferAlloced()) && "Output buffer must be allocated prior to inference");
 
     char timer_name_char[64];
-    sprintf(timer_name_char, "L%d", layerNum);
+    sprintf(timer_name_char, "L%d", (int)layerNum);
     std::string timer_name = std::string(timer_name_char);
     Timer elapsedTimer(std::move(timer_name));
-    elapsedTimer.start();
+    if (layerTimers) elapsedTimer.start();
 
     switch (infType) {
     case Layer::InfType::NAIVE:
@@ -48,9 +308,50 @@ const LayerData& Model::inferenceLayer(const LayerData& inData, const int layerN
         assert(false && "Inference Type not implemented");
     }
 
-    elapsedTimer.stop();
+    if (layerTimers) elapsedTimer.stop();
+}
+
+const LayerData& Model::reorderInto(std::unique_ptr<LayerData>& stage, const LayerData& data, const Layout from, const Layout to) const {
+    const dimVec& dims = data.getParams().dims;
+    if (dims.size() != 3) throw std::runtime_error("Only [height][width][channels] data can change layout");
 
-    return layer.getOutputData();
+    if (!stage || stage->getParams().dims != dims) {
+        stage.reset(new LayerData({sizeof(fp32), dims}));
+        stage->setAccount(scratch.get(), MemoryKind::SCRATCH);
+        stage->allocData();
+    }
+    reorder(data.ptr<fp32>(), from, stage->ptr<fp32>(), to, dims[ParamIndex::HEIGHT], dims[ParamIndex::WIDTH], dims[ParamIndex::CHANNELS], *scratch);
+    return *stage;
+}
+
+void Model::planLayouts(const Layer::InfType infType) {
+    Layout prev = Layout::NHWC;
+    for (std::unique_ptr<Layer>& layer : layers) {
+        std::vector<Layout> options = layer->supportedLayouts(infType);
+        bool keep = layer->isLayoutTransparent() && std::find(options.begin(), options.end(), prev) != options.end();
+        Layout pick = keep ? prev : options.front();
+
+        layer->setLayout(pick);
+        prev = pick;
+    }
+}
+
+void Model::resetLayouts() {
+    for (std::unique_ptr<Layer>& layer : layers) layer->setLayout(Layout::NHWC);
+}
+
+std::string Model::layoutPlanString(const Layer::InfType infType) const {
+    std::ostringstream oss;
+    Layout prev = Layout::NHWC;
+    oss << layoutName(prev);
+    for (std::size_t i = 0; i < layers.size(); i++) {
+        Layout layout = layers[i]->layoutFor(infType);
+        if (layout != prev) oss << " > " << layoutName(layout);
+        oss << " L" << i;
+        prev = layout;
+    }
+    if (prev != Layout::NHWC) oss << " > " << layoutName(Layout::NHWC);
+    return oss.str();
 }
 
 }  // namespace ML
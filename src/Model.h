@@ -1,4 +1,7 @@
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
 #include <vector>
 #include <memory>
 
@@ -10,17 +13,112 @@
 #include "layers/Flatten.h"
 
 namespace ML {
+class ResultCache;
+
+// Layers compute into their own output buffers, so a model runs one inference at a time. Objects that drive a model
+// (Pipeline, ParallelInference, DeltaInference, AsyncInference, BatchServer) take it allocated, must not outlive it,
+// and no other inference may run on it while they use it; their headers only add what they need beyond that
 class Model {
    public:
     // Constructors
-    inline Model() : layers() {}  //, checkFinal(true), checkEachLayer(false) {}
+    inline Model() : memory(new MemoryAccount()), scratch(new MemoryAccount()), layers() {  //, checkFinal(true), checkEachLayer(false) {}
+        scratch->setParent(memory.get());
+    }
+    Model(Model&&) = default;
+    ~Model();
 
     // Functions
     const LayerData& inference(const LayerData& inData, const Layer::InfType infType = Layer::InfType::NAIVE) const;
+
+    // Asked before each layer of the model (not of its exit heads) with the layer's index, false stops the inference
+    using ProceedFn = std::function<bool(std::size_t layer)>;
+
+    // inference() that stops as soon as `proceed` says so and returns nullptr. A stopped inference is neither cached nor
+    // counted in the exit statistics (AsyncInference drops cancelled requests this way)
+    const LayerData* inference(const LayerData& inData, const Layer::InfType infType, const ProceedFn& proceed) const;
     const LayerData& inferenceLayer(const LayerData& inData, const int layerNum, const Layer::InfType infType = Layer::InfType::NAIVE) const;
 
+    // Run layers [first, last) on inData, which is in `layout`. On return `layout` is the layout of the result.
+    // Reordered inputs go to the caller's `stage` buffers (indexed by layer), so threads running disjoint layer
+    // ranges (Pipeline) do not share any buffer
+    const LayerData& inferenceRange(const LayerData& inData, Layout& layout, const std::size_t first, const std::size_t last,
+                                    const Layer::InfType infType, std::vector<std::unique_ptr<LayerData>>& stage) const;
+
+    // Run a batch of images layer by layer: each layer computes every image before the next layer starts, so its
+    // weights stay in cache for the whole batch. Returns one NHWC output per image, valid until the next batch
+    std::vector<const LayerData*> inferenceBatch(const std::vector<const LayerData*>& images, const Layer::InfType infType = Layer::InfType::NAIVE) const;
+
+    // Serve inference() from a cache of final outputs keyed by the input bytes and the exit thresholds (ResultCache,
+    // not on the zedboard), nullptr turns it off. `version` identifies the weights (modelVersion in ModelLoader.h). A
+    // hit copies the cached output into a model owned buffer without running any layer. The cache must outlive its use
+    // by the model, its entries are charged to this model's scratch account while attached (to the last model
+    // attached, when shared)
+    void setResultCache(ResultCache* cache, const std::uint64_t version);
+    ResultCache* getResultCache() const { return resultCache; }
+    std::uint64_t getCacheVersion() const { return cacheVersion; }
+
+    // --- Early exits ---
+    // Attach a classifier head (a small model, e.g. flatten, dense, softmax) to the output of layer `after`. When
+    // inference() reaches that layer it runs the head, and returns the head's output without computing the remaining
+    // layers if its top-1 probability is at least `threshold`. The head takes NHWC input and must produce an output of
+    // the model's output shape. Heads are allocated and freed with the model's layers and only affect inference()
+    void addExitHead(const std::size_t after, Model&& head, const fp32 threshold);
+    std::size_t getNumExitHeads() const { return exits.size(); }
+    void setExitThreshold(const std::size_t exit, const fp32 threshold) { exits.at(exit).threshold = threshold; }
+
+    // Exit taken by the last computed inference(): the index of a head, or getNumExitHeads() for the full model.
+    // Result cache hits compute nothing and are not counted
+    std::size_t getLastExit() const { return lastExit; }
+
+    // Share of the inferences that took each exit and their mean latency, with the time saved against the mean of
+    // the full model (not on the zedboard, which only counts)
+    std::string exitReport() const;
+    void resetExitStats();
+
+    // Log the time of every layer computed (on by default)
+    void setLayerTimers(const bool enabled) {
+        layerTimers = enabled;
+        for (ExitHead& exit : exits) exit.head->setLayerTimers(enabled);
+    }
+    bool hasLayerTimers() const { return layerTimers; }
+
+    // Memory backing of every layer's weights and biases, exit heads included (Layer::setWeightAllocator). Set it before
+    // allocLayers, the allocator must outlive the buffers
+    void setWeightAllocator(Allocator& alloc);
+
+    // --- Memory ---
+    // Bytes held for the model: the layers' weights, biases, outputs and prepacked copies, their per-call temporaries
+    // (region windows, low-rank projections, factorization workspace), the exit heads, and as MemoryKind::SCRATCH the
+    // model's own staging, reorder and batch buffers, the attached result cache and the buffers of the objects serving
+    // the model (Pipeline, DeltaInference, AsyncInference, BatchServer). Outputs handed to a caller belong to the caller
+    // and count in the process account. The counts are the exact buffer sizes, updated on every allocation and free,
+    // with the peak since construction (or resetPeak); the reserved bytes add allocator padding and, for the result
+    // cache, an estimate of its bookkeeping
+    MemoryUsage memoryUsage() const { return memory->current(); }
+    MemoryAccount& getMemory() const { return *memory; }
+
+    // Account of the model's scratch buffers, for objects that hold buffers on the model's behalf
+    MemoryAccount& getScratchMemory() const { return *scratch; }
+
+    // Current bytes of every layer by kind with its peak, then the model's own buffers (the result cache's share on its
+    // own line), the exit heads, the model total and the whole process
+    std::string memoryReport() const;
+
+    // --- Activation layouts ---
+    // Pick the layout every layer computes in for an inference type: each layer takes its fastest supported layout,
+    // layout transparent layers (pooling) keep their producer's layout, and data is only reordered between two
+    // layers whose layouts differ. The model input and output stay NHWC. Layers must be allocated first
+    void planLayouts(const Layer::InfType infType);
+
+    // Back to NHWC everywhere
+    void resetLayouts();
+
+    // Layouts of the layers for an inference type, with the reorders, e.g. "L0 NHWC > NCHW16c L1 L2 > NHWC L3"
+    std::string layoutPlanString(const Layer::InfType infType) const;
+
     // Internal memory management
     // Allocate the internal output buffers for each layer in the model
+    // View layers (Layer::isView) get no buffer, their output aliases the previous layer's output
     inline void allocLayers();
 
     // Free all layers
@@ -30,7 +128,10 @@ class Model {
     inline const std::size_t getNumLayers() const { return layers.size(); }
 
     // Add a layer to the model
-    template<typename T, typename... Args> void addLayer(Args&&... args) { layers.emplace_back(new T(std::forward<Args>(args)...)); }
+    template<typename T, typename... Args> void addLayer(Args&&... args) {
+        layers.emplace_back(new T(std::forward<Args>(args)...));
+        layers.back()->getMemory().setParent(memory.get());
+    }
 
     // Insert a layer into the model
     // void insertLayer(Layer* l, std::size_t idx) { layers.insert(layers.begin() + idx, l); }
@@ -59,7 +160,54 @@ class Model {
     }
 
    private:
+    // inferenceRange asking `proceed` (if set) before each layer, nullptr when it stopped
+    const LayerData* runRange(const LayerData& inData, Layout& layout, const std::size_t first, const std::size_t last, const Layer::InfType infType,
+                              std::vector<std::unique_ptr<LayerData>>& stage, const ProceedFn& proceed) const;
+
+    // Compute one layer on data already in the layer's layout
+    void computeLayer(const std::size_t layerNum, const LayerData& inData, const Layer::InfType infType) const;
+
+    // Reorder a [height][width][channels] tensor into a staging buffer owned by the model
+    const LayerData& reorderInto(std::unique_ptr<LayerData>& stage, const LayerData& data, const Layout from, const Layout to) const;
+
+    // Parent of the layer, exit head and scratch accounts, scratch is charged with the model's own buffers. Heap
+    // allocated so the children keep their parent when the model is moved, and declared first so they are destroyed last
+    std::unique_ptr<MemoryAccount> memory;
+    std::unique_ptr<MemoryAccount> scratch;
+
     std::vector<std::unique_ptr<Layer>> layers;
+    bool layerTimers = true;
+
+    struct ExitHead {
+        std::size_t after;
+        fp32 threshold;
+        std::unique_ptr<Model> head;
+        // NHWC copy of a blocked activation for the head
+        mutable std::unique_ptr<LayerData> stage;
+        mutable std::size_t taken;
+        mutable double seconds;
+    };
+    // Sorted by the layer they follow
+    std::vector<ExitHead> exits;
+    // Inferences that ran every layer and their total time
+    mutable std::size_t fullTaken = 0;
+    mutable double fullSeconds = 0;
+    mutable std::size_t lastExit = 0;
+    // Inference time of an exit (or of the full model) and its counters
+    void countExit(const std::size_t exit, const double seconds) const;
+
+    ResultCache* resultCache = nullptr;
+    std::uint64_t cacheVersion = 0;
+    // Output of a cache hit
+    mutable std::unique_ptr<LayerData> cachedOut;
+
+    // Staging buffers for reordered layer inputs and (single layer inference) outputs, allocated on first use
+    mutable std::vector<std::unique_ptr<LayerData>> inStage;
+    mutable std::vector<std::unique_ptr<LayerData>> outStage;
+
+    // Per image layer outputs (plus a final NHWC reorder buffer) and reorder buffers of inferenceBatch
+    mutable std::vector<std::vector<std::unique_ptr<LayerData>>> batchOut;
+    mutable std::vector<std::vector<std::unique_ptr<LayerData>>> batchStage;
 };
 
 // Allocate the internal output buffers for each layer in the model
@@ -67,11 +215,18 @@ void Model::allocLayers() {
     for (std::size_t i = 0; i < layers.size(); i++) {
         layers[i]->allocLayer();
     }
+    for (ExitHead& exit : exits) exit.head->allocLayers();
 }
 
 // Free all layers in the model
 void Model::freeLayers() {
     // All classes use RAII, so just wipe out the vector of layers.
     layers.clear();
+    exits.clear();
+    inStage.clear();
+    outStage.clear();
+    batchOut.clear();
+    batchStage.clear();
+    cachedOut.reset();
 }
 }  // namespace ML
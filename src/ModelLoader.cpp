@@ -0,0 +1,427 @@
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+#include "Hash.h"
+
+namespace ML {
+
+namespace {
+
+// The description and weight files are on the SD card on the zedboard (FatFS, mounted by main)
+#ifdef ZEDBOARD
+bool fileSize(const std::string& path, std::size_t& size) {
+    FIL file;
+    if (f_open(&file, path.c_str(), FA_OPEN_EXISTING | FA_READ) != FR_OK) return false;
+    size = f_size(&file);
+    f_close(&file);
+    return true;
+}
+
+bool readFile(const std::string& path, std::string& bytes) {
+    FIL file;
+    if (f_open(&file, path.c_str(), FA_OPEN_EXISTING | FA_READ) != FR_OK) return false;
+    bytes.resize(f_size(&file));
+    UINT bytes_read = 0;
+    bool ok = bytes.empty() || (f_read(&file, &bytes[0], bytes.size(), &bytes_read) == FR_OK && bytes_read == bytes.size());
+    f_close(&file);
+    return ok;
+}
+#else
+bool fileSize(const std::string& path, std::size_t& size) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) return false;
+    size = (std::size_t)file.tellg();
+    return true;
+}
+
+bool readFile(const std::string& path, std::string& bytes) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) return false;
+    std::ostringstream oss;
+    oss << file.rdbuf();
+    bytes = oss.str();
+    return true;
+}
+#endif
+
+std::string dimsString(const dimVec& dims) {
+    std::ostringstream oss;
+    for (std::size_t i = 0; i < dims.size(); i++) oss << (i ? "x" : "") << dims[i];
+    return oss.str();
+}
+
+// Errors point at the offending line of the description
+class DescError {
+   public:
+    DescError(const std::string& path, const std::size_t line) : path(path), line(line) {}
+
+    [[noreturn]] void fail(const std::string& msg) const {
+        std::ostringstream oss;
+        oss << path << ":" << line << ": " << msg;
+        throw std::runtime_error(oss.str());
+    }
+
+   private:
+    const std::string& path;
+    std::size_t line;
+};
+
+std::size_t parseSize(const std::string& value, const DescError& err, const std::string& key) {
+    std::size_t pos = 0;
+    unsigned long v = 0;
+    try {
+        v = std::stoul(value, &pos);
+    } catch (const std::exception&) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != value.size() || value[0] == '-') err.fail(key + " must be a non-negative integer, got '" + value + "'");
+    return v;
+}
+
+// "5" or "5x3" style shapes
+dimVec parseDims(const std::string& value, const DescError& err, const std::string& key) {
+    dimVec dims;
+    std::size_t start = 0;
+    while (true) {
+        std::size_t end = value.find('x', start);
+        dims.push_back(parseSize(value.substr(start, end - start), err, key));
+        if (end == std::string::npos) break;
+        start = end + 1;
+    }
+    for (std::size_t d : dims) {
+        if (d == 0) err.fail(key + " dimensions must be non-zero, got '" + value + "'");
+    }
+    return dims;
+}
+
+// A probability in [0, 1]
+fp32 parseProbability(const std::string& value, const DescError& err, const std::string& key) {
+    std::size_t pos = 0;
+    float v = -1;
+    try {
+        v = std::stof(value, &pos);
+    } catch (const std::exception&) {
+        pos = 0;
+    }
+    if (pos == 0 || pos != value.size() || !(v >= 0 && v <= 1)) err.fail(key + " must be a number between 0 and 1, got '" + value + "'");
+    return v;
+}
+
+bool parseBool(const std::string& value, const DescError& err, const std::string& key) {
+    if (value == "true") return true;
+    if (value == "false") return false;
+    err.fail(key + " must be true or false, got '" + value + "'");
+}
+
+// Attribute lookups with the layer's error context
+class Attrs {
+   public:
+    Attrs(const LayerDesc& layer, const DescError& err) : layer(layer), err(err) {}
+
+    bool has(const std::string& key) const { return layer.attrs.count(key) != 0; }
+
+    const std::string& str(const std::string& key) const {
+        auto it = layer.attrs.find(key);
+        if (it == layer.attrs.end()) err.fail(layer.type + " needs " + key + "=");
+        return it->second;
+    }
+
+    std::size_t size(const std::string& key) const { return parseSize(str(key), err, key); }
+    std::size_t size(const std::string& key, const std::size_t def) const { return has(key) ? size(key) : def; }
+    bool flag(const std::string& key, const bool def) const { return has(key) ? parseBool(str(key), err, key) : def; }
+
+    // A square window (N) or HxW
+    void window(const std::string& key, std::size_t& h, std::size_t& w) const {
+        dimVec dims = parseDims(str(key), err, key);
+        if (dims.size() > 2) err.fail(key + " must be N or HxW");
+        h = dims[0];
+        w = dims.back();
+    }
+
+   private:
+    const LayerDesc& layer;
+    const DescError& err;
+};
+
+const std::map<std::string, std::set<std::string>>& layerKeys() {
+    static const std::map<std::string, std::set<std::string>> keys = {
+        {"input", {"shape"}},
+        {"conv", {"filters", "kernel", "stride", "pad", "dilation", "groups", "weights", "bias", "out"}},
+        {"maxpool", {"size", "stride", "pad", "out"}},
+        {"flatten", {"out"}},
+        {"dense", {"units", "relu", "weights", "bias", "rank", "energy", "out"}},
+        {"softmax", {"log", "out"}},
+        {"exit", {"threshold", "weights", "bias"}},
+    };
+    return keys;
+}
+
+// Weight files must hold exactly the tensor the layer expects
+void checkWeightFile(const std::string& path, const dimVec& dims, const DescError& err) {
+    std::size_t actual = 0;
+    if (!fileSize(path, actual)) err.fail("cannot open " + path);
+
+    std::size_t expected = LayerParams(sizeof(fp32), dims).byte_size();
+    if (actual != expected) {
+        err.fail(path + " holds " + std::to_string(actual) + " bytes, a " + dimsString(dims) + " fp32 tensor needs " + std::to_string(expected));
+    }
+}
+
+// Shape inference for one layer, fills in the layer's output, weight and bias shapes
+void inferLayer(LayerDesc& layer, const std::string& weightDir, const DescError& err) {
+    Attrs a(layer, err);
+    const dimVec& in = layer.inDims;
+
+    if (layer.type == "conv" || layer.type == "maxpool") {
+        if (in.size() != 3) err.fail(layer.type + " needs a [height][width][channels] input, got " + dimsString(in));
+    } else if (layer.type == "dense" || layer.type == "softmax") {
+        if (in.size() != 1) err.fail(layer.type + " needs a flat input, got " + dimsString(in) + " (add a flatten layer)");
+    }
+
+    if (layer.type == "conv") {
+        std::size_t kh, kw;
+        a.window("kernel", kh, kw);
+        std::size_t filters = a.size("filters"), stride = a.size("stride", 1), dil = a.size("dilation", 1), groups = a.size("groups", 1);
+        if (filters == 0 || stride == 0 || dil == 0 || groups == 0) err.fail("conv filters, stride, dilation and groups must be non-zero");
+
+        std::size_t in_c = in[ParamIndex::CHANNELS];
+        if (in_c % groups != 0 || filters % groups != 0) {
+            err.fail("conv channels (" + std::to_string(in_c) + " in, " + std::to_string(filters) + " out) are not divisible by " + std::to_string(groups) + " groups");
+        }
+
+        std::size_t out_h, out_w;
+        std::size_t span_h = (kh - 1) * dil + 1, span_w = (kw - 1) * dil + 1;
+        if (a.has("pad") && a.str("pad") == "same") {
+            out_h = (in[ParamIndex::HEIGHT] + stride - 1) / stride;
+            out_w = (in[ParamIndex::WIDTH] + stride - 1) / stride;
+        } else {
+            std::size_t pad = a.size("pad", 0);
+            out_h = windowOutputSize(in[ParamIndex::HEIGHT], 2 * pad, span_h, stride);
+            out_w = windowOutputSize(in[ParamIndex::WIDTH], 2 * pad, span_w, stride);
+        }
+        if (out_h == 0 || out_w == 0) err.fail("conv kernel " + a.str("kernel") + " does not fit the " + dimsString(in) + " input");
+
+        layer.outDims = {out_h, out_w, filters};
+        layer.weightDims = {kh, kw, in_c / groups, filters};
+        layer.biasDims = {filters};
+    } else if (layer.type == "maxpool") {
+        std::size_t kh, kw;
+        a.window("size", kh, kw);
+        std::size_t stride = a.size("stride", kh), pad = a.size("pad", 0);
+        if (stride == 0) err.fail("maxpool stride must be non-zero");
+        if (pad >= kh || pad >= kw) err.fail("maxpool padding must be smaller than the window");
+
+        std::size_t out_h = windowOutputSize(in[ParamIndex::HEIGHT], 2 * pad, kh, stride);
+        std::size_t out_w = windowOutputSize(in[ParamIndex::WIDTH], 2 * pad, kw, stride);
+        if (out_h == 0 || out_w == 0) err.fail("maxpool window " + a.str("size") + " does not fit the " + dimsString(in) + " input");
+        layer.outDims = {out_h, out_w, in[ParamIndex::CHANNELS]};
+    } else if (layer.type == "flatten") {
+        layer.outDims = {LayerParams(sizeof(fp32), in).flat_count()};
+    } else if (layer.type == "dense") {
+        std::size_t units = a.size("units");
+        if (units == 0) err.fail("dense units must be non-zero");
+        a.flag("relu", true);
+        if (a.has("rank") && a.has("energy")) err.fail("dense takes rank= or energy=, not both");
+        std::size_t maxRank = std::min(in[0], units);
+        if (a.has("rank") && (a.size("rank") == 0 || a.size("rank") > maxRank)) {
+            err.fail("dense rank must be between 1 and " + std::to_string(maxRank) + ", got '" + a.str("rank") + "'");
+        }
+        if (a.has("energy") && parseProbability(a.str("energy"), err, "energy") == 0) err.fail("dense energy must be above 0");
+
+        layer.outDims = {units};
+        layer.weightDims = {in[0], units};
+        layer.biasDims = {units};
+    } else if (layer.type == "softmax") {
+        a.flag("log", false);
+        layer.outDims = in;
+    }
+
+    if (a.has("out")) {
+        dimVec declared = parseDims(a.str("out"), err, "out");
+        if (declared != layer.outDims) err.fail("declared output " + dimsString(declared) + " but the layer produces " + dimsString(layer.outDims));
+    }
+
+    if (!layer.weightDims.empty()) {
+        checkWeightFile(weightDir + "/" + a.str("weights"), layer.weightDims, err);
+        checkWeightFile(weightDir + "/" + a.str("bias"), layer.biasDims, err);
+    }
+}
+
+}  // namespace
+
+ModelDesc loadModelDesc(const Path& path) {
+    std::string contents;
+    if (!readFile(path, contents)) throw std::runtime_error("Cannot read model description " + path);
+    std::istringstream file(contents);
+
+    ModelDesc desc;
+    desc.path = path;
+    std::size_t slash = desc.path.find_last_of('/');
+    desc.weightDir = slash == std::string::npos ? "." : desc.path.substr(0, slash);
+
+    bool haveInput = false;
+    std::string text;
+    for (std::size_t lineNum = 1; std::getline(file, text); lineNum++) {
+        DescError err(desc.path, lineNum);
+        std::istringstream line(text.substr(0, text.find('#')));
+
+        LayerDesc layer;
+        layer.line = lineNum;
+        if (!(line >> layer.type)) continue;
+
+        auto keys = layerKeys().find(layer.type);
+        if (keys == layerKeys().end()) err.fail("unknown layer type '" + layer.type + "'");
+
+        std::string token;
+        while (line >> token) {
+            std::size_t eq = token.find('=');
+            if (eq == std::string::npos || eq == 0 || eq + 1 == token.size()) err.fail("expected key=value, got '" + token + "'");
+
+            std::string key = token.substr(0, eq);
+            if (!keys->second.count(key)) err.fail(layer.type + " has no attribute '" + key + "'");
+            if (!layer.attrs.insert({key, token.substr(eq + 1)}).second) err.fail("duplicate attribute '" + key + "'");
+        }
+
+        if (layer.type == "input") {
+            if (haveInput) err.fail("only one input line is allowed");
+            if (!desc.layers.empty()) err.fail("input must come before the layers");
+            desc.inputDims = parseDims(Attrs(layer, err).str("shape"), err, "shape");
+            haveInput = true;
+            continue;
+        }
+        if (!haveInput) err.fail("the first line must be the input shape (input shape=HxWxC)");
+
+        if (layer.type == "exit") {
+            if (desc.layers.empty()) err.fail("an exit must follow a layer");
+            if (!desc.exits.empty() && desc.exits.back().after + 1 == desc.layers.size()) err.fail("only one exit per layer");
+            layer.inDims = desc.layers.back().outDims;
+            desc.exits.push_back(ExitDesc{desc.layers.size() - 1, parseProbability(Attrs(layer, err).str("threshold"), err, "threshold"), layer});
+            continue;
+        }
+
+        layer.inDims = desc.layers.empty() ? desc.inputDims : desc.layers.back().outDims;
+        inferLayer(layer, desc.weightDir, err);
+        desc.layers.push_back(layer);
+    }
+
+    if (desc.layers.empty()) throw std::runtime_error(desc.path + ": the model has no layers");
+
+    // Heads classify into the model's outputs, whose size is only known now
+    for (ExitDesc& exit : desc.exits) {
+        DescError err(desc.path, exit.head.line);
+        const dimVec& out = desc.layers.back().outDims;
+        if (exit.after + 1 == desc.layers.size()) err.fail("an exit cannot follow the output layer");
+        if (out.size() != 1) err.fail("exits need a flat model output, got " + dimsString(out));
+
+        LayerDesc& head = exit.head;
+        head.outDims = out;
+        head.weightDims = {LayerParams(sizeof(fp32), head.inDims).flat_count(), out[0]};
+        head.biasDims = out;
+        checkWeightFile(desc.weightDir + "/" + Attrs(head, err).str("weights"), head.weightDims, err);
+        checkWeightFile(desc.weightDir + "/" + Attrs(head, err).str("bias"), head.biasDims, err);
+    }
+    return desc;
+}
+
+Model buildModel(const ModelDesc& desc) {
+    Model model;
+    Path dir(std::string(desc.weightDir));
+
+    for (const LayerDesc& layer : desc.layers) {
+        DescError err(desc.path, layer.line);
+        Attrs a(layer, err);
+        LayerParams in(sizeof(fp32), layer.inDims), out(sizeof(fp32), layer.outDims);
+
+        if (layer.type == "conv") {
+            LayerParams weights(sizeof(fp32), layer.weightDims, dir / std::string(a.str("weights")));
+            LayerParams bias(sizeof(fp32), layer.biasDims, dir / std::string(a.str("bias")));
+            std::size_t stride = a.size("stride", 1), dil = a.size("dilation", 1), groups = a.size("groups", 1);
+            bool same = a.has("pad") && a.str("pad") == "same";
+            ConvParams conv = same ? ConvParams::same(stride, dil, groups) : ConvParams(stride, a.size("pad", 0), dil, groups);
+            model.addLayer<ConvolutionalLayer>(in, out, weights, bias, conv);
+        } else if (layer.type == "maxpool") {
+            std::size_t kh, kw;
+            a.window("size", kh, kw);
+            std::size_t stride = a.size("stride", kh), pad = a.size("pad", 0);
+            model.addLayer<MaxPoolingLayer>(in, out, PoolParams(kh, kw, stride, stride, pad, pad));
+        } else if (layer.type == "flatten") {
+            model.addLayer<Flatten>(in, out);
+        } else if (layer.type == "dense") {
+            LayerParams weights(sizeof(fp32), layer.weightDims, dir / std::string(a.str("weights")));
+            LayerParams bias(sizeof(fp32), layer.biasDims, dir / std::string(a.str("bias")));
+            model.addLayer<DenseLayer>(in, out, weights, bias, a.flag("relu", true));
+            if (a.has("rank") || a.has("energy")) {
+                fp32 energy = a.has("energy") ? parseProbability(a.str("energy"), err, "energy") : 1.0f;
+                static_cast<DenseLayer&>(model.getOutputLayer()).setLowRank(energy, a.size("rank", 0));
+            }
+        } else if (layer.type == "softmax") {
+            model.addLayer<SoftMaxLayer>(in, out, a.flag("log", false));
+        }
+    }
+
+    for (const ExitDesc& exit : desc.exits) {
+        const LayerDesc& layer = exit.head;
+        DescError err(desc.path, layer.line);
+        Attrs a(layer, err);
+        LayerParams in(sizeof(fp32), layer.inDims), flat(sizeof(fp32), {layer.weightDims[0]}), out(sizeof(fp32), layer.outDims);
+        LayerParams weights(sizeof(fp32), layer.weightDims, dir / std::string(a.str("weights")));
+        LayerParams bias(sizeof(fp32), layer.biasDims, dir / std::string(a.str("bias")));
+
+        Model head;
+        if (layer.inDims.size() != 1) head.addLayer<Flatten>(in, flat);
+        head.addLayer<DenseLayer>(flat, out, weights, bias, false);
+        head.addLayer<SoftMaxLayer>(out, out, false);
+        model.addExitHead(exit.after, std::move(head), exit.threshold);
+    }
+
+    return model;
+}
+
+Model loadModel(const Path& path) {
+    logInfo("--- Loading Model " + path + " ---");
+    return buildModel(loadModelDesc(path));
+}
+
+std::uint64_t modelVersion(const ModelDesc& desc) {
+    std::vector<std::string> files = {desc.path};
+    std::vector<const LayerDesc*> weighted;
+    for (const LayerDesc& layer : desc.layers) weighted.push_back(&layer);
+    for (const ExitDesc& exit : desc.exits) weighted.push_back(&exit.head);
+    for (const LayerDesc* layer : weighted) {
+        if (layer->attrs.count("weights")) files.push_back(desc.weightDir + "/" + layer->attrs.at("weights"));
+        if (layer->attrs.count("bias")) files.push_back(desc.weightDir + "/" + layer->attrs.at("bias"));
+    }
+
+    // Each file's hash seeds the next one
+    std::uint64_t version = 0;
+    for (const std::string& path : files) {
+        std::string bytes;
+        if (!readFile(path, bytes)) throw std::runtime_error("Cannot read " + path);
+        version = hash64(bytes.data(), bytes.size(), version);
+    }
+    return version;
+}
+
+std::string ModelDesc::summary() const {
+    std::ostringstream oss;
+    oss << "input " << dimsString(inputDims) << "\n";
+    for (std::size_t i = 0; i < layers.size(); i++) {
+        const LayerDesc& layer = layers[i];
+        oss << "L" << i << " " << layer.type << ": " << dimsString(layer.inDims) << " -> " << dimsString(layer.outDims);
+        if (!layer.weightDims.empty()) oss << ", weights " << dimsString(layer.weightDims);
+        if (layer.attrs.count("rank")) oss << ", rank " << layer.attrs.at("rank");
+        if (layer.attrs.count("energy")) oss << ", energy " << layer.attrs.at("energy");
+        oss << "\n";
+        for (const ExitDesc& exit : exits) {
+            if (exit.after == i) oss << "   exit: " << dimsString(exit.head.inDims) << " -> " << dimsString(exit.head.outDims) << ", threshold " << exit.threshold << "\n";
+        }
+    }
+    return oss.str();
+}
+
+}  // namespace ML
@@ -0,0 +1,76 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Model.h"
+#include "Types.h"
+#include "Utils.h"
+
+namespace ML {
+
+// Model description files (*.model) list the network one layer per line, so a new topology only needs a new file:
+//
+//   # comment
+//   input   shape=64x64x3
+//   conv    filters=32 kernel=5 weights=conv1_weights.bin bias=conv1_biases.bin out=60x60x32
+//   maxpool size=2
+//   flatten
+//   dense   units=200 relu=false weights=dense2_weights.bin bias=dense2_biases.bin
+//   softmax
+//
+// Attributes per layer type (defaults in brackets):
+//   conv     filters, kernel (N or HxW), stride [1], pad (N or "same") [0], dilation [1], groups [1], weights, bias
+//   maxpool  size (N or HxW), stride [size], pad [0]
+//   dense    units, relu [true], weights, bias, rank [full], energy [1]
+//   softmax  log [false]
+//   exit     threshold, weights, bias
+// An exit line is not a layer but an early exit classifier on the output of the layer above it (Model::addExitHead):
+// a flatten (for spatial outputs), a dense layer without ReLU to the model's output size and a softmax. Inference
+// stops there when the head's top-1 probability reaches the threshold. The model's output must be flat.
+// A dense layer with rank= or energy= is factorized when allocated (DenseLayer::setLowRank): to that rank, or to the
+// smallest rank keeping that share of the squared singular value spectrum.
+// Every layer accepts out=HxWxC, which is checked against the inferred output shape. Weight and bias files are
+// relative to the description file. Convolutions always apply a ReLU.
+
+// One parsed layer line with the shapes found by the validation pass
+struct LayerDesc {
+    std::size_t line;
+    std::string type;
+    std::map<std::string, std::string> attrs;
+    dimVec inDims, outDims;
+    dimVec weightDims, biasDims;
+};
+
+// An exit line: the head's dense layer (inDims is the activation it classifies) after layers[after]
+struct ExitDesc {
+    std::size_t after;
+    fp32 threshold;
+    LayerDesc head;
+};
+
+struct ModelDesc {
+    std::string path;
+    std::string weightDir;
+    dimVec inputDims;
+    std::vector<LayerDesc> layers;
+    std::vector<ExitDesc> exits;
+
+    // Layer table with the inferred shapes, one line per layer
+    std::string summary() const;
+};
+
+// Parse a description file and run shape inference over it. Any syntax error, shape mismatch or weight file of the
+// wrong size throws with the file and line, before anything is allocated
+ModelDesc loadModelDesc(const Path& path);
+
+// Build the layers (and exit heads) of a validated description
+Model buildModel(const ModelDesc& desc);
+
+// loadModelDesc + buildModel
+Model loadModel(const Path& path);
+
+// Hash of the description file and every weight and bias file it names, for keying cached results (ResultCache)
+std::uint64_t modelVersion(const ModelDesc& desc);
+
+}  // namespace ML
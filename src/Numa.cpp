@@ -0,0 +1,191 @@
+#include "Numa.h"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__linux__) && !defined(ZEDBOARD)
+#include <sched.h>
+
+#include <thread>
+#define ML_HAVE_AFFINITY
+#endif
+
+namespace ML {
+
+namespace {
+
+// Linux CPU lists, e.g. "0-3,8,10-11". Returns false on anything else
+bool parseCpuList(const std::string& text, std::vector<unsigned>& cpus) {
+    std::istringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty()) continue;
+
+        std::size_t dash = range.find('-');
+        try {
+            std::size_t pos = 0;
+            unsigned first = std::stoul(range.substr(0, dash), &pos);
+            if (pos != std::min(dash, range.size()) || range[0] == '-') return false;
+            unsigned last = first;
+            if (dash != std::string::npos) {
+                last = std::stoul(range.substr(dash + 1), &pos);
+                if (pos != range.size() - dash - 1 || last < first) return false;
+            }
+            for (unsigned cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        } catch (const std::exception&) {
+            return false;
+        }
+    }
+    return !cpus.empty();
+}
+
+std::string cpuListString(const std::vector<unsigned>& cpus) {
+    std::ostringstream oss;
+    for (std::size_t i = 0; i < cpus.size();) {
+        std::size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) j++;
+        oss << (i ? "," : "") << cpus[i];
+        if (j > i) oss << "-" << cpus[j];
+        i = j + 1;
+    }
+    return oss.str();
+}
+
+// CPUs the process may run on
+std::vector<unsigned> allowedCpus() {
+    std::vector<unsigned> cpus;
+#ifdef ML_HAVE_AFFINITY
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (unsigned cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+        }
+    }
+    for (unsigned cpu = 0; cpus.empty() && cpu < std::max<unsigned>(std::thread::hardware_concurrency(), 1); cpu++) cpus.push_back(cpu);
+#endif
+    if (cpus.empty()) cpus.push_back(0);
+    return cpus;
+}
+
+NumaTopology detect() {
+    std::vector<unsigned> allowed = allowedCpus();
+    NumaTopology topology;
+
+#ifdef ML_HAVE_AFFINITY
+    // Node ids can have gaps, "online" lists the ones that exist
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string text;
+    std::vector<unsigned> ids;
+    if (std::getline(online, text) && parseCpuList(text, ids)) {
+        for (unsigned id : ids) {
+            std::ifstream list("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            std::vector<unsigned> cpus;
+            if (!std::getline(list, text) || !parseCpuList(text, cpus)) continue;
+
+            NumaTopology::Node node{id, {}};
+            for (unsigned cpu : cpus) {
+                if (std::find(allowed.begin(), allowed.end(), cpu) != allowed.end()) node.cpus.push_back(cpu);
+            }
+            // Nodes without usable CPUs (memory only, or outside our cpuset) cannot host a worker
+            if (!node.cpus.empty()) topology.nodes.push_back(node);
+        }
+    }
+#endif
+
+    if (topology.nodes.empty()) topology.nodes.push_back(NumaTopology::Node{0, allowed});
+    return topology;
+}
+
+}  // namespace
+
+std::size_t NumaTopology::nodeOf(const unsigned cpu) const {
+    for (std::size_t n = 0; n < nodes.size(); n++) {
+        if (std::find(nodes[n].cpus.begin(), nodes[n].cpus.end(), cpu) != nodes[n].cpus.end()) return n;
+    }
+    return 0;
+}
+
+std::string NumaTopology::toString() const {
+    std::ostringstream oss;
+    oss << nodes.size() << (nodes.size() == 1 ? " node: " : " nodes: ");
+    for (std::size_t n = 0; n < nodes.size(); n++) oss << (n ? ", " : "") << nodes[n].id << " [" << cpuListString(nodes[n].cpus) << "]";
+    return oss.str();
+}
+
+const NumaTopology& NumaTopology::host() {
+    static const NumaTopology topology = detect();
+    return topology;
+}
+
+Affinity Affinity::parse(const std::string& text) {
+    Affinity affinity;
+    if (text == "none") return affinity;
+    if (text == "compact") {
+        affinity.policy = Policy::COMPACT;
+    } else if (text == "scatter") {
+        affinity.policy = Policy::SCATTER;
+    } else if (parseCpuList(text, affinity.cpus)) {
+        affinity.policy = Policy::EXPLICIT;
+    } else {
+        throw std::runtime_error("Unknown affinity '" + text + "', expected none, compact, scatter or a CPU list such as 0,2,4-7");
+    }
+    return affinity;
+}
+
+std::string Affinity::toString() const {
+    switch (policy) {
+    case Policy::NONE: return "none";
+    case Policy::COMPACT: return "compact";
+    case Policy::SCATTER: return "scatter";
+    case Policy::EXPLICIT: return cpuListString(cpus);
+    }
+    return "?";
+}
+
+int Affinity::cpuFor(const std::size_t worker, const NumaTopology& topology) const {
+    if (policy == Policy::NONE) return -1;
+    if (policy == Policy::EXPLICIT) return cpus.empty() ? -1 : (int)cpus[worker % cpus.size()];
+
+    std::vector<unsigned> order;
+    if (policy == Policy::COMPACT) {
+        for (const NumaTopology::Node& node : topology.nodes) order.insert(order.end(), node.cpus.begin(), node.cpus.end());
+    } else {
+        // Round robin over the nodes, the i-th CPU of every node before any node's (i+1)-th
+        std::size_t longest = 0;
+        for (const NumaTopology::Node& node : topology.nodes) longest = std::max(longest, node.cpus.size());
+        for (std::size_t i = 0; i < longest; i++) {
+            for (const NumaTopology::Node& node : topology.nodes) {
+                if (i < node.cpus.size()) order.push_back(node.cpus[i]);
+            }
+        }
+    }
+    return order.empty() ? -1 : (int)order[worker % order.size()];
+}
+
+bool pinThread(const int cpu) {
+    if (cpu < 0) return false;
+#ifdef ML_HAVE_AFFINITY
+    if (cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    return false;
+#endif
+}
+
+int currentCpu() {
+#ifdef ML_HAVE_AFFINITY
+    return sched_getcpu();
+#else
+    return -1;
+#endif
+}
+
+}  // namespace ML
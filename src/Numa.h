@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace ML {
+
+// NUMA nodes of the host and the CPUs of each that this process may run on, read from /sys/devices/system/node on
+// Linux. Anywhere else (or without that directory) the host is one node holding every CPU
+struct NumaTopology {
+    struct Node {
+        unsigned id;
+        std::vector<unsigned> cpus;
+    };
+    std::vector<Node> nodes;
+
+    // Node index (into `nodes`) of a CPU, 0 for an unknown CPU
+    std::size_t nodeOf(const unsigned cpu) const;
+
+    // e.g. "2 nodes: 0 [0-7], 1 [8-15]"
+    std::string toString() const;
+
+    // Detected once
+    static const NumaTopology& host();
+};
+
+// Placement of worker threads on CPUs:
+//   none      threads run where the scheduler puts them
+//   compact   worker w takes the w-th CPU, filling a node before using the next one (shared caches, local memory)
+//   scatter   workers alternate over the nodes (memory bandwidth of every socket)
+//   0,2,8-11  an explicit CPU list, worker w takes the w-th entry
+// Workers beyond the number of CPUs wrap around
+struct Affinity {
+    enum class Policy { NONE, COMPACT, SCATTER, EXPLICIT };
+
+    Policy policy = Policy::NONE;
+    std::vector<unsigned> cpus;  // EXPLICIT
+
+    // Throws on anything but the forms above
+    static Affinity parse(const std::string& text);
+    std::string toString() const;
+
+    // CPU of a worker, -1 for NONE
+    int cpuFor(const std::size_t worker, const NumaTopology& topology = NumaTopology::host()) const;
+};
+
+// Restrict the calling thread to one CPU (sched_setaffinity), false if it is not supported or failed. -1 does nothing
+bool pinThread(const int cpu);
+
+// CPU the calling thread runs on, -1 if unknown
+int currentCpu();
+
+}  // namespace ML
@@ -0,0 +1,78 @@
+#include "ParallelInference.h"
+
+#ifndef ZEDBOARD
+#include <sstream>
+#include <stdexcept>
+
+namespace ML {
+
+ParallelInference::ParallelInference(const Model& model, TaskScheduler& scheduler, const Options& options)
+    : model(model), scheduler(scheduler), stage(model.getNumLayers()) {
+    if (model.getNumLayers() == 0) throw std::runtime_error("Parallel inference needs a model with layers");
+    if (options.tileRows == 0) throw std::runtime_error("Parallel inference tiles need at least one row");
+    for (std::size_t i = 0; i < model.getNumLayers(); i++) {
+        if (model[i].layoutFor(Layer::InfType::SIMD) != Layout::NHWC) {
+            throw std::runtime_error("Parallel inference needs NHWC activations, L" + std::to_string(i) + " has a blocked layout (Model::resetLayouts)");
+        }
+    }
+
+    // Tasks of the previous layer, with the input rows they produce for this one (spatial layers only)
+    std::vector<TaskGraph::TaskId> previous;
+    std::vector<Region> previousRows;
+    for (std::size_t i = 0; i < model.getNumLayers(); i++) {
+        const Layer& layer = model[i];
+        std::vector<TaskGraph::TaskId> tasks;
+        std::vector<Region> rows;
+
+        if (!layer.supportsRegions()) {
+            tasks.push_back(graph.add(
+                [this, i] {
+                    Layout layout = Layout::NHWC;
+                    this->model.inferenceRange(inputOf(i), layout, i, i + 1, Layer::InfType::SIMD, stage);
+                },
+                previous));
+        } else {
+            const dimVec& out = layer.getOutputParams().dims;
+            const std::size_t inWidth = layer.getInputParams().dims[ParamIndex::WIDTH];
+            for (std::size_t r0 = 0; r0 < out[ParamIndex::HEIGHT]; r0 += options.tileRows) {
+                Region region = {r0, std::min(r0 + options.tileRows, out[ParamIndex::HEIGHT]), 0, out[ParamIndex::WIDTH]};
+
+                // A band waits for the previous bands any of its outputs read, every previous task when those are not bands
+                std::vector<TaskGraph::TaskId> deps;
+                for (std::size_t t = 0; t < previous.size(); t++) {
+                    Region reads = previousRows.empty() ? region : layer.outputRegion({previousRows[t].h0, previousRows[t].h1, 0, inWidth});
+                    if (reads.h0 < region.h1 && region.h0 < reads.h1) deps.push_back(previous[t]);
+                }
+                tasks.push_back(graph.add([this, i, region] { this->model[i].computeRegion(inputOf(i), region); }, deps));
+                rows.push_back(region);
+            }
+        }
+
+        layerTasks.push_back(tasks.size());
+        previous = tasks;
+        previousRows = rows;
+    }
+}
+
+const LayerData& ParallelInference::inputOf(const std::size_t layer) const {
+    return layer == 0 ? *image : model[layer - 1].getOutputData();
+}
+
+const LayerData& ParallelInference::infer(const LayerData& in) {
+    if (!model[0].getInputParams().isCompatible(in.getParams())) throw std::runtime_error("Image does not match the model input");
+    image = &in;
+    scheduler.run(graph);
+    return model.getOutputLayer().getOutputData();
+}
+
+std::string ParallelInference::graphString() const {
+    std::ostringstream oss;
+    for (std::size_t i = 0; i < layerTasks.size(); i++) {
+        oss << (i ? ", " : "") << "L" << i << " " << layerTasks[i] << (model[i].supportsRegions() ? " tiles" : " task");
+    }
+    oss << " (" << graph.size() << " tasks, " << graph.edges() << " edges)";
+    return oss.str();
+}
+
+}  // namespace ML
+#endif
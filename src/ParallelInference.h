@@ -0,0 +1,51 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Model.h"
+#include "Scheduler.h"
+
+namespace ML {
+
+// Inference as a graph of tile tasks on a work stealing TaskScheduler, without a barrier between layers. Spatial
+// layers (convolution, max pooling) are split into bands of output rows computed with Layer::computeRegion, and a band
+// only waits for the bands of the previous layer its receptive field reads (Layer::outputRegion), so the first rows of
+// a layer are computed while the previous layer still works on its last rows. Layers without a spatial structure
+// (flatten, dense, softmax) are one task each, which starts as soon as the last tile it reads is done.
+//
+// The graph is built once for the model's shapes and reused by every inference. The tiles run the SIMD kernels on NHWC
+// activations, so the model must be in NHWC (Model::resetLayouts).
+class ParallelInference {
+   public:
+    struct Options {
+        // Output rows per tile of the spatial layers
+        std::size_t tileRows = 4;
+    };
+
+    ParallelInference(const Model& model, TaskScheduler& scheduler, const Options& options);
+    ParallelInference(const Model& model, TaskScheduler& scheduler) : ParallelInference(model, scheduler, Options()) {}
+
+    // Output (NHWC) for an image, valid until the next call
+    const LayerData& infer(const LayerData& image);
+
+    // Tasks per layer and the dependency edges, e.g. "L0 15 tiles, L1 14 tiles, ..., L12 1 task (120 tasks, 310 edges)"
+    std::string graphString() const;
+
+   private:
+    const LayerData& inputOf(const std::size_t layer) const;
+
+    const Model& model;
+    TaskScheduler& scheduler;
+    TaskGraph graph;
+    std::vector<std::size_t> layerTasks;
+
+    const LayerData* image = nullptr;
+    // Reorder buffers of the non spatial layers (unused in NHWC, inferenceRange needs them)
+    std::vector<std::unique_ptr<LayerData>> stage;
+};
+
+}  // namespace ML
+#endif
@@ -0,0 +1,245 @@
+#include "Pipeline.h"
+
+#ifndef ZEDBOARD
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+namespace ML {
+
+Pipeline::Pipeline(Model& model, const LayerData& sample, const Options& options)
+    : model(model), options(options), inputFree(std::max<std::size_t>(options.depth, 1)), input(std::max<std::size_t>(options.depth, 1)),
+      results(std::max<std::size_t>(options.depth, 1)) {
+    const std::size_t numLayers = model.getNumLayers();
+    const std::size_t depth = std::max<std::size_t>(options.depth, 1);
+    if (numLayers == 0) throw std::runtime_error("Cannot pipeline a model without layers");
+    if (!model[0].getInputParams().isCompatible(sample.getParams())) throw std::runtime_error("Pipeline sample does not match the model input");
+
+    // Time every layer on the sample, the first pass only warms up the caches and the reorder buffers
+    std::vector<double> layerMs(numLayers);
+    std::vector<std::unique_ptr<LayerData>> calibration;
+    layerTimers = model.hasLayerTimers();
+    model.setLayerTimers(false);
+    for (int pass = 0; pass < 2; pass++) {
+        const LayerData* data = &sample;
+        Layout layout = Layout::NHWC;
+        for (std::size_t i = 0; i < numLayers; i++) {
+            Clock::time_point begin = Clock::now();
+            data = &model.inferenceRange(*data, layout, i, i + 1, options.infType, calibration);
+            layerMs[i] = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+        }
+    }
+
+    std::size_t count = options.stages ? options.stages : std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    partition(layerMs, std::min(count, numLayers));
+
+    for (std::size_t i = 0; i < depth; i++) {
+        inputBuffers.emplace_back(new LayerData(model[0].getInputParams()));
+        inputBuffers.back()->setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+        inputBuffers.back()->allocData();
+        inputFree.push(inputBuffers.back().get());
+    }
+
+    for (std::size_t s = 0; s + 1 < stages.size(); s++) {
+        Stage& stage = *stages[s];
+        for (std::size_t i = 0; i < depth; i++) {
+            stage.buffers.emplace_back(new LayerData(model[stage.last - 1].getOutputParams()));
+            stage.buffers.back()->setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+            stage.buffers.back()->allocData();
+            stage.free.push(stage.buffers.back().get());
+        }
+    }
+
+    for (std::size_t s = 0; s < stages.size(); s++) {
+        BoundedQueue<Item>& in = s == 0 ? input : stages[s - 1]->out;
+        stages[s]->thread = std::thread(&Pipeline::runStage, this, std::ref(*stages[s]), s, std::ref(in));
+    }
+}
+
+Pipeline::~Pipeline() {
+    abort();
+    for (std::unique_ptr<Stage>& stage : stages) {
+        if (stage->thread.joinable()) stage->thread.join();
+    }
+    model.setLayerTimers(layerTimers);
+}
+
+void Pipeline::partition(const std::vector<double>& layerMs, std::size_t count) {
+    const std::size_t n = layerMs.size();
+
+    // A stage can end after layer i unless it is a view of its input buffer (the next stage would read a buffer
+    // that is already being reused)
+    std::vector<bool> canEnd(n);
+    std::size_t ends = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        canEnd[i] = i + 1 == n || !model[i].isView();
+        ends += canEnd[i];
+    }
+    count = std::max<std::size_t>(std::min(count, ends), 1);
+
+    std::vector<double> prefix(n + 1, 0);
+    for (std::size_t i = 0; i < n; i++) prefix[i + 1] = prefix[i] + layerMs[i];
+
+    // best[s][j]: smallest slowest stage splitting layers [0, j) into s stages, cut[s][j]: where the last one starts
+    const double inf = std::numeric_limits<double>::infinity();
+    std::vector<std::vector<double>> best(count + 1, std::vector<double>(n + 1, inf));
+    std::vector<std::vector<std::size_t>> cut(count + 1, std::vector<std::size_t>(n + 1, 0));
+    best[0][0] = 0;
+    for (std::size_t s = 1; s <= count; s++) {
+        for (std::size_t j = 1; j <= n; j++) {
+            if (!canEnd[j - 1]) continue;
+            for (std::size_t k = 0; k < j; k++) {
+                if (best[s - 1][k] == inf) continue;
+                double slowest = std::max(best[s - 1][k], prefix[j] - prefix[k]);
+                if (slowest < best[s][j]) {
+                    best[s][j] = slowest;
+                    cut[s][j] = k;
+                }
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Stage>> planned;
+    for (std::size_t s = count, j = n; s > 0; j = cut[s][j], s--) {
+        planned.emplace_back(new Stage(cut[s][j], j, std::max<std::size_t>(options.depth, 1)));
+        planned.back()->calibratedMs = prefix[j] - prefix[cut[s][j]];
+    }
+    stages.assign(std::make_move_iterator(planned.rbegin()), std::make_move_iterator(planned.rend()));
+}
+
+void Pipeline::runStage(Stage& stage, const std::size_t index, BoundedQueue<Item>& in) {
+    const bool lastStage = &stage == stages.back().get();
+    LayerData& layerOut = model[stage.last - 1].getOutputData();
+
+    try {
+        // Only this thread touches the stage's layers and output buffers until it hands out the first image
+        if (pinThread(options.affinity.cpuFor(index))) {
+            for (std::size_t i = stage.first; i < stage.last; i++) model[i].localizeBuffers();
+            for (std::unique_ptr<LayerData>& buffer : stage.buffers) buffer->localize();
+        }
+
+        Item item;
+        while (in.pop(item)) {
+            LayerData* buffer = nullptr;
+            if (!lastStage && !stage.free.pop(buffer)) break;
+
+            // The last layer of the stage writes straight into the free buffer
+            Layout layout = item.layout;
+            if (buffer) std::swap(*buffer, layerOut);
+            const LayerData& result = model.inferenceRange(*item.data, layout, stage.first, stage.last, options.infType, stage.reorderBuffers);
+            if (buffer) std::swap(*buffer, layerOut);
+
+            if (!lastStage) {
+                item.home->push(item.data);
+                stage.out.push(Item{buffer, layout, &stage.free});
+                continue;
+            }
+
+            LayerData output(result.getParams());
+            output.setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+            output.allocData();
+            const dimVec& dims = result.getParams().dims;
+            if (layout == Layout::NHWC) {
+                std::memcpy(output.raw(), result.raw(), result.getParams().byte_size());
+            } else {
+                reorder(result.ptr<fp32>(), layout, output.ptr<fp32>(), Layout::NHWC, dims[ParamIndex::HEIGHT], dims[ParamIndex::WIDTH],
+                        dims[ParamIndex::CHANNELS], model.getScratchMemory());
+            }
+            // Only now, a trailing view layer reads the input buffer
+            item.home->push(item.data);
+
+            {
+                std::lock_guard<std::mutex> lock(statsMutex);
+                doneTimes.push_back(Clock::now());
+            }
+            results.push(std::move(output));
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+
+    // Drained (or aborted), let the next stage finish too
+    if (lastStage) {
+        results.close();
+    } else {
+        stage.out.close();
+    }
+}
+
+void Pipeline::push(const LayerData& image) {
+    if (!model[0].getInputParams().isCompatible(image.getParams())) throw std::runtime_error("Pipeline input does not match the model input");
+
+    LayerData* buffer;
+    if (!inputFree.pop(buffer)) throw std::runtime_error("Pipeline is closed");
+    std::memcpy(buffer->raw(), image.raw(), image.getParams().byte_size());
+    if (!input.push(Item{buffer, Layout::NHWC, &inputFree})) throw std::runtime_error("Pipeline is closed");
+}
+
+bool Pipeline::pull(LayerData& result) {
+    if (results.pop(result)) {
+        // Handed to the caller, the result no longer counts as the model's
+        result.setAccount(nullptr, MemoryKind::ACTIVATIONS);
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (error) std::rethrow_exception(error);
+    return false;
+}
+
+void Pipeline::close() {
+    input.close();
+}
+
+void Pipeline::fail(std::exception_ptr stageError) {
+    {
+        std::lock_guard<std::mutex> lock(statsMutex);
+        if (!error) error = stageError;
+    }
+    abort();
+}
+
+// Wake every thread waiting on a queue, the stages then exit
+void Pipeline::abort() {
+    inputFree.close();
+    input.close();
+    for (std::unique_ptr<Stage>& stage : stages) {
+        stage->free.close();
+        stage->out.close();
+    }
+    results.close();
+}
+
+std::string Pipeline::stagesString() const {
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(2);
+    for (std::size_t s = 0; s < stages.size(); s++) {
+        const Stage& stage = *stages[s];
+        oss << (s ? " | " : "") << "L" << stage.first;
+        if (stage.last - stage.first > 1) oss << "-L" << stage.last - 1;
+        oss << " (" << stage.calibratedMs << "ms)";
+    }
+    return oss.str();
+}
+
+std::size_t Pipeline::completed() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    return doneTimes.size();
+}
+
+double Pipeline::imagesPerSecond() const {
+    std::lock_guard<std::mutex> lock(statsMutex);
+    if (doneTimes.size() < 2) return 0;
+
+    // Skip the results produced while the pipeline was still filling up
+    std::size_t first = std::min(stages.size(), doneTimes.size() / 2);
+    double seconds = std::chrono::duration<double>(doneTimes.back() - doneTimes[first]).count();
+    return seconds > 0 ? (doneTimes.size() - 1 - first) / seconds : 0;
+}
+
+}  // namespace ML
+#endif
@@ -0,0 +1,114 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <chrono>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Model.h"
+#include "Numa.h"
+
+namespace ML {
+
+// Streaming inference for a continuous feed of images. The layers are split into contiguous stages that each run on
+// their own thread, so consecutive images overlap: while image k is in the later convolutions, image k+1 is already
+// in the first ones. Stages hand activations over through bounded queues. Each stage owns `depth` output buffers and
+// writes every image into the next free one (double buffering with the default depth of 2), so it can compute the
+// next image while its consumer still reads the previous one.
+//
+// push() blocks when the pipeline is full, so push and pull from different threads, or pull whenever a result is ready.
+class Pipeline {
+   public:
+    struct Options {
+        // Number of stages (threads), 0 picks one per hardware thread. Clamped to the number of layers
+        std::size_t stages = 0;
+        // Output buffers per stage, and capacity of the queues between stages
+        std::size_t depth = 2;
+        Layer::InfType infType = Layer::InfType::SIMD;
+        // Stage s runs on affinity.cpuFor(s). A pinned stage reallocates its layers' buffers and weights and its output
+        // buffers from its own thread before the first image, so they are local to its NUMA node
+        Affinity affinity;
+    };
+
+    // `sample` (a model input) is run once through the layers to time them, the stages are then balanced on those times
+    Pipeline(Model& model, const LayerData& sample, const Options& options);
+    Pipeline(Model& model, const LayerData& sample) : Pipeline(model, sample, Options()) {}
+    ~Pipeline();
+
+    Pipeline(const Pipeline&) = delete;
+    Pipeline& operator=(const Pipeline&) = delete;
+
+    // Queue an image (copied), waits while the pipeline is full
+    void push(const LayerData& image);
+
+    // Next result (NHWC, in push order), waits until one is ready. Returns false once close() was called and every
+    // pushed image came out. Rethrows an exception raised by a stage
+    bool pull(LayerData& result);
+
+    // No more images, the pipeline drains
+    void close();
+
+    // Stage layer ranges with their calibrated times, e.g. "L0 (1.20ms) | L1-L2 (1.10ms)"
+    std::string stagesString() const;
+    std::size_t numStages() const { return stages.size(); }
+
+    // Results produced so far, and the steady state throughput: the rate of the results after the pipeline filled up
+    std::size_t completed() const;
+    double imagesPerSecond() const;
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    // An activation handed from one stage to the next, its buffer goes back to `home` once consumed
+    struct Item {
+        LayerData* data;
+        Layout layout;
+        BoundedQueue<LayerData*>* home;
+    };
+
+    struct Stage {
+        Stage(const std::size_t first, const std::size_t last, const std::size_t depth) : first(first), last(last), free(depth), out(depth) {}
+
+        std::size_t first, last;
+        double calibratedMs = 0;
+
+        // Output buffers and the ones not in use, the model's last stage copies its result out instead
+        std::vector<std::unique_ptr<LayerData>> buffers;
+        BoundedQueue<LayerData*> free;
+        BoundedQueue<Item> out;
+
+        std::vector<std::unique_ptr<LayerData>> reorderBuffers;
+        std::thread thread;
+    };
+
+    // Balance the layers over `count` stages on the calibrated per layer times, stages never end on a view layer
+    void partition(const std::vector<double>& layerMs, std::size_t count);
+
+    void runStage(Stage& stage, const std::size_t index, BoundedQueue<Item>& in);
+    void fail(std::exception_ptr error);
+    void abort();
+
+    Model& model;
+    Options options;
+    bool layerTimers;
+
+    // Input buffers for push() and the queue into the first stage
+    std::vector<std::unique_ptr<LayerData>> inputBuffers;
+    BoundedQueue<LayerData*> inputFree;
+    BoundedQueue<Item> input;
+
+    std::vector<std::unique_ptr<Stage>> stages;
+    BoundedQueue<LayerData> results;
+
+    mutable std::mutex statsMutex;
+    std::vector<Clock::time_point> doneTimes;
+    std::exception_ptr error;
+};
+
+}  // namespace ML
+#endif
@@ -0,0 +1,115 @@
+#include "ResultCache.h"
+
+#ifndef ZEDBOARD
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "Hash.h"
+
+namespace ML {
+
+ResultCache::ResultCache(const Options& options) {
+    if (options.stripes == 0) throw std::runtime_error("The result cache needs at least one stripe");
+    for (std::size_t i = 0; i < options.stripes; i++) stripes.emplace_back(new Stripe());
+    stripeCapacity = options.capacityBytes / options.stripes;
+}
+
+std::uint64_t ResultCache::keyOf(const LayerData& input, const std::uint64_t version) {
+    return hash64(input.raw(), input.getParams().byte_size(), version);
+}
+
+bool ResultCache::lookup(const std::uint64_t key, LayerData& out) {
+    Stripe& stripe = stripeOf(key);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+
+    auto found = stripe.index.find(key);
+    if (found == stripe.index.end()) {
+        stripe.misses++;
+        return false;
+    }
+    Entry& entry = stripe.entries[found->second];
+    if (entry.bytes.size() != out.getParams().byte_size()) throw std::runtime_error("Cached result does not match the output size");
+    std::memcpy(out.raw(), entry.bytes.data(), entry.bytes.size());
+    entry.referenced = true;
+    stripe.hits++;
+    return true;
+}
+
+void ResultCache::insert(const std::uint64_t key, const LayerData& output) {
+    std::size_t size = output.getParams().byte_size();
+    if (entryBytes(size) > stripeCapacity) return;
+
+    Stripe& stripe = stripeOf(key);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    if (stripe.index.count(key)) return;
+
+    while (stripe.bytes + entryBytes(size) > stripeCapacity) evictOne(stripe);
+
+    const char* data = (const char*)output.raw();
+    // New entries start unreferenced, so a result seen once is evicted before one that was hit
+    stripe.entries.push_back(Entry{key, std::vector<char>(data, data + size), false});
+    stripe.index[key] = stripe.entries.size() - 1;
+    stripe.bytes += entryBytes(size);
+    memory.charge(MemoryKind::SCRATCH, size, entryBytes(size));
+    stripe.insertions++;
+}
+
+void ResultCache::evictOne(Stripe& stripe) {
+    while (true) {
+        if (stripe.hand >= stripe.entries.size()) stripe.hand = 0;
+        Entry& entry = stripe.entries[stripe.hand];
+        if (entry.referenced) {
+            entry.referenced = false;
+            stripe.hand++;
+            continue;
+        }
+
+        // The last entry takes the victim's slot, the hand stays to look at it next
+        stripe.bytes -= entryBytes(entry.bytes.size());
+        forget(entry);
+        stripe.index.erase(entry.key);
+        if (stripe.hand + 1 != stripe.entries.size()) {
+            entry = std::move(stripe.entries.back());
+            stripe.index[entry.key] = stripe.hand;
+        }
+        stripe.entries.pop_back();
+        stripe.evictions++;
+        return;
+    }
+}
+
+void ResultCache::clear() {
+    for (std::unique_ptr<Stripe>& stripe : stripes) {
+        std::lock_guard<std::mutex> lock(stripe->mutex);
+        for (const Entry& entry : stripe->entries) forget(entry);
+        stripe->entries.clear();
+        stripe->index.clear();
+        stripe->hand = stripe->bytes = 0;
+    }
+}
+
+ResultCache::Stats ResultCache::stats() const {
+    Stats total;
+    for (const std::unique_ptr<Stripe>& stripe : stripes) {
+        std::lock_guard<std::mutex> lock(stripe->mutex);
+        total.hits += stripe->hits;
+        total.misses += stripe->misses;
+        total.insertions += stripe->insertions;
+        total.evictions += stripe->evictions;
+        total.entries += stripe->entries.size();
+        total.bytes += stripe->bytes;
+    }
+    return total;
+}
+
+std::string ResultCache::Stats::toString() const {
+    std::ostringstream oss;
+    oss << "hits " << hits << ", misses " << misses << " (" << std::fixed << std::setprecision(1) << 100 * hitRate() << "% hit rate), " << insertions
+        << " insertions, " << evictions << " evictions, " << entries << " entries in " << bytes / 1024.0 << "KB";
+    return oss.str();
+}
+
+}  // namespace ML
+#endif
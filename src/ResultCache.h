@@ -0,0 +1,99 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "layers/Layer.h"
+
+namespace ML {
+
+// Content addressed cache of model outputs for request streams with duplicate images. Results are keyed by a hash of
+// the input bytes (hash64) and a model version, so a hit returns the stored output without running any layer. Every
+// backend's output serves every backend.
+//
+// Memory is bounded by `capacityBytes` (outputs plus bookkeeping) and charged to the cache's account as
+// MemoryKind::SCRATCH, the outputs as bytes and the bookkeeping estimate as reserved. Entries are evicted with the CLOCK algorithm
+// (an approximate LRU: a hit sets an entry's reference bit, and the clock hand skips and clears set bits before it
+// evicts). The keys are split over `stripes` independently locked shards, so threads running their own models can
+// share one cache without serializing on a single lock.
+//
+// Two inputs with the same 64 bit hash would share an entry, which a non-adversarial stream never hits in practice.
+class ResultCache {
+   public:
+    struct Options {
+        std::size_t capacityBytes = 16 << 20;
+        std::size_t stripes = 16;
+    };
+
+    struct Stats {
+        std::size_t hits = 0, misses = 0, insertions = 0, evictions = 0;
+        std::size_t entries = 0, bytes = 0;
+
+        double hitRate() const { return hits + misses ? (double)hits / (hits + misses) : 0; }
+
+        // e.g. "hits 90, misses 10 (90.0% hit rate), 10 insertions, 0 evictions, 10 entries in 8.4KB"
+        std::string toString() const;
+    };
+
+    explicit ResultCache(const Options& options);
+    ResultCache() : ResultCache(Options()) {}
+    ~ResultCache() { clear(); }
+
+    ResultCache(const ResultCache&) = delete;
+    ResultCache& operator=(const ResultCache&) = delete;
+
+    // Key of an input for a model version
+    static std::uint64_t keyOf(const LayerData& input, const std::uint64_t version);
+
+    // Copy the stored output into `out` (allocated, same size as the stored output), false on a miss
+    bool lookup(const std::uint64_t key, LayerData& out);
+
+    // Store a copy of an output, evicting entries until it fits. Outputs larger than a stripe are not stored
+    void insert(const std::uint64_t key, const LayerData& output);
+
+    void clear();
+
+    Stats stats() const;
+
+    // Parented to the model the cache is attached to (Model::setResultCache), otherwise to the process
+    MemoryAccount& getMemory() { return memory; }
+
+   private:
+    struct Entry {
+        std::uint64_t key;
+        std::vector<char> bytes;
+        bool referenced;
+    };
+
+    struct Stripe {
+        mutable std::mutex mutex;
+        std::vector<Entry> entries;
+        std::unordered_map<std::uint64_t, std::size_t> index;
+        std::size_t hand = 0, bytes = 0;
+        std::size_t hits = 0, misses = 0, insertions = 0, evictions = 0;
+    };
+
+    // Memory charged for an entry: the output and an estimate of the slot and hash map node
+    static std::size_t entryBytes(const std::size_t outputBytes) { return outputBytes + sizeof(Entry) + 4 * sizeof(void*); }
+
+    Stripe& stripeOf(const std::uint64_t key) { return *stripes[(key >> 32) % stripes.size()]; }
+
+    // Remove the entry under the clock hand that was not referenced since the hand last passed it
+    void evictOne(Stripe& stripe);
+
+    // Release the charge of an entry being dropped
+    void forget(const Entry& entry) { memory.release(MemoryKind::SCRATCH, entry.bytes.size(), entryBytes(entry.bytes.size())); }
+
+    // Declared before the entries charged to it
+    MemoryAccount memory;
+    std::vector<std::unique_ptr<Stripe>> stripes;
+    std::size_t stripeCapacity;
+};
+
+}  // namespace ML
+#endif
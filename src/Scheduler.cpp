@@ -0,0 +1,173 @@
+#include "Scheduler.h"
+
+#ifndef ZEDBOARD
+#include <algorithm>
+#include <stdexcept>
+
+namespace ML {
+
+TaskGraph::TaskId TaskGraph::add(std::function<void()> work, const std::vector<TaskId>& deps) {
+    TaskId id = tasks.size();
+    for (TaskId dep : deps) {
+        if (dep >= id) throw std::runtime_error("A task can only depend on tasks added before it");
+    }
+    tasks.push_back(Task{std::move(work), {}, deps.size()});
+    for (TaskId dep : deps) tasks[dep].dependents.push_back(id);
+    return id;
+}
+
+std::size_t TaskGraph::edges() const {
+    std::size_t count = 0;
+    for (const Task& task : tasks) count += task.deps;
+    return count;
+}
+
+TaskScheduler::TaskScheduler(const Options& options) : remaining(0), failed(false), queued(0), runs(0), executed(0), steals(0) {
+    std::size_t count = options.threads ? options.threads : std::max<unsigned>(std::thread::hardware_concurrency(), 1);
+    for (std::size_t i = 0; i < count; i++) workers.emplace_back(new Worker());
+    for (std::size_t i = 1; i < count; i++) threads.emplace_back(&TaskScheduler::workerLoop, this, i, options.affinity.cpuFor(i));
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& thread : threads) thread.join();
+}
+
+void TaskScheduler::run(const TaskGraph& taskGraph) {
+    std::lock_guard<std::mutex> runLock(runMutex);
+    const std::size_t n = taskGraph.tasks.size();
+    if (n == 0) return;
+
+    pending.reset(new std::atomic<std::size_t>[n]);
+    for (std::size_t i = 0; i < n; i++) pending[i] = taskGraph.tasks[i].deps;
+    remaining = n;
+    failed = false;
+    error = nullptr;
+    {
+        // Workers only look at the graph once a task is queued, the lock publishes it to them
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        graph = &taskGraph;
+    }
+
+    // Spread the tasks without dependencies over the workers, they would steal them anyway
+    std::size_t next = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        if (taskGraph.tasks[i].deps == 0) push(next++ % workers.size(), i);
+    }
+
+    while (remaining > 0) {
+        if (runOne(0)) continue;
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        wake.wait(lock, [&] { return queued > 0 || remaining == 0; });
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        graph = nullptr;
+    }
+    runs++;
+    if (error) std::rethrow_exception(error);
+}
+
+void TaskScheduler::workerLoop(const std::size_t index, const int cpu) {
+    pinThread(cpu);
+    while (true) {
+        if (runOne(index)) continue;
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            wake.wait(lock, [&] { return queued > 0 || !jobs.empty() || stopping; });
+            if (stopping) return;
+            // Graph tasks first, a run() is waiting for them
+            if (queued > 0) continue;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        try {
+            job();
+        } catch (...) {
+        }
+    }
+}
+
+void TaskScheduler::post(std::function<void()> job) {
+    if (threads.empty()) throw std::runtime_error("Posting a job needs a scheduler with more than one thread");
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        jobs.push_back(std::move(job));
+    }
+    // run() waits on the same condition without looking at the jobs, so wake everyone
+    wake.notify_all();
+}
+
+bool TaskScheduler::runOne(const std::size_t index) {
+    TaskGraph::TaskId task = 0;
+    bool found = false;
+
+    // Own deque newest first, then the oldest task of the other workers in turn
+    for (std::size_t k = 0; k < workers.size() && !found; k++) {
+        Worker& worker = *workers[(index + k) % workers.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (worker.ready.empty()) continue;
+        if (k == 0) {
+            task = worker.ready.back();
+            worker.ready.pop_back();
+        } else {
+            task = worker.ready.front();
+            worker.ready.pop_front();
+            steals++;
+        }
+        found = true;
+    }
+    if (!found) return false;
+    queued--;
+
+    if (!failed) {
+        try {
+            graph->tasks[task].work();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            if (!failed) error = std::current_exception();
+            failed = true;
+        }
+    }
+    executed++;
+    finish(index, task);
+    return true;
+}
+
+void TaskScheduler::finish(const std::size_t index, const TaskGraph::TaskId task) {
+    for (TaskGraph::TaskId dependent : graph->tasks[task].dependents) {
+        if (--pending[dependent] == 0) push(index, dependent);
+    }
+    if (--remaining == 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_all();
+    }
+}
+
+void TaskScheduler::push(const std::size_t index, const TaskGraph::TaskId task) {
+    // Counted before the sleep lock is taken, so a worker checking the count under that lock cannot miss the task
+    queued++;
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->mutex);
+        workers[index]->ready.push_back(task);
+    }
+    std::lock_guard<std::mutex> lock(sleepMutex);
+    wake.notify_one();
+}
+
+TaskScheduler::Stats TaskScheduler::stats() const {
+    Stats stats;
+    stats.runs = runs;
+    stats.tasks = executed;
+    stats.steals = steals;
+    return stats;
+}
+
+}  // namespace ML
+#endif
@@ -0,0 +1,120 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Numa.h"
+
+namespace ML {
+
+// Tasks with the tasks they wait for, built once and run any number of times by a TaskScheduler
+class TaskGraph {
+   public:
+    using TaskId = std::size_t;
+
+    // Add a task that runs once every task in `deps` (added before it) has finished
+    TaskId add(std::function<void()> work, const std::vector<TaskId>& deps = {});
+
+    std::size_t size() const { return tasks.size(); }
+    // Dependency edges over all tasks
+    std::size_t edges() const;
+
+   private:
+    friend class TaskScheduler;
+
+    struct Task {
+        std::function<void()> work;
+        std::vector<TaskId> dependents;
+        std::size_t deps;
+    };
+    std::vector<Task> tasks;
+};
+
+// Work stealing thread pool for task graphs. Every worker owns a deque of ready tasks: it pushes the tasks its own
+// work made ready and pops them newest first (they read what it just wrote, which is still in its cache), while an
+// idle worker steals the oldest task of another worker's deque. A task starts as soon as its own dependencies are done,
+// so there is no barrier between groups of tasks (e.g. layers) unless the graph asks for one.
+//
+// The thread calling run() works as worker 0 until the graph is done, the other workers sleep between runs. One graph
+// runs at a time, concurrent run() calls take turns. Independent jobs can also be posted to the workers without waiting
+// for them (AsyncInference), they run between graph tasks.
+class TaskScheduler {
+   public:
+    struct Options {
+        // Workers including the thread calling run(), 0 picks one per hardware thread
+        std::size_t threads = 0;
+        // Worker w runs on affinity.cpuFor(w). Worker 0 is the calling thread, which is left where it is (the caller
+        // can pin itself to affinity.cpuFor(0))
+        Affinity affinity;
+    };
+
+    struct Stats {
+        std::size_t runs = 0, tasks = 0, steals = 0;
+    };
+
+    explicit TaskScheduler(const Options& options);
+    TaskScheduler() : TaskScheduler(Options()) {}
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Run every task of the graph and wait for all of them. After a task throws, the tasks that did not start yet are
+    // skipped and the first exception is rethrown here
+    void run(const TaskGraph& graph);
+
+    // Run `job` on one of the scheduler's own workers (never the thread calling run()) and return at once. Jobs start in
+    // the order they were posted, the ones not started when the scheduler is destroyed are dropped. Throws if the
+    // scheduler has no worker besides the caller (threads = 1)
+    void post(std::function<void()> job);
+
+    std::size_t numThreads() const { return workers.size(); }
+    Stats stats() const;
+
+   private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<TaskGraph::TaskId> ready;
+    };
+
+    void workerLoop(const std::size_t index, const int cpu);
+
+    // Run one task from the worker's own deque or a stolen one, false if every deque was empty
+    bool runOne(const std::size_t index);
+
+    // Release the dependents of a finished task onto the worker's deque
+    void finish(const std::size_t index, const TaskGraph::TaskId task);
+
+    void push(const std::size_t index, const TaskGraph::TaskId task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    // Current run
+    std::mutex runMutex;
+    const TaskGraph* graph = nullptr;
+    std::unique_ptr<std::atomic<std::size_t>[]> pending;
+    std::atomic<std::size_t> remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr error;
+
+    // Sleeping workers wait for queued tasks, run() for the last task to finish
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<std::size_t> queued;
+    std::deque<std::function<void()>> jobs;
+    bool stopping = false;
+
+    std::atomic<std::size_t> runs, executed, steals;
+};
+
+}  // namespace ML
+#endif
@@ -0,0 +1,256 @@
+#include "Server.h"
+
+#ifndef ZEDBOARD
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+#include "ResultCache.h"
+
+namespace ML {
+
+// --- Histogram ---
+
+std::size_t Histogram::bucketOf(const double value) const {
+    if (!powerOfTwo) return (std::size_t)std::max(value, 0.0);
+    return value <= 1 ? 0 : (std::size_t)std::ceil(std::log2(value));
+}
+
+double Histogram::upperBound(const std::size_t bucket) const {
+    return powerOfTwo ? std::ldexp(1.0, (int)bucket) : bucket;
+}
+
+void Histogram::add(const double value) {
+    std::size_t bucket = bucketOf(value);
+    if (buckets.size() <= bucket) buckets.resize(bucket + 1, 0);
+    buckets[bucket]++;
+    total++;
+    sum += value;
+    maxValue = std::max(maxValue, value);
+}
+
+double Histogram::percentile(const double p) const {
+    std::size_t rank = (std::size_t)std::ceil(p * total), seen = 0;
+    for (std::size_t b = 0; b < buckets.size(); b++) {
+        seen += buckets[b];
+        if (seen >= std::max<std::size_t>(rank, 1)) return upperBound(b);
+    }
+    return 0;
+}
+
+std::string Histogram::toString(const std::string& unit) const {
+    std::ostringstream oss;
+    std::size_t most = buckets.empty() ? 0 : *std::max_element(buckets.begin(), buckets.end());
+    for (std::size_t b = 0; b < buckets.size(); b++) {
+        if (!buckets[b]) continue;
+        std::ostringstream label;
+        label << (powerOfTwo ? "<= " : "") << upperBound(b) << unit;
+        oss << "  " << std::setw(12) << label.str() << " " << std::setw(6) << buckets[b] << " " << std::string((buckets[b] * 40 + most - 1) / most, '#') << "\n";
+    }
+    return oss.str();
+}
+
+// --- BatchServer ---
+
+BatchServer::BatchServer(Model& model, const Options& options, Callback onResponse)
+    : model(model), options(options), onResponse(onResponse), layerTimers(model.hasLayerTimers()), queueUs(true), latencyUs(true), batchSizes(false) {
+    if (this->options.maxBatch == 0) throw std::runtime_error("The maximum batch size must be non-zero");
+    model.setLayerTimers(false);
+    worker = std::thread(&BatchServer::run, this);
+}
+
+BatchServer::~BatchServer() {
+    close();
+    model.setLayerTimers(layerTimers);
+}
+
+void BatchServer::submit(const std::uint64_t id, LayerData image) {
+    if (!model[0].getInputParams().isCompatible(image.getParams())) throw std::runtime_error("Request image does not match the model input");
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (closed) throw std::runtime_error("The server is closed");
+    if (!started) firstArrival = Clock::now();
+    started = true;
+    image.setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+    queue.push_back(Request{id, std::move(image), Clock::now()});
+    waiting.notify_one();
+}
+
+void BatchServer::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = true;
+        waiting.notify_one();
+    }
+    if (worker.joinable()) worker.join();
+}
+
+void BatchServer::run() {
+    std::vector<Request> batch;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            waiting.wait(lock, [this] { return closed || !queue.empty(); });
+            if (queue.empty()) return;
+
+            // Hold the batch open until it is full or its oldest request has waited long enough
+            Clock::time_point deadline = queue.front().arrival + std::chrono::microseconds(options.maxWaitUs);
+            waiting.wait_until(lock, deadline, [this] { return closed || queue.size() >= options.maxBatch; });
+
+            std::size_t size = std::min(queue.size(), options.maxBatch);
+            batch.clear();
+            for (std::size_t i = 0; i < size; i++) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+        }
+        serveBatch(batch);
+    }
+}
+
+void BatchServer::serveBatch(std::vector<Request>& batch) {
+    Clock::time_point start = Clock::now();
+
+    // Images seen before come from the model's result cache, only the others run
+    ResultCache* cache = model.getResultCache();
+    std::vector<std::uint64_t> keys(batch.size());
+    std::vector<std::unique_ptr<LayerData>> hits(batch.size());
+    std::vector<const LayerData*> outputs(batch.size());
+    std::vector<std::vector<Prediction>> predictions(batch.size());
+    std::string error;
+    try {
+        std::vector<const LayerData*> images;
+        std::vector<std::size_t> computed;
+        for (std::size_t b = 0; b < batch.size(); b++) {
+            if (cache) {
+                keys[b] = ResultCache::keyOf(batch[b].image, model.getCacheVersion());
+                hits[b].reset(new LayerData(model.getOutputLayer().getOutputParams()));
+                hits[b]->setAccount(&model.getScratchMemory(), MemoryKind::SCRATCH);
+                hits[b]->allocData();
+                if (cache->lookup(keys[b], *hits[b])) continue;
+                hits[b].reset();
+            }
+            images.push_back(&batch[b].image);
+            computed.push_back(b);
+        }
+
+        if (!images.empty()) {
+            std::vector<const LayerData*> results = model.inferenceBatch(images, options.infType);
+            for (std::size_t i = 0; i < computed.size(); i++) {
+                outputs[computed[i]] = results[i];
+                if (cache) cache->insert(keys[computed[i]], *results[i]);
+            }
+        }
+        for (std::size_t b = 0; b < batch.size(); b++) predictions[b] = topK(hits[b] ? *hits[b] : *outputs[b], options.topK);
+    } catch (const std::exception& e) {
+        error = e.what();
+    } catch (...) {
+        error = "unknown error";
+    }
+
+    Clock::time_point done = Clock::now();
+    for (std::size_t b = 0; b < batch.size(); b++) {
+        Response response;
+        response.id = batch[b].id;
+        response.cached = error.empty() && hits[b] != nullptr;
+        if (error.empty()) response.predictions = std::move(predictions[b]);
+        response.batchSize = batch.size();
+        response.queueUs = std::chrono::duration<double, std::micro>(start - batch[b].arrival).count();
+        response.latencyUs = std::chrono::duration<double, std::micro>(done - batch[b].arrival).count();
+        response.error = error;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queueUs.add(response.queueUs);
+            latencyUs.add(response.latencyUs);
+        }
+        onResponse(response);
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    batchSizes.add(batch.size());
+    lastDone = done;
+}
+
+std::string BatchServer::statsString() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ostringstream oss;
+    oss << std::fixed << std::setprecision(1);
+
+    std::size_t requests = latencyUs.count();
+    double seconds = std::chrono::duration<double>(lastDone - firstArrival).count();
+    oss << requests << " requests in " << batchSizes.count() << " batches (max batch " << options.maxBatch << ", max wait "
+        << options.maxWaitUs << "us)";
+    if (requests && seconds > 0) oss << ", " << requests / seconds << " images/s";
+    oss << "\n";
+
+    oss << "Queueing latency: mean " << queueUs.mean() << "us, p50 <= " << queueUs.percentile(0.5) << "us, p99 <= " << queueUs.percentile(0.99)
+        << "us, max " << queueUs.max() << "us\n" << queueUs.toString("us");
+    oss << "End to end latency: mean " << latencyUs.mean() << "us, p50 <= " << latencyUs.percentile(0.5) << "us, p99 <= "
+        << latencyUs.percentile(0.99) << "us, max " << latencyUs.max() << "us\n" << latencyUs.toString("us");
+    oss << "Batch size: mean " << batchSizes.mean() << "\n" << batchSizes.toString("");
+    if (model.getResultCache()) oss << "Result cache: " << model.getResultCache()->stats().toString() << "\n";
+    return oss.str();
+}
+
+// --- stdin/stdout framing ---
+
+int serve(Model& model, const BatchServer::Options& options, std::istream& in, std::ostream& out, std::ostream& log) {
+    const LayerParams& inParams = model[0].getInputParams();
+    std::mutex outMutex;
+
+    BatchServer server(model, options, [&](const BatchServer::Response& response) {
+        std::ostringstream line;
+        line << response.id;
+        if (!response.error.empty()) {
+            line << " error " << response.error << "\n";
+        } else {
+            for (const Prediction& p : response.predictions) line << " " << p.index << ":" << p.score;
+            line << " queue_us=" << (long)response.queueUs << " batch=" << response.batchSize;
+            if (model.getResultCache()) line << " cached=" << response.cached;
+            line << "\n";
+        }
+
+        std::lock_guard<std::mutex> lock(outMutex);
+        out << line.str() << std::flush;
+    });
+
+    int status = 0;
+    std::string header;
+    while (std::getline(in, header)) {
+        if (header.empty()) continue;
+
+        std::istringstream fields(header);
+        std::uint64_t id;
+        std::size_t bytes;
+        if (!(fields >> id >> bytes)) {
+            log << "Malformed request header: '" << header << "'\n";
+            status = 1;
+            break;
+        }
+
+        LayerData image(inParams);
+        image.allocData();
+        if (bytes != inParams.byte_size()) {
+            in.ignore(bytes);
+            std::lock_guard<std::mutex> lock(outMutex);
+            out << id << " error expected " << inParams.byte_size() << " bytes, got " << bytes << "\n" << std::flush;
+            continue;
+        }
+        if (!in.read((char*)image.raw(), bytes)) {
+            log << "Request " << id << " ended after " << in.gcount() << " of " << bytes << " bytes\n";
+            status = 1;
+            break;
+        }
+        server.submit(id, std::move(image));
+    }
+
+    server.close();
+    log << server.statsString();
+    return status;
+}
+
+}  // namespace ML
+#endif
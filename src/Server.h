@@ -0,0 +1,127 @@
+#pragma once
+
+#ifndef ZEDBOARD
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Model.h"
+
+namespace ML {
+
+// Counts of non-negative values, either one bucket per value or power of two buckets ([0, 1], (1, 2], (2, 4], ...)
+class Histogram {
+   public:
+    explicit Histogram(const bool powerOfTwo) : powerOfTwo(powerOfTwo) {}
+
+    void add(const double value);
+
+    std::size_t count() const { return total; }
+    double mean() const { return total ? sum / total : 0; }
+    double max() const { return maxValue; }
+
+    // Upper bound of the bucket holding the p-th (0-1) value
+    double percentile(const double p) const;
+
+    // One line per non-empty bucket with its count and a bar
+    std::string toString(const std::string& unit) const;
+
+   private:
+    std::size_t bucketOf(const double value) const;
+    double upperBound(const std::size_t bucket) const;
+
+    bool powerOfTwo;
+    std::vector<std::size_t> buckets;
+    std::size_t total = 0;
+    double sum = 0, maxValue = 0;
+};
+
+// In-process inference server with dynamic batching. Requests are queued as they arrive, and a worker thread runs
+// them as a batch (Model::inferenceBatch) once `maxBatch` requests are waiting or the oldest one has waited
+// `maxWaitUs`. A larger batch or wait buys throughput with queueing latency, maxBatch = 1 serves every request alone.
+//
+// With a result cache on the model (Model::setResultCache), requests whose image was seen before are answered from
+// the cache and only the others run in the batch.
+class BatchServer {
+   public:
+    struct Options {
+        std::size_t maxBatch = 8;
+        std::size_t maxWaitUs = 2000;
+        std::size_t topK = 5;
+        Layer::InfType infType = Layer::InfType::SIMD;
+    };
+
+    struct Response {
+        std::uint64_t id;
+        std::vector<Prediction> predictions;
+        std::size_t batchSize;
+        // Served from the model's result cache
+        bool cached;
+        // Time spent waiting for a batch, and from submit to the result
+        double queueUs, latencyUs;
+        // Set when the batch failed, the predictions are empty then
+        std::string error;
+    };
+
+    // Called on the worker thread for every request, in submit order. A batch that throws answers each of its requests
+    // with the error instead of stopping the worker
+    using Callback = std::function<void(const Response&)>;
+
+    BatchServer(Model& model, const Options& options, Callback onResponse);
+    ~BatchServer();
+
+    BatchServer(const BatchServer&) = delete;
+    BatchServer& operator=(const BatchServer&) = delete;
+
+    // Queue an image for inference, the image must match the model input
+    void submit(const std::uint64_t id, LayerData image);
+
+    // Serve what is queued, then stop the worker. No submit afterwards
+    void close();
+
+    // Queueing latency, end to end latency and batch size histograms, and the throughput
+    std::string statsString() const;
+
+   private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Request {
+        std::uint64_t id;
+        LayerData image;
+        Clock::time_point arrival;
+    };
+
+    void run();
+    void serveBatch(std::vector<Request>& batch);
+
+    Model& model;
+    Options options;
+    Callback onResponse;
+    bool layerTimers;
+
+    mutable std::mutex mutex;
+    std::condition_variable waiting;
+    std::deque<Request> queue;
+    bool closed = false, started = false;
+
+    Histogram queueUs, latencyUs, batchSizes;
+    Clock::time_point firstArrival, lastDone;
+    std::thread worker;
+};
+
+// Serve the request stream on `in`, writing one response line per request to `out`, until end of input.
+//   request:  "<id> <bytes>\n" then <bytes> of raw fp32 NHWC pixels (64x64x3 for the toy model: 49152 bytes)
+//   response: "<id> <class>:<probability> ... queue_us=<us> batch=<size>\n" with the top-k classes, best first,
+//             plus " cached=<0|1>" when the model has a result cache, or "<id> error <message>\n"
+// The statistics are written to `log` at the end. Returns non-zero on a malformed stream
+int serve(Model& model, const BatchServer::Options& options, std::istream& in, std::ostream& out, std::ostream& log);
+
+}  // namespace ML
+#endif
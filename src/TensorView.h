@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Types.h"
+
+namespace ML {
+
+// Non-owning typed view of a tensor with a shape and per-dimension strides (in elements)
+// Views of LayerData are contiguous and row-major, strides allow describing slices and transposes
+template <typename T> class TensorView {
+   public:
+    TensorView() : ptr(nullptr) {}
+
+    // Contiguous row-major view
+    TensorView(T* ptr, const dimVec& dims) : ptr(ptr), dims(dims), strides(dims.size()) {
+        std::size_t stride = 1;
+        for (std::size_t i = dims.size(); i-- > 0;) {
+            strides[i] = stride;
+            stride *= dims[i];
+        }
+    }
+
+    TensorView(T* ptr, const dimVec& dims, const dimVec& strides) : ptr(ptr), dims(dims), strides(strides) {}
+
+    // Views of non-const data convert to views of const data
+    template <typename U> TensorView(const TensorView<U>& other) : ptr(other.data()), dims(other.shape()), strides(other.getStrides()) {}
+
+    T* data() const { return ptr; }
+    const dimVec& shape() const { return dims; }
+    const dimVec& getStrides() const { return strides; }
+    std::size_t rank() const { return dims.size(); }
+    std::size_t dim(const std::size_t i) const { return dims[i]; }
+    std::size_t stride(const std::size_t i) const { return strides[i]; }
+
+    std::size_t size() const {
+        std::size_t count = 1;
+        for (std::size_t d : dims) count *= d;
+        return count;
+    }
+
+    bool isContiguous() const {
+        std::size_t expected = 1;
+        for (std::size_t i = dims.size(); i-- > 0;) {
+            if (dims[i] != 1 && strides[i] != expected) return false;
+            expected *= dims[i];
+        }
+        return true;
+    }
+
+    // Flat element access (contiguous views)
+    T& operator[](const std::size_t flat_index) const { return ptr[flat_index]; }
+
+    // Multi-dimensional element access, one index per dimension
+    template <typename... Idx> T& operator()(Idx... idx) const { return ptr[offset(0, idx...)]; }
+
+    // View of index `i` along the first dimension, with one dimension less
+    TensorView<T> slice(const std::size_t i) const {
+        if (dims.size() == 1) return TensorView<T>(ptr + i * strides[0], {1}, {1});
+        return TensorView<T>(ptr + i * strides[0], dimVec(dims.begin() + 1, dims.end()), dimVec(strides.begin() + 1, strides.end()));
+    }
+
+   private:
+    std::size_t offset(const std::size_t) const { return 0; }
+    template <typename... Rest> std::size_t offset(const std::size_t d, const std::size_t i, Rest... rest) const {
+        return i * strides[d] + offset(d + 1, rest...);
+    }
+
+    T* ptr;
+    dimVec dims;
+    dimVec strides;
+};
+
+}  // namespace ML
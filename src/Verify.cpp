@@ -0,0 +1,449 @@
+#include "Verify.h"
+
+#ifndef ZEDBOARD
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include "kernels/Kernels.h"
+#include "layers/Convolutional.h"
+#include "layers/Dense.h"
+#include "layers/MaxPooling.h"
+#include "layers/SoftMax.h"
+
+namespace ML {
+
+namespace {
+
+enum class Kind { CONV, DENSE, MAXPOOL, SOFTMAX };
+
+const char* kindName(const Kind kind) {
+    switch (kind) {
+    case Kind::CONV: return "conv";
+    case Kind::DENSE: return "dense";
+    case Kind::MAXPOOL: return "maxpool";
+    case Kind::SOFTMAX: return "softmax";
+    }
+    return "?";
+}
+
+// A random layer: named shape knobs, each with the smallest value it can shrink to, and the seed of its data
+struct Knob {
+    std::string name;
+    std::size_t value, min;
+};
+
+struct Case {
+    Kind kind;
+    std::vector<Knob> knobs;
+    std::uint32_t seed;
+
+    std::size_t operator[](const std::string& name) const {
+        for (const Knob& k : knobs) {
+            if (k.name == name) return k.value;
+        }
+        throw std::runtime_error("Unknown verify knob " + name);
+    }
+
+    std::string toString() const {
+        std::ostringstream oss;
+        oss << kindName(kind);
+        for (const Knob& k : knobs) oss << " " << k.name << "=" << k.value;
+        oss << " seed=" << seed;
+        return oss.str();
+    }
+};
+
+dimVec convOutput(const Case& c) {
+    std::size_t stride = c["stride"], dil = c["dilation"];
+    if (c["same"]) return {(c["h"] + stride - 1) / stride, (c["w"] + stride - 1) / stride, c["filters"]};
+    return {windowOutputSize(c["h"], 2 * c["pad"], (c["kh"] - 1) * dil + 1, stride), windowOutputSize(c["w"], 2 * c["pad"], (c["kw"] - 1) * dil + 1, stride),
+            c["filters"]};
+}
+
+dimVec poolOutput(const Case& c) {
+    return {PoolParams::outputSize(c["h"], c["kh"], c["stride"], c["pad"]), PoolParams::outputSize(c["w"], c["kw"], c["stride"], c["pad"]), c["c"]};
+}
+
+bool isValid(const Case& c) {
+    for (const Knob& k : c.knobs) {
+        if (k.value < k.min) return false;
+    }
+    switch (c.kind) {
+    case Kind::CONV: {
+        if (c["c"] % c["groups"] != 0 || c["filters"] % c["groups"] != 0) return false;
+        dimVec out = convOutput(c);
+        return out[0] > 0 && out[1] > 0;
+    }
+    case Kind::MAXPOOL: {
+        if (c["pad"] >= c["kh"] || c["pad"] >= c["kw"]) return false;
+        dimVec out = poolOutput(c);
+        return out[0] > 0 && out[1] > 0;
+    }
+    default: return true;
+    }
+}
+
+class Random {
+   public:
+    explicit Random(const std::uint32_t seed) : gen(seed) {}
+    std::size_t between(const std::size_t lo, const std::size_t hi) { return std::uniform_int_distribution<std::size_t>(lo, hi)(gen); }
+    bool chance(const double p) { return std::uniform_real_distribution<double>(0, 1)(gen) < p; }
+    fp32 value() { return std::uniform_real_distribution<fp32>(-1, 1)(gen); }
+    std::uint32_t seed() { return gen(); }
+
+   private:
+    std::mt19937 gen;
+};
+
+// Channel counts hit the vector widths (and the blocked layouts) often, and odd counts the rest of the time
+std::size_t randomChannels(Random& rng) {
+    return rng.chance(0.35) ? 8 * rng.between(1, 4) : rng.between(1, 40);
+}
+
+Case randomCase(Random& rng) {
+    Case c;
+    c.kind = (Kind)rng.between(0, 3);
+    c.seed = rng.seed();
+
+    do {
+        switch (c.kind) {
+        case Kind::CONV: {
+            std::size_t channels = randomChannels(rng), filters = randomChannels(rng), groups = 1;
+            if (rng.chance(0.15)) {
+                groups = channels;
+                filters = channels * rng.between(1, 2);
+            } else if (rng.chance(0.15)) {
+                groups = rng.between(1, 4);
+                channels = groups * rng.between(1, 8);
+                filters = groups * rng.between(1, 8);
+            }
+            bool same = rng.chance(0.25);
+            c.knobs = {{"h", rng.between(1, 24), 1},
+                       {"w", rng.between(1, 24), 1},
+                       {"c", channels, 1},
+                       {"filters", filters, 1},
+                       {"kh", rng.between(1, 5), 1},
+                       {"kw", rng.between(1, 5), 1},
+                       {"stride", rng.chance(0.6) ? 1 : rng.between(2, 3), 1},
+                       {"dilation", rng.chance(0.8) ? 1u : 2u, 1},
+                       {"pad", same ? 0 : rng.between(0, 2), 0},
+                       {"same", same, 0},
+                       {"groups", groups, 1}};
+            break;
+        }
+        case Kind::DENSE:
+            c.knobs = {{"in", rng.between(1, 300), 1}, {"out", rng.between(1, 300), 1}, {"relu", rng.between(0, 1), 0}};
+            break;
+        case Kind::MAXPOOL: {
+            std::size_t k = rng.between(1, 4);
+            c.knobs = {{"h", rng.between(1, 24), 1},
+                       {"w", rng.between(1, 24), 1},
+                       {"c", randomChannels(rng), 1},
+                       {"kh", k, 1},
+                       {"kw", rng.chance(0.7) ? k : rng.between(1, 4), 1},
+                       {"stride", rng.between(1, 4), 1},
+                       {"pad", rng.chance(0.7) ? 0u : 1u, 0}};
+            break;
+        }
+        case Kind::SOFTMAX:
+            c.knobs = {{"n", rng.between(1, 500), 1}, {"log", rng.between(0, 1), 0}};
+            break;
+        }
+    } while (!isValid(c));
+    return c;
+}
+
+// Backend under test: an inference type, and for SIMD the kernel level and the activation layout. Region variants
+// check delta inference (Layer::outputRegion and computeRegion) at a kernel level instead
+struct Variant {
+    std::string name;
+    Layer::InfType infType;
+    Kernels::Isa isa;
+    Layout layout;
+    bool regions;
+};
+
+// LayerData::loadData logs every file it opens, which would bury the report
+class QuietStdout {
+   public:
+    QuietStdout() : saved(std::cout.rdbuf(nullptr)) {}
+    ~QuietStdout() { std::cout.rdbuf(saved); }
+
+   private:
+    std::streambuf* saved;
+};
+
+// A case turned into a layer with random weights (through scratch files) and a random input
+class Instance {
+   public:
+    Instance(const Case& c, const std::string& scratch) : input(LayerParams(sizeof(fp32), {1})), seed(c.seed) {
+        Random rng(c.seed);
+        Path weights(scratch + "_weights.bin"), bias(scratch + "_bias.bin");
+
+        switch (c.kind) {
+        case Kind::CONV: {
+            dimVec in = {c["h"], c["w"], c["c"]}, w = {c["kh"], c["kw"], c["c"] / c["groups"], c["filters"]};
+            writeRandom(weights, w, rng);
+            writeRandom(bias, {c["filters"]}, rng);
+            ConvParams p = c["same"] ? ConvParams::same(c["stride"], c["dilation"], c["groups"]) : ConvParams(c["stride"], c["pad"], c["dilation"], c["groups"]);
+            layer.reset(new ConvolutionalLayer({sizeof(fp32), in}, {sizeof(fp32), convOutput(c)}, {sizeof(fp32), w, weights},
+                                               {sizeof(fp32), {c["filters"]}, bias}, p));
+            break;
+        }
+        case Kind::DENSE:
+            writeRandom(weights, {c["in"], c["out"]}, rng);
+            writeRandom(bias, {c["out"]}, rng);
+            layer.reset(new DenseLayer({sizeof(fp32), {c["in"]}}, {sizeof(fp32), {c["out"]}}, {sizeof(fp32), {c["in"], c["out"]}, weights},
+                                       {sizeof(fp32), {c["out"]}, bias}, c["relu"] != 0));
+            break;
+        case Kind::MAXPOOL:
+            layer.reset(new MaxPoolingLayer({sizeof(fp32), {c["h"], c["w"], c["c"]}}, {sizeof(fp32), poolOutput(c)},
+                                            PoolParams(c["kh"], c["kw"], c["stride"], c["stride"], c["pad"], c["pad"])));
+            break;
+        case Kind::SOFTMAX:
+            layer.reset(new SoftMaxLayer({sizeof(fp32), {c["n"]}}, {sizeof(fp32), {c["n"]}}, c["log"] != 0));
+            break;
+        }
+
+        {
+            QuietStdout quiet;
+            layer->allocLayer();
+        }
+        input = LayerData(layer->getInputParams());
+        input.allocData();
+        // Softmax inputs span a wider range so the exponentials cover several orders of magnitude
+        fp32* values = input.ptr<fp32>();
+        fp32 range = c.kind == Kind::SOFTMAX ? 16 : 4;
+        for (std::size_t i = 0; i < input.getParams().flat_count(); i++) values[i] = rng.value() * range;
+
+        layer->computeNaive(input);
+        reference.reset(new LayerData(layer->getOutputData()));
+    }
+
+    // Blocked layouts are only used for ungrouped convolutions and pooling whose channels fill whole blocks
+    bool supports(const Variant& v) const {
+        if (v.regions) return layer->supportsRegions();
+        if (v.layout == Layout::NHWC) return true;
+        if (layer->getLType() == Layer::LayerType::CONVOLUTIONAL && static_cast<const ConvolutionalLayer&>(*layer).getConvParams().groups != 1) return false;
+        if (layer->getLType() != Layer::LayerType::CONVOLUTIONAL && layer->getLType() != Layer::LayerType::MAX_POOLING) return false;
+        return layoutFits(v.layout, layer->getInputParams().dims) && layoutFits(v.layout, layer->getOutputParams().dims);
+    }
+
+    enum class Outcome { PASS, FAIL, NOT_IMPLEMENTED };
+
+    Outcome run(const Variant& v, const VerifyOptions& options, std::string& detail) {
+        if (v.infType == Layer::InfType::SIMD) Kernels::select(v.isa);
+        if (v.regions) return runRegion(options, detail);
+        layer->setLayout(v.layout);
+
+        // Reorder into the variant's layout, and fill the output with a marker to spot backends that never write it
+        const LayerData* in = &input;
+        LayerData blockedIn(input.getParams());
+        const dimVec& inDims = input.getParams().dims;
+        if (v.layout != Layout::NHWC) {
+            blockedIn.allocData();
+            reorder(input.ptr<fp32>(), Layout::NHWC, blockedIn.ptr<fp32>(), v.layout, inDims[0], inDims[1], inDims[2]);
+            in = &blockedIn;
+        }
+
+        LayerData& out = layer->getOutputData();
+        const std::uint32_t marker = 0x7FC0DEAD;
+        std::uint32_t* bits = (std::uint32_t*)out.raw();
+        std::size_t count = out.getParams().flat_count();
+        std::fill(bits, bits + count, marker);
+
+        switch (v.infType) {
+        case Layer::InfType::NAIVE: layer->computeNaive(*in); break;
+        case Layer::InfType::THREADED: layer->computeThreaded(*in); break;
+        case Layer::InfType::TILED: layer->computeTiled(*in); break;
+        case Layer::InfType::SIMD: layer->computeSIMD(*in); break;
+        }
+        layer->setLayout(Layout::NHWC);
+        if (std::all_of(bits, bits + count, [&](std::uint32_t b) { return b == marker; })) return Outcome::NOT_IMPLEMENTED;
+
+        LayerData result(out);
+        if (v.layout != Layout::NHWC) {
+            const dimVec& d = out.getParams().dims;
+            reorder(out.ptr<fp32>(), v.layout, result.ptr<fp32>(), Layout::NHWC, d[0], d[1], d[2]);
+        }
+        return check(result, *reference, options, detail) ? Outcome::PASS : Outcome::FAIL;
+    }
+
+    // Change a random input rectangle, recompute only the outputs it reaches on top of the old output, and compare
+    // with a full naive run on the changed input. A too small output region leaves stale values behind
+    Outcome runRegion(const VerifyOptions& options, std::string& detail) {
+        Random rng(seed + 1);
+        const dimVec& d = input.getParams().dims;
+        Region changed;
+        changed.h0 = rng.between(0, d[0] - 1);
+        changed.h1 = rng.between(changed.h0 + 1, d[0]);
+        changed.w0 = rng.between(0, d[1] - 1);
+        changed.w1 = rng.between(changed.w0 + 1, d[1]);
+
+        LayerData frame(input);
+        for (std::size_t h = changed.h0; h < changed.h1; h++) {
+            for (std::size_t w = changed.w0; w < changed.w1; w++) {
+                for (std::size_t ch = 0; ch < d[2]; ch++) frame.ptr<fp32>()[(h * d[1] + w) * d[2] + ch] = rng.value() * 4;
+            }
+        }
+        layer->computeNaive(frame);
+        LayerData expected(layer->getOutputData());
+
+        LayerData& out = layer->getOutputData();
+        std::memcpy(out.raw(), reference->raw(), out.getParams().byte_size());
+        layer->computeRegion(frame, layer->outputRegion(changed));
+        if (!check(out, expected, options, detail)) {
+            detail += ", input rows [" + std::to_string(changed.h0) + ", " + std::to_string(changed.h1) + ") cols [" + std::to_string(changed.w0) + ", " +
+                      std::to_string(changed.w1) + ")";
+            return Outcome::FAIL;
+        }
+        return Outcome::PASS;
+    }
+
+    Layer::LayerType type() const { return layer->getLType(); }
+
+   private:
+    static void writeRandom(const std::string& path, const dimVec& dims, Random& rng) {
+        std::vector<fp32> values(LayerParams(sizeof(fp32), dims).flat_count());
+        for (fp32& v : values) v = rng.value();
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write((const char*)values.data(), values.size() * sizeof(fp32));
+        if (!file) throw std::runtime_error("Cannot write verify scratch file " + path);
+    }
+
+    bool check(const LayerData& result, const LayerData& expected, const VerifyOptions& options, std::string& detail) const {
+        const fp32* a = result.ptr<fp32>();
+        const fp32* b = expected.ptr<fp32>();
+        CompareResult stats = result.compareResult(expected);
+        std::size_t worst = stats.worstIndex;
+
+        fp32 scale = 0;
+        for (std::size_t i = 0; i < expected.getParams().flat_count(); i++) scale = std::max(scale, std::fabs(b[i]));
+
+        // An all zero reference (everything clipped by the ReLU) has no direction to compare
+        fp32 error = stats.maxAbsDiff / std::max(scale, 1e-6f);
+        fp32 similarity = scale == 0 ? (stats.maxAbsDiff == 0 ? 1.0f : 0.0f) : stats.cosine;
+
+        std::ostringstream oss;
+        oss << "similarity " << similarity << ", max error " << error << " at element " << worst << " (" << a[worst] << " vs " << b[worst] << ")";
+        detail = oss.str();
+        return similarity >= options.minSimilarity && error <= options.maxError;
+    }
+
+    std::unique_ptr<Layer> layer;
+    LayerData input;
+    std::unique_ptr<LayerData> reference;
+    std::uint32_t seed;
+};
+
+// Smallest shape (knob by knob: minimum, half, minus one) on which the variant still fails
+Case shrink(Case c, const Variant& v, const VerifyOptions& options, const std::string& scratch, std::string& detail) {
+    for (bool progress = true; progress;) {
+        progress = false;
+        for (std::size_t k = 0; k < c.knobs.size() && !progress; k++) {
+            std::size_t value = c.knobs[k].value, min = c.knobs[k].min;
+            for (std::size_t candidate : {min, value / 2, value - 1}) {
+                if (candidate >= value || candidate < min) continue;
+                Case smaller = c;
+                smaller.knobs[k].value = candidate;
+                if (!isValid(smaller)) continue;
+
+                Instance instance(smaller, scratch);
+                std::string smallerDetail;
+                if (instance.supports(v) && instance.run(v, options, smallerDetail) == Instance::Outcome::FAIL) {
+                    c = smaller;
+                    detail = smallerDetail;
+                    progress = true;
+                    break;
+                }
+            }
+        }
+    }
+    return c;
+}
+
+}  // namespace
+
+VerifyReport verifyKernels(const VerifyOptions& options) {
+    const Kernels::Isa defaultIsa = Kernels::active().isa;
+    const Kernels::Isa levels[] = {Kernels::Isa::SCALAR, Kernels::Isa::GENERIC, Kernels::Isa::SSE42, Kernels::Isa::AVX2, Kernels::Isa::AVX512};
+
+    std::vector<Variant> variants;
+    for (Layer::InfType infType : options.backends) {
+        if (infType == Layer::InfType::THREADED) variants.push_back({"threaded", infType, defaultIsa, Layout::NHWC, false});
+        if (infType == Layer::InfType::TILED) variants.push_back({"tiled", infType, defaultIsa, Layout::NHWC, false});
+        if (infType != Layer::InfType::SIMD) continue;
+        for (Kernels::Isa isa : levels) {
+            if (!Kernels::isAvailable(isa)) continue;
+            for (Layout layout : {Layout::NHWC, Layout::NCHW8c, Layout::NCHW16c}) {
+                variants.push_back({std::string("simd/") + Kernels::isaName(isa) + "/" + layoutName(layout), infType, isa, layout, false});
+            }
+            variants.push_back({std::string("region/") + Kernels::isaName(isa), infType, isa, Layout::NHWC, true});
+        }
+    }
+
+    std::string scratch = options.scratchDir + "/ml_verify_" + std::to_string(std::random_device()());
+    Random rng(options.seed);
+    VerifyReport report;
+    std::set<std::string> skipped;
+
+    try {
+        for (std::size_t i = 0; i < options.cases && report.failures.size() < options.maxFailures; i++) {
+            Case c = randomCase(rng);
+            Instance instance(c, scratch);
+            report.cases++;
+
+            for (const Variant& v : variants) {
+                // One reproducer per backend and layer type is enough
+                std::string combo = v.name + " " + kindName(c.kind);
+                if (skipped.count(combo) || !instance.supports(v)) continue;
+
+                std::string detail;
+                Instance::Outcome outcome = instance.run(v, options, detail);
+                report.checks++;
+                if (outcome == Instance::Outcome::NOT_IMPLEMENTED) {
+                    report.notImplemented.push_back(combo);
+                    skipped.insert(combo);
+                } else if (outcome == Instance::Outcome::FAIL) {
+                    Case minimal = shrink(c, v, options, scratch, detail);
+                    report.failures.push_back(v.name + ": " + minimal.toString() + ": " + detail);
+                    skipped.insert(combo);
+                    if (report.failures.size() >= options.maxFailures) break;
+                }
+            }
+        }
+    } catch (...) {
+        Kernels::select(defaultIsa);
+        std::remove((scratch + "_weights.bin").c_str());
+        std::remove((scratch + "_bias.bin").c_str());
+        throw;
+    }
+
+    Kernels::select(defaultIsa);
+    std::remove((scratch + "_weights.bin").c_str());
+    std::remove((scratch + "_bias.bin").c_str());
+    return report;
+}
+
+std::string VerifyReport::summary() const {
+    std::ostringstream oss;
+    oss << cases << " random cases, " << checks << " backend checks, " << failures.size() << " failures\n";
+    if (!notImplemented.empty()) {
+        oss << "Not implemented (output left untouched):";
+        for (const std::string& combo : notImplemented) oss << " [" << combo << "]";
+        oss << "\n";
+    }
+    for (const std::string& failure : failures) oss << "FAIL " << failure << "\n";
+    return oss.str();
+}
+
+}  // namespace ML
+#endif
@@ -0,0 +1,47 @@
+#pragma once
+
+// Scratch weight files and the host kernel levels, desktop only
+#ifndef ZEDBOARD
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "layers/Layer.h"
+
+namespace ML {
+
+// Differential testing of the optimized backends against computeNaive on random layer shapes and data. Every case
+// is a random convolution (odd channels, groups, depthwise, stride, dilation, padding), dense, max pooling or softmax
+// layer. It runs on the tiled backend, and on the SIMD backend at every kernel level the CPU has, in NHWC and in the
+// blocked layouts where the channels fit. Convolution and pooling cases also check delta inference at every kernel level:
+// a random input rectangle changes and only its output region is recomputed. A failing case is shrunk to the smallest
+// shape that still fails.
+struct VerifyOptions {
+    std::size_t cases = 200;
+    std::uint32_t seed = 1;
+    std::vector<Layer::InfType> backends = {Layer::InfType::THREADED, Layer::InfType::TILED, Layer::InfType::SIMD};
+    // Stop after this many (shrunk) failures
+    std::size_t maxFailures = 5;
+    // Random weights are written here, the layers only load weights from files
+    std::string scratchDir = "/tmp";
+
+    // A result passes with a cosine similarity (LayerData::compare) of at least minSimilarity and no element off
+    // by more than maxError relative to the largest reference magnitude, which catches a few wrong tail elements
+    fp32 minSimilarity = 0.99999f;
+    fp32 maxError = 1e-4f;
+};
+
+struct VerifyReport {
+    std::size_t cases = 0, checks = 0;
+    // Backend/layer combinations that left the output untouched (not implemented yet), counted once each
+    std::vector<std::string> notImplemented;
+    // Minimal reproducers
+    std::vector<std::string> failures;
+
+    std::string summary() const;
+};
+
+VerifyReport verifyKernels(const VerifyOptions& options);
+
+}  // namespace ML
+#endif
@@ -0,0 +1,82 @@
+#include "Kernels.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <string>
+
+#include "../CpuFeatures.h"
+
+namespace ML {
+namespace Kernels {
+
+namespace {
+
+const KernelTable* tableOf(const Isa isa) {
+    switch (isa) {
+    case Isa::SCALAR: return scalarTable();
+    case Isa::GENERIC: return genericTable();
+    case Isa::SSE42: return sse42Table();
+    case Isa::AVX2: return avx2Table();
+    case Isa::AVX512: return avx512Table();
+    }
+    return nullptr;
+}
+
+bool cpuSupports(const Isa isa) {
+    const CpuFeatures& f = cpuFeatures();
+    switch (isa) {
+    case Isa::SCALAR:
+    case Isa::GENERIC: return true;
+    case Isa::SSE42: return f.sse42;
+    case Isa::AVX2: return f.avx2 && f.fma;
+    case Isa::AVX512: return f.avx512f && f.avx512dq && f.avx2 && f.fma;
+    }
+    return false;
+}
+
+const KernelTable* best() {
+    const Isa order[] = {Isa::AVX512, Isa::AVX2, Isa::SSE42, Isa::GENERIC};
+    for (Isa isa : order) {
+        if (isAvailable(isa)) return tableOf(isa);
+    }
+    throw std::runtime_error("No kernel table available");
+}
+
+// Read by every thread running a kernel, so selection is atomic. The host's best table is picked once, thread safe,
+// by the function-local static
+std::atomic<const KernelTable*> selected(nullptr);
+
+const KernelTable* defaultTable() {
+    static const KernelTable* table = best();
+    return table;
+}
+
+}  // namespace
+
+bool isAvailable(const Isa isa) { return tableOf(isa) != nullptr && cpuSupports(isa); }
+
+const KernelTable& forIsa(const Isa isa) {
+    if (!isAvailable(isa)) throw std::runtime_error(std::string("Kernel ISA not available: ") + isaName(isa));
+    return *tableOf(isa);
+}
+
+const KernelTable& active() {
+    const KernelTable* table = selected.load(std::memory_order_acquire);
+    return table ? *table : *defaultTable();
+}
+
+void select(const Isa isa) { selected.store(&forIsa(isa), std::memory_order_release); }
+
+const char* isaName(const Isa isa) {
+    switch (isa) {
+    case Isa::SCALAR: return "scalar";
+    case Isa::GENERIC: return "generic";
+    case Isa::SSE42: return "sse4.2";
+    case Isa::AVX2: return "avx2";
+    case Isa::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+}  // namespace Kernels
+}  // namespace ML
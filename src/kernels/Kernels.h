@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+
+#include "../Types.h"
+
+namespace ML {
+
+// Resolved NHWC convolution geometry
+struct ConvShape {
+    std::size_t in_h, in_w, in_c;
+    std::size_t out_h, out_w, out_c;
+    std::size_t filt_h, filt_w;
+    std::size_t stride_h, stride_w;
+    std::size_t pad_top, pad_left;
+    std::size_t dil_h, dil_w;
+    std::size_t groups, group_in, group_out;
+};
+
+// Resolved NHWC max pooling geometry
+struct PoolShape {
+    std::size_t in_h, in_w, channels;
+    std::size_t out_h, out_w;
+    std::size_t kernel_h, kernel_w;
+    std::size_t stride_h, stride_w;
+    std::size_t pad_h, pad_w;
+};
+
+// Running sums of a comparison of two arrays (LayerData::compareResult), merged chunk by chunk
+struct CompareSums {
+    double dot, a_sq, b_sq, diff_sq;
+    // Largest |a - b| (NaN once any difference is NaN) and the first element reaching it
+    fp32 max_diff;
+    std::size_t worst;
+};
+
+namespace Kernels {
+
+// Instruction set levels with their own kernel build, in increasing order. SCALAR is the reference
+// backend of the vector abstraction, never picked automatically
+enum class Isa { SCALAR, GENERIC, SSE42, AVX2, AVX512 };
+
+// SIMD kernels of one instruction set level. The kernels are written once against vfloat<N> (Vec.h) and every
+// level is compiled in its own translation unit (src/kernels/<isa>/) with matching compiler flags, the dispatcher
+// picks one at runtime
+struct KernelTable {
+    Isa isa;
+    const char* name;
+
+    // out = in[in_c] * weights[in_c][out_c] (+ bias) (then ReLU), bias may be nullptr
+    void (*dense)(const fp32* in, const fp32* weights, const fp32* bias, fp32* out, std::size_t in_c, std::size_t out_c, bool relu);
+
+    // Convolution with bias and ReLU, one group after the other, weights are [filt_h][filt_w][group_in][out_c]
+    void (*conv)(const ConvShape& shape, const fp32* in, const fp32* weights, const fp32* bias, fp32* out);
+
+    // Channel block of the blocked layout (NCHW<block>c) these kernels are fastest in
+    std::size_t block;
+
+    // Ungrouped convolution with bias and ReLU in a blocked layout, block is 8 or 16 and divides both channel counts.
+    // in and out are [channels / block][height][width][block], weights [out_c / block][filt_h][filt_w][in_c][block]
+    void (*convBlocked)(const ConvShape& shape, std::size_t block, const fp32* in, const fp32* weights, const fp32* bias, fp32* out);
+
+    // Depthwise convolution (one output channel per input channel) with bias and ReLU, weights are [filt_h][filt_w][1][channels]
+    void (*depthwise)(const ConvShape& shape, const fp32* in, const fp32* weights, const fp32* bias, fp32* out);
+
+    void (*maxPool)(const PoolShape& shape, const fp32* in, fp32* out);
+
+    // Max of the logits and sum of exp(x - max) in a single pass
+    void (*softmaxStats)(const fp32* in, std::size_t count, fp32& max, fp32& sum);
+
+    // out = exp(in - shift) * scale, or in - shift for log-softmax
+    void (*softmaxOut)(const fp32* in, fp32* out, std::size_t count, fp32 shift, fp32 scale, bool log);
+
+    // Adds a[i] * b[i], a[i]^2, b[i]^2 and (a[i] - b[i])^2 over [0, count) to sums and updates the max difference,
+    // element indices are offset by `first`
+    void (*compare)(const fp32* a, const fp32* b, std::size_t count, std::size_t first, CompareSums& sums);
+};
+
+// Best table for the host CPU, selected once on first use
+const KernelTable& active();
+
+// Force a level (e.g. to benchmark each backend), throws if the CPU or the build does not support it. Safe while other
+// threads run kernels, calls of active() after it see the new level
+void select(const Isa isa);
+
+// Whether the level was built into this binary and runs on this CPU
+bool isAvailable(const Isa isa);
+
+// Table of a level, throws if not available
+const KernelTable& forIsa(const Isa isa);
+
+const char* isaName(const Isa isa);
+
+// Per level tables, nullptr when the translation unit was built without the level's compiler flags
+const KernelTable* scalarTable();
+const KernelTable* genericTable();
+const KernelTable* sse42Table();
+const KernelTable* avx2Table();
+const KernelTable* avx512Table();
+
+}  // namespace Kernels
+}  // namespace ML
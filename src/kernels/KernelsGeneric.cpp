@@ -0,0 +1,20 @@
+// Baseline kernels, built with the default flags, always available
+#include "Kernels.h"
+#include "KernelsImpl.h"
+
+namespace ML {
+namespace Kernels {
+
+const KernelTable* genericTable() {
+    static const KernelTable table = makeTable<vfloat<4>>(Isa::GENERIC, "generic");
+    return &table;
+}
+
+// Same kernels on the scalar reference backend, to check and benchmark the vector backends against
+const KernelTable* scalarTable() {
+    static const KernelTable table = makeTable<ScalarVec<4>>(Isa::SCALAR, "scalar");
+    return &table;
+}
+
+}  // namespace Kernels
+}  // namespace ML
@@ -0,0 +1,364 @@
+#pragma once
+
+// Kernel bodies shared by every instruction set level. Only included by the per-level translation units
+// (src/kernels/<isa>/), which compile it with their own -m flags. Everything lives in an anonymous
+// namespace and avoids inline library templates, so no code built for one level can be picked by the
+// linker for another (which would SIGILL on older CPUs).
+//
+// Kernels are written once against the vfloat abstraction (Vec.h) and instantiated per backend.
+
+#include <cfloat>
+#include <type_traits>
+
+#include "Kernels.h"
+#include "Vec.h"
+
+namespace ML {
+namespace Kernels {
+namespace {
+
+inline std::size_t kmin(const std::size_t a, const std::size_t b) { return a < b ? a : b; }
+
+// Filter taps [begin, end) of output position `o` along one dimension that land inside the unpadded input
+inline void tapRange(const std::size_t o, const std::size_t stride, const std::size_t pad, const std::size_t dil, const std::size_t filt,
+                     const std::size_t in, std::size_t& begin, std::size_t& end) {
+    long base = (long)(o * stride) - (long)pad;
+    begin = base >= 0 ? 0 : (std::size_t)((-base + (long)dil - 1) / (long)dil);
+    end = (long)in > base ? kmin(filt, (std::size_t)(((long)in - base + (long)dil - 1) / (long)dil)) : 0;
+    if (end < begin) end = begin;
+}
+
+// Calls f(px, w) for every filter tap of output pixel (p, q) inside the unpadded input, px is the input pixel
+// and w the weights of the tap (w_stride apart) offset to output channel m0
+template <typename F>
+void forEachTap(const ConvShape& sh, const fp32* in, const fp32* weights, const std::size_t w_stride, const std::size_t p, const std::size_t q,
+                const std::size_t m0, F f) {
+    std::size_t r_begin, r_end, s_begin, s_end;
+    tapRange(p, sh.stride_h, sh.pad_top, sh.dil_h, sh.filt_h, sh.in_h, r_begin, r_end);
+    tapRange(q, sh.stride_w, sh.pad_left, sh.dil_w, sh.filt_w, sh.in_w, s_begin, s_end);
+
+    for (std::size_t r = r_begin; r < r_end; r++) {
+        std::size_t ih = p * sh.stride_h + r * sh.dil_h - sh.pad_top;
+        for (std::size_t s = s_begin; s < s_end; s++) {
+            std::size_t iw = q * sh.stride_w + s * sh.dil_w - sh.pad_left;
+            f(in + (ih * sh.in_w + iw) * sh.in_c, weights + (r * sh.filt_w + s) * w_stride + m0);
+        }
+    }
+}
+
+template <typename V> struct KernelImpl {
+    enum { L = V::width };
+
+    // Vector j of a block of NV, the last one is partial (tail lanes) when PARTIAL
+    template <std::size_t NV, bool PARTIAL> static V loadBlock(const fp32* p, const std::size_t j, const std::size_t tail) {
+        return (PARTIAL && j == NV - 1) ? V::loadPartial(p + j * L, tail) : V::load(p + j * L);
+    }
+    template <std::size_t NV, bool PARTIAL> static void storeBlock(const V& v, fp32* p, const std::size_t j, const std::size_t tail) {
+        if (PARTIAL && j == NV - 1) {
+            v.storePartial(p + j * L, tail);
+        } else {
+            v.store(p + j * L);
+        }
+    }
+
+    // Runs block(m0, tail) over `count` channels: blocks of 4, 2 and 1 vectors, then a partial vector
+    template <template <std::size_t, bool> class Block, typename... Args> static void forEachBlock(const std::size_t count, Args&&... args) {
+        std::size_t m = 0;
+        for (; m + 4 * L <= count; m += 4 * L) Block<4, false>::run(m, L, args...);
+        for (; m + 2 * L <= count; m += 2 * L) Block<2, false>::run(m, L, args...);
+        for (; m + L <= count; m += L) Block<1, false>::run(m, L, args...);
+        if (m < count) Block<1, true>::run(m, count - m, args...);
+    }
+
+    // --- Dense ---
+    // NV vectors of output channels [m0, ...) accumulated over all inputs, the weight rows are walked contiguously
+    template <std::size_t NV, bool PARTIAL> struct DenseBlock {
+        static void run(const std::size_t m0, const std::size_t tail, const fp32* in, const fp32* weights, const fp32* bias, fp32* out,
+                        const std::size_t in_c, const std::size_t out_c, const bool relu) {
+            V acc[NV];
+            for (std::size_t j = 0; j < NV; j++) acc[j] = bias ? loadBlock<NV, PARTIAL>(bias + m0, j, tail) : V::zero();
+
+            const fp32* w = weights + m0;
+            for (std::size_t c = 0; c < in_c; c++, w += out_c) {
+                V x = V::broadcast(in[c]);
+                for (std::size_t j = 0; j < NV; j++) acc[j] = fmadd(x, loadBlock<NV, PARTIAL>(w, j, tail), acc[j]);
+            }
+
+            for (std::size_t j = 0; j < NV; j++) storeBlock<NV, PARTIAL>(relu ? vmax(acc[j], V::zero()) : acc[j], out + m0, j, tail);
+        }
+    };
+
+    static void dense(const fp32* in, const fp32* weights, const fp32* bias, fp32* out, const std::size_t in_c, const std::size_t out_c,
+                      const bool relu) {
+        forEachBlock<DenseBlock>(out_c, in, weights, bias, out, in_c, out_c, relu);
+    }
+
+    // --- Convolution ---
+    // NV vectors of output channels of one pixel, the accumulators stay in registers. in, weights, bias and dst point
+    // at the group's first channel, so each group reads only its own group_in input channels
+    template <std::size_t NV, bool PARTIAL> struct ConvBlock {
+        static void run(const std::size_t m0, const std::size_t tail, const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias,
+                        fp32* dst, const std::size_t p, const std::size_t q) {
+            V acc[NV];
+            for (std::size_t j = 0; j < NV; j++) acc[j] = loadBlock<NV, PARTIAL>(bias + m0, j, tail);
+
+            forEachTap(sh, in, weights, sh.group_in * sh.out_c, p, q, m0, [&](const fp32* px, const fp32* w) {
+                for (std::size_t c = 0; c < sh.group_in; c++, w += sh.out_c) {
+                    V x = V::broadcast(px[c]);
+                    for (std::size_t j = 0; j < NV; j++) acc[j] = fmadd(x, loadBlock<NV, PARTIAL>(w, j, tail), acc[j]);
+                }
+            });
+
+            for (std::size_t j = 0; j < NV; j++) storeBlock<NV, PARTIAL>(vmax(acc[j], V::zero()), dst + m0, j, tail);
+        }
+    };
+
+    static void conv(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out) {
+        for (std::size_t p = 0; p < sh.out_h; p++) {
+            for (std::size_t q = 0; q < sh.out_w; q++) {
+                fp32* dst = out + (p * sh.out_w + q) * sh.out_c;
+                for (std::size_t g = 0; g < sh.groups; g++) {
+                    std::size_t m = g * sh.group_out;
+                    forEachBlock<ConvBlock>(sh.group_out, sh, in + g * sh.group_in, weights + m, bias + m, dst + m, p, q);
+                }
+            }
+        }
+    }
+
+    // --- Convolution in a blocked layout (NCHW<CB>c) ---
+    // Register blocks over Q neighbouring output pixels of one output channel block, every weight vector is loaded
+    // once for all Q pixels. A block narrower than the level's vectors uses the narrower backend
+    template <std::size_t CB> struct BlockedConv {
+        typedef typename std::conditional<(CB >= L), V, typename VecSelect<CB>::type>::type VB;
+        enum { NV = CB / VB::width, Q = 8 / NV };
+
+        template <std::size_t QT>
+        static void tile(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out, const std::size_t p,
+                         const std::size_t q0, const std::size_t s_begin, const std::size_t s_end) {
+            std::size_t r_begin, r_end;
+            tapRange(p, sh.stride_h, sh.pad_top, sh.dil_h, sh.filt_h, sh.in_h, r_begin, r_end);
+
+            VB acc[QT][NV];
+            for (std::size_t t = 0; t < QT; t++) {
+                for (std::size_t j = 0; j < NV; j++) acc[t][j] = VB::load(bias + j * VB::width);
+            }
+
+            const std::size_t plane = sh.in_h * sh.in_w * CB;
+            const std::size_t pixel_step = sh.stride_w * CB;
+            for (std::size_t r = r_begin; r < r_end; r++) {
+                std::size_t ih = p * sh.stride_h + r * sh.dil_h - sh.pad_top;
+                for (std::size_t s = s_begin; s < s_end; s++) {
+                    std::size_t iw = q0 * sh.stride_w + s * sh.dil_w - sh.pad_left;
+                    const fp32* px = in + (ih * sh.in_w + iw) * CB;
+                    const fp32* w = weights + (r * sh.filt_w + s) * sh.in_c * CB;
+                    for (std::size_t ib = 0; ib < sh.in_c / CB; ib++, px += plane) {
+                        for (std::size_t c = 0; c < CB; c++, w += CB) {
+                            VB wv[NV];
+                            for (std::size_t j = 0; j < NV; j++) wv[j] = VB::load(w + j * VB::width);
+                            for (std::size_t t = 0; t < QT; t++) {
+                                VB x = VB::broadcast(px[t * pixel_step + c]);
+                                for (std::size_t j = 0; j < NV; j++) acc[t][j] = fmadd(x, wv[j], acc[t][j]);
+                            }
+                        }
+                    }
+                }
+            }
+
+            for (std::size_t t = 0; t < QT; t++) {
+                fp32* dst = out + (p * sh.out_w + q0 + t) * CB;
+                for (std::size_t j = 0; j < NV; j++) vmax(acc[t][j], VB::zero()).store(dst + j * VB::width);
+            }
+        }
+
+        static void run(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out) {
+            for (std::size_t ob = 0; ob < sh.out_c / CB; ob++) {
+                const fp32* w = weights + ob * sh.filt_h * sh.filt_w * sh.in_c * CB;
+                fp32* dst = out + ob * sh.out_h * sh.out_w * CB;
+                for (std::size_t p = 0; p < sh.out_h; p++) {
+                    std::size_t q = 0;
+                    while (q < sh.out_w) {
+                        // Whole tiles need the same horizontal taps for every pixel, i.e. no padding in the tile
+                        std::size_t s_begin, s_end, last_begin, last_end;
+                        tapRange(q, sh.stride_w, sh.pad_left, sh.dil_w, sh.filt_w, sh.in_w, s_begin, s_end);
+                        if (q + Q <= sh.out_w) tapRange(q + Q - 1, sh.stride_w, sh.pad_left, sh.dil_w, sh.filt_w, sh.in_w, last_begin, last_end);
+
+                        if (q + Q <= sh.out_w && last_begin == s_begin && last_end == s_end) {
+                            tile<Q>(sh, in, w, bias + ob * CB, dst, p, q, s_begin, s_end);
+                            q += Q;
+                        } else {
+                            tile<1>(sh, in, w, bias + ob * CB, dst, p, q, s_begin, s_end);
+                            q++;
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    static void convBlocked(const ConvShape& sh, const std::size_t block, const fp32* in, const fp32* weights, const fp32* bias, fp32* out) {
+        if (block == 16) {
+            BlockedConv<16>::run(sh, in, weights, bias, out);
+        } else {
+            BlockedConv<8>::run(sh, in, weights, bias, out);
+        }
+    }
+
+    // --- Depthwise convolution, vectorized across channels ---
+    template <std::size_t NV, bool PARTIAL> struct DepthwiseBlock {
+        static void run(const std::size_t c0, const std::size_t tail, const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias,
+                        fp32* dst, const std::size_t p, const std::size_t q) {
+            V acc[NV];
+            for (std::size_t j = 0; j < NV; j++) acc[j] = loadBlock<NV, PARTIAL>(bias + c0, j, tail);
+
+            forEachTap(sh, in, weights, sh.out_c, p, q, c0, [&](const fp32* px, const fp32* w) {
+                for (std::size_t j = 0; j < NV; j++) acc[j] = fmadd(loadBlock<NV, PARTIAL>(px + c0, j, tail), loadBlock<NV, PARTIAL>(w, j, tail), acc[j]);
+            });
+
+            for (std::size_t j = 0; j < NV; j++) storeBlock<NV, PARTIAL>(vmax(acc[j], V::zero()), dst + c0, j, tail);
+        }
+    };
+
+    static void depthwise(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out) {
+        for (std::size_t p = 0; p < sh.out_h; p++) {
+            for (std::size_t q = 0; q < sh.out_w; q++) {
+                forEachBlock<DepthwiseBlock>(sh.out_c, sh, in, weights, bias, out + (p * sh.out_w + q) * sh.out_c, p, q);
+            }
+        }
+    }
+
+    // --- Max pooling, vectorized across channels ---
+    template <std::size_t NV, bool PARTIAL> struct PoolBlock {
+        static void run(const std::size_t c0, const std::size_t tail, const PoolShape& sh, const fp32* window, fp32* dst, const std::size_t rows,
+                        const std::size_t cols) {
+            V acc[NV];
+            for (std::size_t j = 0; j < NV; j++) acc[j] = V::broadcast(-FLT_MAX);
+
+            const std::size_t row_stride = sh.in_w * sh.channels;
+            for (std::size_t i = 0; i < rows; i++) {
+                for (std::size_t k = 0; k < cols; k++) {
+                    const fp32* px = window + i * row_stride + k * sh.channels + c0;
+                    for (std::size_t j = 0; j < NV; j++) acc[j] = vmax(acc[j], loadBlock<NV, PARTIAL>(px, j, tail));
+                }
+            }
+
+            for (std::size_t j = 0; j < NV; j++) storeBlock<NV, PARTIAL>(acc[j], dst + c0, j, tail);
+        }
+    };
+
+    static void maxPool(const PoolShape& sh, const fp32* in, fp32* out) {
+        for (std::size_t h = 0; h < sh.out_h; h++) {
+            // Padded positions never win the max, so the window is clipped to the input
+            long h_start = (long)(h * sh.stride_h) - (long)sh.pad_h;
+            std::size_t h_begin = h_start > 0 ? (std::size_t)h_start : 0;
+            std::size_t h_end = kmin((std::size_t)(h_start + (long)sh.kernel_h), sh.in_h);
+
+            for (std::size_t w = 0; w < sh.out_w; w++) {
+                long w_start = (long)(w * sh.stride_w) - (long)sh.pad_w;
+                std::size_t w_begin = w_start > 0 ? (std::size_t)w_start : 0;
+                std::size_t w_end = kmin((std::size_t)(w_start + (long)sh.kernel_w), sh.in_w);
+
+                const fp32* window = in + (h_begin * sh.in_w + w_begin) * sh.channels;
+                forEachBlock<PoolBlock>(sh.channels, sh, window, out + (h * sh.out_w + w) * sh.channels, h_end - h_begin, w_end - w_begin);
+            }
+        }
+    }
+
+    // --- SoftMax ---
+    // Online normalizer per lane: whenever the running max grows, the running sum is rescaled
+    static void softmaxStats(const fp32* in, const std::size_t count, fp32& max_out, fp32& sum_out) {
+        V lane_max = V::broadcast(-FLT_MAX);
+        V lane_sum = V::zero();
+
+        std::size_t i = 0;
+        for (; i + L <= count; i += L) {
+            V x = V::load(in + i);
+            V new_max = vmax(lane_max, x);
+            lane_sum = fmadd(lane_sum, vexp(lane_max - new_max), vexp(x - new_max));
+            lane_max = new_max;
+        }
+
+        // Merge the lanes, then the remaining elements
+        fp32 max = hmax(lane_max);
+        fp32 sum = hsum(lane_sum * vexp(lane_max - V::broadcast(max)));
+        for (; i < count; i++) {
+            fp32 new_max = in[i] > max ? in[i] : max;
+            sum = sum * vexp(max - new_max) + vexp(in[i] - new_max);
+            max = new_max;
+        }
+
+        max_out = max;
+        sum_out = sum;
+    }
+
+    static void softmaxOut(const fp32* in, fp32* out, const std::size_t count, const fp32 shift, const fp32 scale, const bool log) {
+        const V vshift = V::broadcast(shift);
+        const V vscale = V::broadcast(scale);
+
+        std::size_t i = 0;
+        for (; i + L <= count; i += L) {
+            V x = V::load(in + i) - vshift;
+            (log ? x : vexp(x) * vscale).store(out + i);
+        }
+        if (i < count) {
+            V x = V::loadPartial(in + i, count - i) - vshift;
+            (log ? x : vexp(x) * vscale).storePartial(out + i, count - i);
+        }
+    }
+
+    // --- Compare ---
+    // The sums are kept in fp32 lanes for a block and flushed to double, the max difference only per block: a block
+    // that beats it (or holds the first NaN) is rescanned for the element, which is rare after the first few blocks
+    static void compare(const fp32* a, const fp32* b, const std::size_t count, const std::size_t first, CompareSums& sums) {
+        const std::size_t block = 64 * L;
+        for (std::size_t begin = 0; begin < count; begin += block) {
+            std::size_t end = kmin(begin + block, count);
+            V dot = V::zero(), a_sq = V::zero(), b_sq = V::zero(), diff_sq = V::zero(), diff_max = V::zero();
+
+            for (std::size_t i = begin; i < end; i += L) {
+                V va = i + L <= end ? V::load(a + i) : V::loadPartial(a + i, end - i);
+                V vb = i + L <= end ? V::load(b + i) : V::loadPartial(b + i, end - i);
+                V diff = va - vb;
+                dot = fmadd(va, vb, dot);
+                a_sq = fmadd(va, va, a_sq);
+                b_sq = fmadd(vb, vb, b_sq);
+                diff_sq = fmadd(diff, diff, diff_sq);
+                diff_max = vmax(diff_max, vmax(diff, V::zero() - diff));
+            }
+
+            fp32 block_sq = hsum(diff_sq);
+            sums.dot += hsum(dot);
+            sums.a_sq += hsum(a_sq);
+            sums.b_sq += hsum(b_sq);
+            sums.diff_sq += block_sq;
+
+            bool has_nan = block_sq != block_sq;
+            if (sums.max_diff != sums.max_diff || !(hmax(diff_max) > sums.max_diff || has_nan)) continue;
+            for (std::size_t i = begin; i < end; i++) {
+                fp32 diff = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+                if (diff != diff || diff > sums.max_diff) {
+                    sums.max_diff = diff;
+                    sums.worst = first + i;
+                    if (diff != diff) break;
+                }
+            }
+        }
+    }
+};
+
+template <typename V> KernelTable makeTable(const Isa isa, const char* name) {
+    return {isa,
+            name,
+            &KernelImpl<V>::dense,
+            &KernelImpl<V>::conv,
+            V::width >= 16 ? 16 : 8,
+            &KernelImpl<V>::convBlocked,
+            &KernelImpl<V>::depthwise,
+            &KernelImpl<V>::maxPool,
+            &KernelImpl<V>::softmaxStats,
+            &KernelImpl<V>::softmaxOut,
+            &KernelImpl<V>::compare};
+}
+
+}  // namespace
+}  // namespace Kernels
+}  // namespace ML
@@ -0,0 +1,328 @@
+#pragma once
+
+// Thin vector abstraction the SIMD kernels are written against. vfloat<N> is N fp32 lanes, backed by the
+// widest native backend the including translation unit is compiled for:
+//   vfloat<4>  SSE (x86) or NEON (ARM)
+//   vfloat<8>  AVX2 + FMA
+//   vfloat<16> AVX-512
+// and by the scalar reference backend (plain arrays, any N, any target) otherwise, or everywhere when
+// ML_SCALAR_VEC is defined. A new backend is one more struct with the same members and a VecSelect specialization.
+//
+// Like KernelsImpl.h this is only included by the per level kernel translation units, everything has internal
+// linkage so the code for one level can't be shared with another.
+
+#include <cstddef>
+#include <cstring>
+
+#include "../Types.h"
+
+#if !defined(ML_SCALAR_VEC)
+#if defined(__SSE2__) || defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define ML_VEC_NEON
+#endif
+#endif
+
+namespace ML {
+namespace Kernels {
+namespace {
+
+// Lane-wise operations shared by every backend:
+//   V::load(p), V::loadPartial(p, n)     (lanes >= n are zero), V::broadcast(x), V::zero()
+//   v.store(p), v.storePartial(p, n)     (only the first n lanes are written)
+//   a + b, a - b, a * b, fmadd(a, b, c) = a * b + c, vmax(a, b), vmin(a, b)
+//   hsum(v), hmax(v)                     horizontal reductions
+//   pow2i(n)                             2^n for integral lanes n in [-126, 127]
+
+// --- Scalar reference backend ---
+template <std::size_t N> struct ScalarVec {
+    enum { width = N };
+    fp32 v[N];
+
+    static ScalarVec load(const fp32* p) {
+        ScalarVec r;
+        for (std::size_t i = 0; i < N; i++) r.v[i] = p[i];
+        return r;
+    }
+    static ScalarVec loadPartial(const fp32* p, const std::size_t n) {
+        ScalarVec r = zero();
+        for (std::size_t i = 0; i < n; i++) r.v[i] = p[i];
+        return r;
+    }
+    static ScalarVec broadcast(const fp32 x) {
+        ScalarVec r;
+        for (std::size_t i = 0; i < N; i++) r.v[i] = x;
+        return r;
+    }
+    static ScalarVec zero() { return broadcast(0.0f); }
+
+    void store(fp32* p) const {
+        for (std::size_t i = 0; i < N; i++) p[i] = v[i];
+    }
+    void storePartial(fp32* p, const std::size_t n) const {
+        for (std::size_t i = 0; i < n; i++) p[i] = v[i];
+    }
+
+#define ML_SCALAR_VEC_OP(name, expr)                                 \
+    friend ScalarVec name(const ScalarVec& a, const ScalarVec& b) { \
+        ScalarVec r;                                                 \
+        for (std::size_t i = 0; i < N; i++) r.v[i] = (expr);         \
+        return r;                                                    \
+    }
+    ML_SCALAR_VEC_OP(operator+, a.v[i] + b.v[i])
+    ML_SCALAR_VEC_OP(operator-, a.v[i] - b.v[i])
+    ML_SCALAR_VEC_OP(operator*, a.v[i] * b.v[i])
+    ML_SCALAR_VEC_OP(vmax, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+    ML_SCALAR_VEC_OP(vmin, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+#undef ML_SCALAR_VEC_OP
+
+    friend ScalarVec fmadd(const ScalarVec& a, const ScalarVec& b, const ScalarVec& c) {
+        ScalarVec r;
+        for (std::size_t i = 0; i < N; i++) r.v[i] = a.v[i] * b.v[i] + c.v[i];
+        return r;
+    }
+    friend fp32 hsum(const ScalarVec& a) {
+        fp32 s = 0.0f;
+        for (std::size_t i = 0; i < N; i++) s += a.v[i];
+        return s;
+    }
+    friend fp32 hmax(const ScalarVec& a) {
+        fp32 m = a.v[0];
+        for (std::size_t i = 1; i < N; i++) m = a.v[i] > m ? a.v[i] : m;
+        return m;
+    }
+    friend ScalarVec pow2i(const ScalarVec& n) {
+        ScalarVec r;
+        for (std::size_t i = 0; i < N; i++) {
+            i32 bits = ((i32)n.v[i] + 127) << 23;
+            std::memcpy(&r.v[i], &bits, sizeof(fp32));
+        }
+        return r;
+    }
+};
+
+// Partial loads/stores of the native backends that have no masked memory operations go through a stack buffer
+template <typename V> V loadPartialBuffered(const fp32* p, const std::size_t n) {
+    fp32 buf[V::width] = {};
+    for (std::size_t i = 0; i < n; i++) buf[i] = p[i];
+    return V::load(buf);
+}
+template <typename V> void storePartialBuffered(const V& v, fp32* p, const std::size_t n) {
+    fp32 buf[V::width];
+    v.store(buf);
+    for (std::size_t i = 0; i < n; i++) p[i] = buf[i];
+}
+
+#if !defined(ML_SCALAR_VEC) && defined(__SSE2__)
+// --- SSE backend (x86-64 baseline) ---
+struct SseVec {
+    enum { width = 4 };
+    __m128 v;
+
+    static SseVec load(const fp32* p) { return {_mm_loadu_ps(p)}; }
+    static SseVec loadPartial(const fp32* p, const std::size_t n) { return loadPartialBuffered<SseVec>(p, n); }
+    static SseVec broadcast(const fp32 x) { return {_mm_set1_ps(x)}; }
+    static SseVec zero() { return {_mm_setzero_ps()}; }
+    void store(fp32* p) const { _mm_storeu_ps(p, v); }
+    void storePartial(fp32* p, const std::size_t n) const { storePartialBuffered(*this, p, n); }
+
+    friend SseVec operator+(const SseVec a, const SseVec b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend SseVec operator-(const SseVec a, const SseVec b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend SseVec operator*(const SseVec a, const SseVec b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend SseVec vmax(const SseVec a, const SseVec b) { return {_mm_max_ps(a.v, b.v)}; }
+    friend SseVec vmin(const SseVec a, const SseVec b) { return {_mm_min_ps(a.v, b.v)}; }
+#if defined(__FMA__)
+    friend SseVec fmadd(const SseVec a, const SseVec b, const SseVec c) { return {_mm_fmadd_ps(a.v, b.v, c.v)}; }
+#else
+    friend SseVec fmadd(const SseVec a, const SseVec b, const SseVec c) { return {_mm_add_ps(_mm_mul_ps(a.v, b.v), c.v)}; }
+#endif
+
+    friend fp32 hsum(const SseVec a) {
+        __m128 s = _mm_add_ps(a.v, _mm_movehl_ps(a.v, a.v));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+    friend fp32 hmax(const SseVec a) {
+        __m128 m = _mm_max_ps(a.v, _mm_movehl_ps(a.v, a.v));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    friend SseVec pow2i(const SseVec n) {
+        return {_mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n.v), _mm_set1_epi32(127)), 23))};
+    }
+};
+#endif
+
+#if !defined(ML_SCALAR_VEC) && defined(ML_VEC_NEON)
+// --- NEON backend (ARMv7 with NEON, e.g. the ZedBoard's Cortex-A9, and AArch64) ---
+struct NeonVec {
+    enum { width = 4 };
+    float32x4_t v;
+
+    static NeonVec load(const fp32* p) { return {vld1q_f32(p)}; }
+    static NeonVec loadPartial(const fp32* p, const std::size_t n) { return loadPartialBuffered<NeonVec>(p, n); }
+    static NeonVec broadcast(const fp32 x) { return {vdupq_n_f32(x)}; }
+    static NeonVec zero() { return {vdupq_n_f32(0.0f)}; }
+    void store(fp32* p) const { vst1q_f32(p, v); }
+    void storePartial(fp32* p, const std::size_t n) const { storePartialBuffered(*this, p, n); }
+
+    friend NeonVec operator+(const NeonVec a, const NeonVec b) { return {vaddq_f32(a.v, b.v)}; }
+    friend NeonVec operator-(const NeonVec a, const NeonVec b) { return {vsubq_f32(a.v, b.v)}; }
+    friend NeonVec operator*(const NeonVec a, const NeonVec b) { return {vmulq_f32(a.v, b.v)}; }
+    friend NeonVec vmax(const NeonVec a, const NeonVec b) { return {vmaxq_f32(a.v, b.v)}; }
+    friend NeonVec vmin(const NeonVec a, const NeonVec b) { return {vminq_f32(a.v, b.v)}; }
+#if defined(__aarch64__) || defined(__ARM_FEATURE_FMA)
+    friend NeonVec fmadd(const NeonVec a, const NeonVec b, const NeonVec c) { return {vfmaq_f32(c.v, a.v, b.v)}; }
+#else
+    friend NeonVec fmadd(const NeonVec a, const NeonVec b, const NeonVec c) { return {vmlaq_f32(c.v, a.v, b.v)}; }
+#endif
+
+    friend fp32 hsum(const NeonVec a) {
+        float32x2_t s = vadd_f32(vget_low_f32(a.v), vget_high_f32(a.v));
+        return vget_lane_f32(vpadd_f32(s, s), 0);
+    }
+    friend fp32 hmax(const NeonVec a) {
+        float32x2_t m = vmax_f32(vget_low_f32(a.v), vget_high_f32(a.v));
+        return vget_lane_f32(vpmax_f32(m, m), 0);
+    }
+    friend NeonVec pow2i(const NeonVec n) {
+        return {vreinterpretq_f32_s32(vshlq_n_s32(vaddq_s32(vcvtq_s32_f32(n.v), vdupq_n_s32(127)), 23))};
+    }
+};
+#endif
+
+#if !defined(ML_SCALAR_VEC) && defined(__AVX2__) && defined(__FMA__)
+// --- AVX2 + FMA backend ---
+struct Avx2Vec {
+    enum { width = 8 };
+    __m256 v;
+
+    static __m256i mask(const std::size_t n) { return _mm256_cmpgt_epi32(_mm256_set1_epi32((int)n), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)); }
+
+    static Avx2Vec load(const fp32* p) { return {_mm256_loadu_ps(p)}; }
+    static Avx2Vec loadPartial(const fp32* p, const std::size_t n) { return {_mm256_maskload_ps(p, mask(n))}; }
+    static Avx2Vec broadcast(const fp32 x) { return {_mm256_set1_ps(x)}; }
+    static Avx2Vec zero() { return {_mm256_setzero_ps()}; }
+    void store(fp32* p) const { _mm256_storeu_ps(p, v); }
+    void storePartial(fp32* p, const std::size_t n) const { _mm256_maskstore_ps(p, mask(n), v); }
+
+    friend Avx2Vec operator+(const Avx2Vec a, const Avx2Vec b) { return {_mm256_add_ps(a.v, b.v)}; }
+    friend Avx2Vec operator-(const Avx2Vec a, const Avx2Vec b) { return {_mm256_sub_ps(a.v, b.v)}; }
+    friend Avx2Vec operator*(const Avx2Vec a, const Avx2Vec b) { return {_mm256_mul_ps(a.v, b.v)}; }
+    friend Avx2Vec vmax(const Avx2Vec a, const Avx2Vec b) { return {_mm256_max_ps(a.v, b.v)}; }
+    friend Avx2Vec vmin(const Avx2Vec a, const Avx2Vec b) { return {_mm256_min_ps(a.v, b.v)}; }
+    friend Avx2Vec fmadd(const Avx2Vec a, const Avx2Vec b, const Avx2Vec c) { return {_mm256_fmadd_ps(a.v, b.v, c.v)}; }
+
+    friend fp32 hsum(const Avx2Vec a) {
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+    friend fp32 hmax(const Avx2Vec a) {
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    friend Avx2Vec pow2i(const Avx2Vec n) {
+        return {_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n.v), _mm256_set1_epi32(127)), 23))};
+    }
+};
+#endif
+
+#if !defined(ML_SCALAR_VEC) && defined(__AVX512F__)
+// --- AVX-512 backend, tails use mask registers ---
+// Operations with an undefined pass-through source use their masked forms, the unmasked ones trip GCC 12's
+// uninitialized warning through _mm512_undefined_ps
+struct Avx512Vec {
+    enum { width = 16 };
+    __m512 v;
+
+    static __mmask16 mask(const std::size_t n) { return (__mmask16)((1u << n) - 1); }
+
+    static Avx512Vec load(const fp32* p) { return {_mm512_loadu_ps(p)}; }
+    static Avx512Vec loadPartial(const fp32* p, const std::size_t n) { return {_mm512_maskz_loadu_ps(mask(n), p)}; }
+    static Avx512Vec broadcast(const fp32 x) { return {_mm512_set1_ps(x)}; }
+    static Avx512Vec zero() { return {_mm512_setzero_ps()}; }
+    void store(fp32* p) const { _mm512_storeu_ps(p, v); }
+    void storePartial(fp32* p, const std::size_t n) const { _mm512_mask_storeu_ps(p, mask(n), v); }
+
+    friend Avx512Vec operator+(const Avx512Vec a, const Avx512Vec b) { return {_mm512_add_ps(a.v, b.v)}; }
+    friend Avx512Vec operator-(const Avx512Vec a, const Avx512Vec b) { return {_mm512_sub_ps(a.v, b.v)}; }
+    friend Avx512Vec operator*(const Avx512Vec a, const Avx512Vec b) { return {_mm512_mul_ps(a.v, b.v)}; }
+    friend Avx512Vec vmax(const Avx512Vec a, const Avx512Vec b) { return {_mm512_mask_max_ps(a.v, 0xFFFF, a.v, b.v)}; }
+    friend Avx512Vec vmin(const Avx512Vec a, const Avx512Vec b) { return {_mm512_mask_min_ps(a.v, 0xFFFF, a.v, b.v)}; }
+    friend Avx512Vec fmadd(const Avx512Vec a, const Avx512Vec b, const Avx512Vec c) { return {_mm512_fmadd_ps(a.v, b.v, c.v)}; }
+
+    friend fp32 hsum(const Avx512Vec a) {
+        __m256 s8 = _mm256_add_ps(_mm512_extractf32x8_ps(a.v, 0), _mm512_extractf32x8_ps(a.v, 1));
+        __m128 s = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1));
+        s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+        s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+        return _mm_cvtss_f32(s);
+    }
+    friend fp32 hmax(const Avx512Vec a) {
+        __m256 m8 = _mm256_max_ps(_mm512_extractf32x8_ps(a.v, 0), _mm512_extractf32x8_ps(a.v, 1));
+        __m128 m = _mm_max_ps(_mm256_castps256_ps128(m8), _mm256_extractf128_ps(m8, 1));
+        m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+        m = _mm_max_ss(m, _mm_shuffle_ps(m, m, 1));
+        return _mm_cvtss_f32(m);
+    }
+    friend Avx512Vec pow2i(const Avx512Vec n) {
+        const __m512i zero = _mm512_setzero_si512();
+        __m512i bits = _mm512_add_epi32(_mm512_mask_cvtps_epi32(zero, 0xFFFF, n.v), _mm512_set1_epi32(127));
+        return {_mm512_castsi512_ps(_mm512_mask_slli_epi32(zero, 0xFFFF, bits, 23))};
+    }
+};
+#endif
+
+// Maps a lane count to its backend in this translation unit
+template <std::size_t N> struct VecSelect { typedef ScalarVec<N> type; };
+#if !defined(ML_SCALAR_VEC) && defined(__SSE2__)
+template <> struct VecSelect<4> { typedef SseVec type; };
+#elif !defined(ML_SCALAR_VEC) && defined(ML_VEC_NEON)
+template <> struct VecSelect<4> { typedef NeonVec type; };
+#endif
+#if !defined(ML_SCALAR_VEC) && defined(__AVX2__) && defined(__FMA__)
+template <> struct VecSelect<8> { typedef Avx2Vec type; };
+#endif
+#if !defined(ML_SCALAR_VEC) && defined(__AVX512F__)
+template <> struct VecSelect<16> { typedef Avx512Vec type; };
+#endif
+
+template <std::size_t N> using vfloat = typename VecSelect<N>::type;
+
+// Cephes style exp: e^x = 2^n * e^r with |r| <= ln(2)/2 and a degree 6 polynomial for e^r, relative error ~1e-7
+template <typename V> V vexp(V x) {
+    x = vmin(vmax(x, V::broadcast(-87.3365447504019f)), V::broadcast(88.3762626647949f));
+
+    // Round to nearest with the 1.5 * 2^23 trick, no rounding instruction needed
+    const V magic = V::broadcast(12582912.0f);
+    V n = fmadd(x, V::broadcast(1.44269504088896341f), magic) - magic;
+    V r = x - n * V::broadcast(0.693359375f) + n * V::broadcast(2.12194440e-4f);
+
+    V p = V::broadcast(1.9875691500e-4f);
+    p = fmadd(p, r, V::broadcast(1.3981999507e-3f));
+    p = fmadd(p, r, V::broadcast(8.3334519073e-3f));
+    p = fmadd(p, r, V::broadcast(4.1665795894e-2f));
+    p = fmadd(p, r, V::broadcast(1.6666665459e-1f));
+    p = fmadd(p, r, V::broadcast(5.0000001201e-1f));
+    p = fmadd(p * r, r, r + V::broadcast(1.0f));
+
+    return p * pow2i(n);
+}
+
+// Scalar exp through the reference backend, for reduction tails
+inline fp32 vexp(const fp32 x) {
+    fp32 r;
+    vexp(ScalarVec<1>::broadcast(x)).store(&r);
+    return r;
+}
+
+}  // namespace
+}  // namespace Kernels
+}  // namespace ML
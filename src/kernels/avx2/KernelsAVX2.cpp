@@ -0,0 +1,29 @@
+// AVX2 + FMA kernels, built with -mavx2 -mfma (see Makefile)
+#include "../Kernels.h"
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include "../KernelsImpl.h"
+
+namespace ML {
+namespace Kernels {
+
+const KernelTable* avx2Table() {
+    static const KernelTable table = makeTable<vfloat<8>>(Isa::AVX2, "avx2");
+    return &table;
+}
+
+}  // namespace Kernels
+}  // namespace ML
+
+#else
+
+namespace ML {
+namespace Kernels {
+
+// Built without the level's flags (e.g. not an x86 host)
+const KernelTable* avx2Table() { return nullptr; }
+
+}  // namespace Kernels
+}  // namespace ML
+
+#endif
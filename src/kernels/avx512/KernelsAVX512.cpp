@@ -0,0 +1,29 @@
+// AVX-512 kernels, built with -mavx512f -mavx512dq (see Makefile)
+#include "../Kernels.h"
+
+#if defined(__AVX512F__) && defined(__AVX512DQ__)
+#include "../KernelsImpl.h"
+
+namespace ML {
+namespace Kernels {
+
+const KernelTable* avx512Table() {
+    static const KernelTable table = makeTable<vfloat<16>>(Isa::AVX512, "avx512");
+    return &table;
+}
+
+}  // namespace Kernels
+}  // namespace ML
+
+#else
+
+namespace ML {
+namespace Kernels {
+
+// Built without the level's flags (e.g. not an x86 host)
+const KernelTable* avx512Table() { return nullptr; }
+
+}  // namespace Kernels
+}  // namespace ML
+
+#endif
@@ -0,0 +1,29 @@
+// SSE4.2 kernels, built with -msse4.2 (see Makefile)
+#include "../Kernels.h"
+
+#if defined(__SSE4_2__)
+#include "../KernelsImpl.h"
+
+namespace ML {
+namespace Kernels {
+
+const KernelTable* sse42Table() {
+    static const KernelTable table = makeTable<vfloat<4>>(Isa::SSE42, "sse4.2");
+    return &table;
+}
+
+}  // namespace Kernels
+}  // namespace ML
+
+#else
+
+namespace ML {
+namespace Kernels {
+
+// Built without the level's flags (e.g. not an x86 host)
+const KernelTable* sse42Table() { return nullptr; }
+
+}  // namespace Kernels
+}  // namespace ML
+
+#endif
@@ -0,0 +1,92 @@
+#include "ConvKernels.h"
+
+#include <algorithm>
+
+namespace ML {
+
+namespace {
+
+// Valid convolution with the filter size, stride and output channel block fixed at compile time,
+// so the filter loops fully unroll and the channel block accumulator stays in registers
+template <size_t FH, size_t FW, size_t STRIDE, size_t CB>
+void convSpecialized(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out) {
+    const size_t in_c = sh.in_c;
+    const size_t out_c = sh.out_c;
+    const size_t row_stride = sh.in_w * in_c;
+
+    for (size_t p = 0; p < sh.out_h; p++) {
+        for (size_t q = 0; q < sh.out_w; q++) {
+            const fp32* window = in + (p * STRIDE) * row_stride + (q * STRIDE) * in_c;
+            fp32* dst = out + (p * sh.out_w + q) * out_c;
+
+            for (size_t m0 = 0; m0 < out_c; m0 += CB) {
+                fp32 acc[CB];
+                for (size_t k = 0; k < CB; k++) acc[k] = bias[m0 + k];
+
+                for (size_t r = 0; r < FH; r++) {
+                    for (size_t s = 0; s < FW; s++) {
+                        const fp32* px = window + r * row_stride + s * in_c;
+                        const fp32* w = weights + (r * FW + s) * in_c * out_c + m0;
+                        for (size_t c = 0; c < in_c; c++, w += out_c) {
+                            const fp32 x = px[c];
+                            for (size_t k = 0; k < CB; k++) acc[k] += x * w[k];
+                        }
+                    }
+                }
+
+                for (size_t k = 0; k < CB; k++) dst[m0 + k] = std::max(acc[k], 0.0f);
+            }
+        }
+    }
+}
+
+template <size_t FH, size_t FW, size_t STRIDE>
+void addBlocks(ConvKernelRegistry& registry) {
+    registry.add({FH, FW, STRIDE, 8}, convSpecialized<FH, FW, STRIDE, 8>);
+    registry.add({FH, FW, STRIDE, 16}, convSpecialized<FH, FW, STRIDE, 16>);
+    registry.add({FH, FW, STRIDE, 32}, convSpecialized<FH, FW, STRIDE, 32>);
+}
+
+}  // namespace
+
+ConvKernelRegistry& ConvKernelRegistry::instance() {
+    static ConvKernelRegistry registry;
+    return registry;
+}
+
+// Built-in instances
+ConvKernelRegistry::ConvKernelRegistry() {
+    addBlocks<1, 1, 1>(*this);
+    addBlocks<3, 3, 1>(*this);
+    addBlocks<5, 5, 1>(*this);
+    addBlocks<1, 1, 2>(*this);
+    addBlocks<3, 3, 2>(*this);
+    addBlocks<5, 5, 2>(*this);
+}
+
+void ConvKernelRegistry::add(const ConvKernelKey key, const ConvKernelFn fn) {
+    kernels.emplace_back(key, fn);
+}
+
+ConvKernelFn ConvKernelRegistry::find(const ConvShape& shape) const {
+    // Specialized kernels only handle plain valid convolutions
+    if (shape.groups != 1 || shape.dil_h != 1 || shape.dil_w != 1 || shape.pad_top != 0 || shape.pad_left != 0) return nullptr;
+    if (shape.stride_h != shape.stride_w) return nullptr;
+    if (shape.in_h < shape.filt_h || shape.in_w < shape.filt_w) return nullptr;
+    if ((shape.in_h - shape.filt_h) / shape.stride_h + 1 != shape.out_h || (shape.in_w - shape.filt_w) / shape.stride_w + 1 != shape.out_w) {
+        return nullptr;  // Bottom/right padding
+    }
+
+    ConvKernelFn best = nullptr;
+    size_t best_block = 0;
+    for (const auto& entry : kernels) {
+        const ConvKernelKey& key = entry.first;
+        if (key.filtH != shape.filt_h || key.filtW != shape.filt_w || key.stride != shape.stride_h) continue;
+        if (shape.out_c % key.channelBlock != 0 || key.channelBlock < best_block) continue;
+        best = entry.second;
+        best_block = key.channelBlock;
+    }
+    return best;
+}
+
+}  // namespace ML
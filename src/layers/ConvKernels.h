@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#include "../Types.h"
+#include "../kernels/Kernels.h"
+
+namespace ML {
+
+// Computes a whole convolution (bias and ReLU included) for one shape
+using ConvKernelFn = void (*)(const ConvShape& shape, const fp32* in, const fp32* weights, const fp32* bias, fp32* out);
+
+// Compile-time parameters of a specialized kernel
+struct ConvKernelKey {
+    std::size_t filtH, filtW;
+    std::size_t stride;
+    std::size_t channelBlock;  // Output channels accumulated together, must divide the output channels
+};
+
+// Shape specialized convolution kernels. The built-in instances cover the common filter sizes and strides,
+// ungrouped, undilated and unpadded layers with another shape fall back to the generic kernels.
+// Only the tiled backend uses them: they are built with the default flags, so the SIMD backend and region inference
+// keep the vector kernels of the level picked at runtime (kernels/), which are faster on every built-in shape
+class ConvKernelRegistry {
+   public:
+    static ConvKernelRegistry& instance();
+
+    // Register a kernel, later registrations win over earlier ones with the same key
+    void add(const ConvKernelKey key, const ConvKernelFn fn);
+
+    // Specialized kernel for the shape (largest usable channel block), nullptr if none matches
+    ConvKernelFn find(const ConvShape& shape) const;
+
+   private:
+    ConvKernelRegistry();
+
+    std::vector<std::pair<ConvKernelKey, ConvKernelFn>> kernels;
+};
+
+}  // namespace ML
@@ -1,12 +1,222 @@
 #include "Convolutional.h"
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #include "../Types.h"
 #include "../Utils.h"
+#include "../kernels/Kernels.h"
 #include "Layer.h"
 
 namespace ML {
+
+namespace {
+
+ConvShape shapeOf(const ConvolutionalLayer& layer) {
+    const dimVec& in = layer.getInputParams().dims;
+    const dimVec& out = layer.getOutputParams().dims;
+    const dimVec& w = layer.getWeightParams().dims;
+    const ConvParams& p = layer.getConvParams();
+    return {in[ParamIndex::HEIGHT], in[ParamIndex::WIDTH], in[ParamIndex::CHANNELS],
+            out[ParamIndex::HEIGHT], out[ParamIndex::WIDTH], out[ParamIndex::CHANNELS],
+            w[0], w[1],
+            p.strideH, p.strideW,
+            p.padTop, p.padLeft,
+            p.dilationH, p.dilationW,
+            p.groups, in[ParamIndex::CHANNELS] / p.groups, out[ParamIndex::CHANNELS] / p.groups};
+}
+
+// Filter taps [begin, end) of output position `o` along one dimension that land inside the unpadded input
+inline void tapRange(const size_t o, const size_t stride, const size_t pad, const size_t dil, const size_t filt, const size_t in,
+                     size_t& begin, size_t& end) {
+    long base = (long)(o * stride) - (long)pad;
+    begin = base >= 0 ? 0 : (size_t)((-base + (long)dil - 1) / (long)dil);
+    end = (long)in > base ? std::min(filt, (size_t)(((long)in - base + (long)dil - 1) / (long)dil)) : 0;
+    if (end < begin) end = begin;
+}
+
+// Output size of one spatial dimension
+inline size_t convOutputSize(const size_t in, const size_t pad, const size_t filt, const size_t stride, const size_t dil) {
+    return windowOutputSize(in, pad, (filt - 1) * dil + 1, stride);
+}
+
+// Direct NHWC convolution of one output pixel, accumulating output channels in the innermost (contiguous) loop
+void convPixel(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out, const size_t p, const size_t q,
+               const size_t m_begin, const size_t m_end) {
+    size_t r_begin, r_end, s_begin, s_end;
+    tapRange(p, sh.stride_h, sh.pad_top, sh.dil_h, sh.filt_h, sh.in_h, r_begin, r_end);
+    tapRange(q, sh.stride_w, sh.pad_left, sh.dil_w, sh.filt_w, sh.in_w, s_begin, s_end);
+
+    fp32* acc = out + (p * sh.out_w + q) * sh.out_c;
+    for (size_t m = m_begin; m < m_end; m++) acc[m] = bias[m];
+
+    for (size_t r = r_begin; r < r_end; r++) {
+        size_t ih = p * sh.stride_h + r * sh.dil_h - sh.pad_top;
+        for (size_t s = s_begin; s < s_end; s++) {
+            size_t iw = q * sh.stride_w + s * sh.dil_w - sh.pad_left;
+            const fp32* px = in + (ih * sh.in_w + iw) * sh.in_c;
+            const fp32* w_rs = weights + (r * sh.filt_w + s) * sh.group_in * sh.out_c;
+
+            for (size_t g = m_begin / sh.group_out; g * sh.group_out < m_end; g++) {
+                size_t g_begin = std::max(m_begin, g * sh.group_out);
+                size_t g_end = std::min(m_end, (g + 1) * sh.group_out);
+                for (size_t c = 0; c < sh.group_in; c++) {
+                    fp32 x = px[g * sh.group_in + c];
+                    const fp32* w_row = w_rs + c * sh.out_c;
+                    for (size_t m = g_begin; m < g_end; m++) acc[m] += x * w_row[m];
+                }
+            }
+        }
+    }
+
+    for (size_t m = m_begin; m < m_end; m++) acc[m] = std::max(acc[m], 0.0f);
+}
+
+// Depthwise convolution of one output pixel, every channel only reads its own input channel
+void depthwisePixel(const ConvShape& sh, const fp32* in, const fp32* weights, const fp32* bias, fp32* out, const size_t p, const size_t q) {
+    size_t r_begin, r_end, s_begin, s_end;
+    tapRange(p, sh.stride_h, sh.pad_top, sh.dil_h, sh.filt_h, sh.in_h, r_begin, r_end);
+    tapRange(q, sh.stride_w, sh.pad_left, sh.dil_w, sh.filt_w, sh.in_w, s_begin, s_end);
+
+    fp32* acc = out + (p * sh.out_w + q) * sh.out_c;
+    for (size_t c = 0; c < sh.out_c; c++) acc[c] = bias[c];
+    for (size_t r = r_begin; r < r_end; r++) {
+        size_t ih = p * sh.stride_h + r * sh.dil_h - sh.pad_top;
+        for (size_t s = s_begin; s < s_end; s++) {
+            size_t iw = q * sh.stride_w + s * sh.dil_w - sh.pad_left;
+            const fp32* px = in + (ih * sh.in_w + iw) * sh.in_c;
+            const fp32* w_rs = weights + (r * sh.filt_w + s) * sh.out_c;
+            for (size_t c = 0; c < sh.out_c; c++) acc[c] += px[c] * w_rs[c];
+        }
+    }
+    for (size_t c = 0; c < sh.out_c; c++) acc[c] = std::max(acc[c], 0.0f);
+}
+
+}  // namespace
+
+ConvolutionalLayer::ConvolutionalLayer(const LayerParams inParams, const LayerParams outParams, const LayerParams weightParams,
+                                       const LayerParams biasParams, const ConvParams convParams)
+    : Layer(inParams, outParams, LayerType::CONVOLUTIONAL),
+      weightParam(weightParams),
+      weightData(weightParams),
+      biasParam(biasParams),
+      biasData(biasParams),
+      convParam(convParams) {
+    weightData.setAccount(&getMemory(), MemoryKind::WEIGHTS);
+    biasData.setAccount(&getMemory(), MemoryKind::BIASES);
+
+    ConvParams& p = convParam;
+    size_t in_h = inParams.dims[ParamIndex::HEIGHT], in_w = inParams.dims[ParamIndex::WIDTH], in_c = inParams.dims[ParamIndex::CHANNELS];
+    size_t out_h = outParams.dims[ParamIndex::HEIGHT], out_w = outParams.dims[ParamIndex::WIDTH], out_c = outParams.dims[ParamIndex::CHANNELS];
+
+    if (weightParams.dims.size() != 4) throw std::runtime_error("Convolution weights must be [height][width][in channels / groups][out channels]");
+    size_t filt_h = weightParams.dims[0], filt_w = weightParams.dims[1];
+
+    if (p.strideH == 0 || p.strideW == 0 || p.dilationH == 0 || p.dilationW == 0 || p.groups == 0) {
+        throw std::runtime_error("Convolution stride, dilation and groups must be non-zero");
+    }
+    if (in_c % p.groups != 0 || out_c % p.groups != 0) throw std::runtime_error("Convolution channels must be divisible by the number of groups");
+    if (weightParams.dims[2] * p.groups != in_c || weightParams.dims[3] != out_c) throw std::runtime_error("Convolution weights do not match the channels");
+    if (biasParams.flat_count() != out_c) throw std::runtime_error("Convolution needs one bias per output channel");
+
+    // SAME padding: out = ceil(in / stride), the extra pixel goes on the bottom/right
+    if (p.padding == ConvParams::Padding::SAME) {
+        size_t pad_h = std::max<long>(0, (long)(((in_h + p.strideH - 1) / p.strideH - 1) * p.strideH + (filt_h - 1) * p.dilationH + 1) - (long)in_h);
+        size_t pad_w = std::max<long>(0, (long)(((in_w + p.strideW - 1) / p.strideW - 1) * p.strideW + (filt_w - 1) * p.dilationW + 1) - (long)in_w);
+        p.padTop = pad_h / 2;
+        p.padBottom = pad_h - p.padTop;
+        p.padLeft = pad_w / 2;
+        p.padRight = pad_w - p.padLeft;
+        p.padding = ConvParams::Padding::EXPLICIT;
+    }
+
+    size_t exp_h = convOutputSize(in_h, p.padTop + p.padBottom, filt_h, p.strideH, p.dilationH);
+    size_t exp_w = convOutputSize(in_w, p.padLeft + p.padRight, filt_w, p.strideW, p.dilationW);
+    if (exp_h != out_h || exp_w != out_w) {
+        std::ostringstream oss;
+        oss << "Convolution output shape (" << out_h << ", " << out_w << ") does not match its parameters, expected (" << exp_h << ", " << exp_w << ")";
+        throw std::runtime_error(oss.str());
+    }
+
+    specializedKernel = ConvKernelRegistry::instance().find(shapeOf(*this));
+}
+
+std::vector<Layout> ConvolutionalLayer::supportedLayouts(const InfType infType) const {
+    if (infType != InfType::SIMD || convParam.groups != 1) return {Layout::NHWC};
+
+    Layout blocked = blockedLayout(Kernels::active().block);
+    if (!layoutFits(blocked, getInputParams().dims) || !layoutFits(blocked, getOutputParams().dims)) return {Layout::NHWC};
+    return {blocked, Layout::NHWC};
+}
+
+void ConvolutionalLayer::setLayout(const Layout newLayout) {
+    Layer::setLayout(newLayout);
+    blockedWeights.reset();
+    if (newLayout == Layout::NHWC) return;
+
+    if (!weightData.isAlloced()) throw std::runtime_error("Convolution weights must be loaded before picking a blocked layout");
+    const dimVec& w = weightParam.dims;
+    size_t filt_h = w[0], filt_w = w[1], in_c = w[2], out_c = w[3];
+    size_t block = channelBlock(newLayout);
+
+    blockedWeights.reset(new LayerData({sizeof(fp32), {out_c / block, filt_h, filt_w, in_c, block}}));
+    blockedWeights->setAccount(&getMemory(), MemoryKind::PACKED);
+    if (weightAllocator) blockedWeights->setAllocator(*weightAllocator);
+    blockedWeights->allocData();
+    const fp32* src = weightData.ptr<fp32>();
+    fp32* dst = blockedWeights->ptr<fp32>();
+    for (size_t ob = 0; ob < out_c / block; ob++) {
+        for (size_t i = 0; i < filt_h * filt_w * in_c; i++) {
+            std::memcpy(dst + (ob * filt_h * filt_w * in_c + i) * block, src + i * out_c + ob * block, block * sizeof(fp32));
+        }
+    }
+}
+
+Region ConvolutionalLayer::outputRegion(const Region& in) const {
+    ConvShape sh = shapeOf(*this);
+    Region out;
+    dependentRange(in.h0, in.h1, sh.stride_h, sh.pad_top, (sh.filt_h - 1) * sh.dil_h + 1, sh.out_h, out.h0, out.h1);
+    dependentRange(in.w0, in.w1, sh.stride_w, sh.pad_left, (sh.filt_w - 1) * sh.dil_w + 1, sh.out_w, out.w0, out.w1);
+    return out;
+}
+
+// The SIMD kernels run on a copy of the input window the region reads, with the padding filled in, so small regions
+// get the same kernels as whole images
+void ConvolutionalLayer::computeRegion(const LayerData& dataIn, const Region& region) const {
+    if (getLayout() != Layout::NHWC) throw std::runtime_error("Region inference needs NHWC activations");
+    if (region.empty()) return;
+    ConvShape sh = shapeOf(*this);
+    const fp32* in = dataIn.ptr<fp32>();
+    const fp32* weights = getWeightData().ptr<fp32>();
+    const fp32* bias = getBiasData().ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+
+    bool depthwise = isDepthwise() && sh.group_out == 1;
+    ConvShape sub = sh;
+    sub.out_h = region.h1 - region.h0;
+    sub.out_w = region.w1 - region.w0;
+    sub.in_h = (sub.out_h - 1) * sh.stride_h + (sh.filt_h - 1) * sh.dil_h + 1;
+    sub.in_w = (sub.out_w - 1) * sh.stride_w + (sh.filt_w - 1) * sh.dil_w + 1;
+    sub.pad_top = sub.pad_left = 0;
+
+    std::vector<fp32> window(sub.in_h * sub.in_w * sh.in_c), result(sub.out_h * sub.out_w * sh.out_c);
+    MemoryCharge charge(getMemory(), MemoryKind::SCRATCH, (window.size() + result.size()) * sizeof(fp32));
+    copyWindow(in, sh.in_h, sh.in_w, sh.in_c, (long)(region.h0 * sh.stride_h) - (long)sh.pad_top, (long)(region.w0 * sh.stride_w) - (long)sh.pad_left,
+               sub.in_h, sub.in_w, 0.0f, window.data());
+    if (depthwise) {
+        Kernels::active().depthwise(sub, window.data(), weights, bias, result.data());
+    } else {
+        Kernels::active().conv(sub, window.data(), weights, bias, result.data());
+    }
+
+    for (size_t p = 0; p < sub.out_h; p++) {
+        std::memcpy(out + ((region.h0 + p) * sh.out_w + region.w0) * sh.out_c, result.data() + p * sub.out_w * sh.out_c, sub.out_w * sh.out_c * sizeof(fp32));
+    }
+}
+
 // --- Begin Student Code ---
 
 // Compute the convultion for the layer data
@@ -16,9 +226,9 @@ void ConvolutionalLayer::computeNaive(const LayerData& dataIn) const {
     const LayerParams& weight_params = getWeightParams();
     // const LayerParams& bias_params = getBiasParams();
     const LayerParams& out_params = getOutputParams();
+    const ConvParams& conv_params = getConvParams();
 
     size_t batch_size = 1;
-    size_t stride = 1;
 
     size_t in_height  = in_params.dims[ParamIndex::HEIGHT];
     size_t in_width   = in_params.dims[ParamIndex::WIDTH];
@@ -30,9 +240,11 @@ void ConvolutionalLayer::computeNaive(const LayerData& dataIn) const {
 
     size_t filt_height = weight_params.dims[ParamIndex::HEIGHT];
     size_t filt_width = weight_params.dims[ParamIndex::WIDTH];
-    // Input channels is equal to filter channels
+    // Filter channels is the number of input channels in a group
     // Output channels is equal to the number of filters
-    // ie. 5 x 5 x in_dim[2] x out_dim[2]
+    // ie. 5 x 5 x (in_dim[2] / groups) x out_dim[2]
+    size_t group_in_chan  = in_chan / conv_params.groups;
+    size_t group_out_chan = out_chan / conv_params.groups;
 
     // Number of biases is also equal to number of output channels
 
@@ -42,6 +254,9 @@ void ConvolutionalLayer::computeNaive(const LayerData& dataIn) const {
         // For every output channel
         for(size_t m = 0; m < out_chan; m++)
         {
+            // Output channels only see the input channels of their group
+            size_t group = m / group_out_chan;
+
             // For every out height pixel
             for(size_t p = 0; p < out_height; p++)
             {
@@ -49,30 +264,35 @@ void ConvolutionalLayer::computeNaive(const LayerData& dataIn) const {
                 for(size_t q = 0; q < out_width; q++)
                 {
                     // Convert indices to flattened array. Following example in ML, out_data should be in form out_data[batch][height][width][chan]
-                    // Gotta be a way to access this like an array right?
                     size_t out_ind = n * out_height * out_width * out_chan + p * out_width * out_chan + q * out_chan + m;
 
                     fp32 weight_sum = 0;
 
-                    // For every input channel
-                    for(size_t c = 0; c < in_chan; c++)
+                    // For every input channel of the group
+                    for(size_t c = 0; c < group_in_chan; c++)
                     {
                         // For every filter height pixel
                         for(size_t r = 0; r < filt_height; r++)
                         {
+                            // Input row, skipping the zero padding
+                            long in_row = (long)(p * conv_params.strideH + r * conv_params.dilationH) - (long)conv_params.padTop;
+                            if(in_row < 0 || in_row >= (long)in_height) continue;
+
                             // For every filter width pixel
                             for(size_t s = 0; s < filt_width; s++)
                             {
+                                long in_col = (long)(q * conv_params.strideW + s * conv_params.dilationW) - (long)conv_params.padLeft;
+                                if(in_col < 0 || in_col >= (long)in_width) continue;
 
                                 // Convert indices to flattened array.
                                 // Following example in ML, in_data should be in form in_data[batch][height][width][chan]
                                 size_t in_ind = n * (in_height * in_width * in_chan) +
-                                                (stride * p + r) * (in_width * in_chan) +
-                                                (stride * q + s) * (in_chan) +
-                                                c;
+                                                in_row * (in_width * in_chan) +
+                                                in_col * (in_chan) +
+                                                group * group_in_chan + c;
 
-                                size_t f_ind = r * (filt_width * in_chan * out_chan) +
-                                               s * (in_chan * out_chan) +
+                                size_t f_ind = r * (filt_width * group_in_chan * out_chan) +
+                                               s * (group_in_chan * out_chan) +
                                                c * (out_chan) +
                                                m;
 
@@ -99,12 +319,58 @@ void ConvolutionalLayer::computeThreaded(const LayerData& dataIn) const {
 }
 
 // Compute the convolution using a tiled approach
+// Uses the shape specialized kernel when one is registered for this shape, otherwise
+// row tiles x output channel blocks, the weight slice of a block is reused across the whole tile
 void ConvolutionalLayer::computeTiled(const LayerData& dataIn) const {
-    // TODO: Your Code Here...
+    const size_t TILE_ROWS = 4;
+    const size_t CHANNEL_BLOCK = 32;
+
+    ConvShape sh = shapeOf(*this);
+    const fp32* in = dataIn.ptr<fp32>();
+    const fp32* weights = getWeightData().ptr<fp32>();
+    const fp32* bias = getBiasData().ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+
+    if (specializedKernel) {
+        specializedKernel(sh, in, weights, bias, out);
+        return;
+    }
+
+    for (size_t p0 = 0; p0 < sh.out_h; p0 += TILE_ROWS) {
+        size_t p_end = std::min(p0 + TILE_ROWS, sh.out_h);
+        if (isDepthwise() && sh.group_out == 1) {
+            for (size_t p = p0; p < p_end; p++) {
+                for (size_t q = 0; q < sh.out_w; q++) depthwisePixel(sh, in, weights, bias, out, p, q);
+            }
+            continue;
+        }
+        for (size_t m0 = 0; m0 < sh.out_c; m0 += CHANNEL_BLOCK) {
+            size_t m_end = std::min(m0 + CHANNEL_BLOCK, sh.out_c);
+            for (size_t p = p0; p < p_end; p++) {
+                for (size_t q = 0; q < sh.out_w; q++) convPixel(sh, in, weights, bias, out, p, q, m0, m_end);
+            }
+        }
+    }
 }
 
 // Compute the convolution using SIMD
+// Depthwise layers vectorize across channels (memory bound, no reduction), other layers accumulate register blocks
+// of output channels (group by group), or of output pixels in a blocked layout. All use the kernel level picked at
+// runtime (kernels/)
 void ConvolutionalLayer::computeSIMD(const LayerData& dataIn) const {
-    // TODO: Your Code Here...
+    ConvShape sh = shapeOf(*this);
+    const fp32* in = dataIn.ptr<fp32>();
+    const fp32* weights = getWeightData().ptr<fp32>();
+    const fp32* bias = getBiasData().ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+    const Kernels::KernelTable& kernels = Kernels::active();
+
+    if (getLayout() != Layout::NHWC) {
+        kernels.convBlocked(sh, channelBlock(getLayout()), in, blockedWeights->ptr<fp32>(), bias, out);
+    } else if (isDepthwise() && sh.group_out == 1) {
+        kernels.depthwise(sh, in, weights, bias, out);
+    } else {
+        kernels.conv(sh, in, weights, bias, out);
+    }
 }
 }  // namespace ML
@@ -2,23 +2,54 @@
 
 #include "../Types.h"
 #include "../Utils.h"
+#include "ConvKernels.h"
 #include "Layer.h"
 
 namespace ML {
+
+// Convolution attributes. The defaults (stride 1, no padding, no dilation, one group) are a plain valid convolution
+struct ConvParams {
+    // SAME pads so that out = ceil(in / stride), the explicit padding values are then computed by the layer
+    enum class Padding { EXPLICIT, SAME };
+
+    ConvParams() : ConvParams(1) {}
+    ConvParams(const std::size_t stride, const std::size_t padding = 0, const std::size_t dilation = 1, const std::size_t groups = 1)
+        : strideH(stride), strideW(stride), padTop(padding), padBottom(padding), padLeft(padding), padRight(padding),
+          dilationH(dilation), dilationW(dilation), groups(groups), padding(Padding::EXPLICIT) {}
+
+    // SAME padding with the given stride/dilation
+    static ConvParams same(const std::size_t stride = 1, const std::size_t dilation = 1, const std::size_t groups = 1) {
+        ConvParams p(stride, 0, dilation, groups);
+        p.padding = Padding::SAME;
+        return p;
+    }
+
+    // Depthwise convolution (one group per input channel)
+    static ConvParams depthwise(const std::size_t inChannels, const std::size_t stride = 1, const std::size_t padding = 0) {
+        return ConvParams(stride, padding, 1, inChannels);
+    }
+
+    std::size_t strideH, strideW;
+    std::size_t padTop, padBottom, padLeft, padRight;
+    std::size_t dilationH, dilationW;
+    std::size_t groups;
+    Padding padding;
+};
+
 class ConvolutionalLayer : public Layer {
    public:
-    ConvolutionalLayer(const LayerParams inParams, const LayerParams outParams, const LayerParams weightParams, const LayerParams biasParams)
-        : Layer(inParams, outParams, LayerType::CONVOLUTIONAL),
-          weightParam(weightParams),
-          weightData(weightParams),
-          biasParam(biasParams),
-          biasData(biasParams) {}
+    // Weights are [filter height][filter width][input channels / groups][output channels]
+    ConvolutionalLayer(const LayerParams inParams, const LayerParams outParams, const LayerParams weightParams, const LayerParams biasParams,
+                       const ConvParams convParams = ConvParams());
 
     // Getters
     const LayerParams& getWeightParams() const { return weightParam; }
     const LayerParams& getBiasParams() const { return biasParam; }
     const LayerData& getWeightData() const { return weightData; }
     const LayerData& getBiasData() const { return biasData; }
+    const ConvParams& getConvParams() const { return convParam; }
+    bool hasSpecializedKernel() const { return specializedKernel != nullptr; }
+    bool isDepthwise() const { return convParam.groups > 1 && convParam.groups == getInputParams().dims[ParamIndex::CHANNELS]; }
 
     // Allocate all resources needed for the layer & Load all of the required data for the layer
     virtual void allocLayer() override {
@@ -32,8 +63,33 @@ class ConvolutionalLayer : public Layer {
         Layer::freeLayer();
         weightData.freeData();
         biasData.freeData();
+        blockedWeights.reset();
     }
 
+    virtual void localizeBuffers() override {
+        Layer::localizeBuffers();
+        weightData.localize();
+        biasData.localize();
+        if (blockedWeights) blockedWeights->localize();
+    }
+
+    virtual void setWeightAllocator(Allocator& alloc) override {
+        weightAllocator = &alloc;
+        weightData.setAllocator(alloc);
+        biasData.setAllocator(alloc);
+    }
+
+    // Ungrouped layers whose channels fill whole blocks run the SIMD backend in the kernel level's blocked layout
+    virtual std::vector<Layout> supportedLayouts(const InfType infType) const override;
+
+    // A blocked layout needs the weights regrouped per output channel block, so the weights must be loaded
+    virtual void setLayout(const Layout newLayout) override;
+
+    // Output pixels only read their receptive field, so a changed input region maps to an output region
+    virtual bool supportsRegions() const override { return true; }
+    virtual Region outputRegion(const Region& in) const override;
+    virtual void computeRegion(const LayerData& dataIn, const Region& region) const override;
+
     // Virtual functions
     virtual void computeNaive(const LayerData& dataIn) const override;
     virtual void computeThreaded(const LayerData& dataIn) const override;
@@ -46,6 +102,13 @@ class ConvolutionalLayer : public Layer {
 
     LayerParams biasParam;
     LayerData biasData;
+
+    ConvParams convParam;
+    ConvKernelFn specializedKernel = nullptr;  // Shape specialized instance from ConvKernelRegistry, if any
+
+    // Weights as [out channels / block][height][width][in channels][block] for a blocked layout
+    std::unique_ptr<LayerData> blockedWeights;
+    Allocator* weightAllocator = nullptr;  // nullptr uses the default allocator
 };
 
-}  // namespace ML
\ No newline at end of file
+}  // namespace ML
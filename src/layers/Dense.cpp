@@ -1,9 +1,12 @@
 #include "Dense.h"
 
+#include <cmath>
 #include <iostream>
 
+#include "../LinAlg.h"
 #include "../Types.h"
 #include "../Utils.h"
+#include "../kernels/Kernels.h"
 #include "Layer.h"
 
 namespace ML {
@@ -21,6 +24,11 @@ void DenseLayer::computeNaive(const LayerData& dataIn) const {
 
     size_t out_chan   = out_params.dims[0];
 
+    if (isLowRank()) {
+        computeLowRankNaive(dataIn);
+        return;
+    }
+
     // for every batch Basically due a matrix multiply by our vector input including bias and activation function
     for(size_t n = 0; n < batch_size; n++)
     {
@@ -54,6 +62,181 @@ void DenseLayer::computeNaive(const LayerData& dataIn) const {
     }
 }
 
+// Compute the fully connected layer through the rank-r factors: out = (in * A) * B + bias
+void DenseLayer::computeLowRankNaive(const LayerData& dataIn) const {
+    TensorView<const fp32> a = factorA->view<fp32>();
+    TensorView<const fp32> b = factorB->view<fp32>();
+    const fp32* in = dataIn.ptr<fp32>();
+    const fp32* bias = getBiasData().ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+
+    size_t in_chan  = a.dim(0);
+    size_t rank     = a.dim(1);
+    size_t out_chan = b.dim(1);
+
+    // Project the input onto the rank-r subspace
+    std::vector<fp32> proj(rank, 0.0f);
+    MemoryCharge charge(getMemory(), MemoryKind::SCRATCH, rank * sizeof(fp32));
+    for (size_t c = 0; c < in_chan; c++) {
+        for (size_t k = 0; k < rank; k++) {
+            proj[k] += in[c] * a(c, k);
+        }
+    }
+
+    // Expand back to the output channels
+    for (size_t m = 0; m < out_chan; m++) {
+        fp32 sum = bias[m];
+        for (size_t k = 0; k < rank; k++) {
+            sum += proj[k] * b(k, m);
+        }
+
+        if (use_relu && sum < 0) sum = 0;
+        out[m] = sum;
+    }
+}
+
+// Compute the eigen decomposition of W^T W, giving the right singular vectors and squared singular values of W
+void DenseLayer::computeSpectrum() {
+    if (!spectrum.empty()) return;
+    if (!weightData.isAlloced()) throw std::runtime_error("Dense weights must be loaded before they can be factorized");
+
+    size_t in_chan  = weightParam.dims[0];
+    size_t out_chan = weightParam.dims[1];
+
+    // The Gram matrix and the solver's rotation basis, both out x out
+    MemoryCharge workspace(getMemory(), MemoryKind::SCRATCH, 2 * out_chan * out_chan * sizeof(fp64));
+    std::vector<fp64> gram;
+    LinAlg::gram(weightData.ptr<fp32>(), in_chan, out_chan, gram);
+    LinAlg::symmetricEigen(gram, out_chan, spectrum, rightVectors);
+
+    // Round off can leave tiny negative eigenvalues
+    for (fp64& e : spectrum) e = std::max(e, 0.0);
+    spectrumCharge = MemoryCharge(getMemory(), MemoryKind::SCRATCH, (spectrum.capacity() + rightVectors.capacity()) * sizeof(fp64));
+}
+
+// Smallest rank that keeps `energy` of the spectrum
+std::size_t DenseLayer::rankForEnergy(const fp32 energy) {
+    computeSpectrum();
+
+    fp64 total = 0;
+    for (fp64 e : spectrum) total += e;
+    if (total == 0) return 1;
+
+    fp64 kept = 0;
+    for (size_t r = 0; r < getMaxRank(); r++) {
+        kept += spectrum[r];
+        if (kept >= energy * total) return r + 1;
+    }
+    return getMaxRank();
+}
+
+// Similarity grows with rank, so binary search for the smallest rank within budget
+std::size_t DenseLayer::tuneRank(const LayerData& input, const LayerData& expected, const fp32 minSimilarity) {
+    if (!expected.getParams().isCompatible(getOutputParams())) throw std::runtime_error("The reference output does not match the dense layer");
+
+    std::size_t lo = 1, hi = getMaxRank();
+    while (lo < hi) {
+        std::size_t mid = (lo + hi) / 2;
+        factorize(mid);
+        computeNaive(input);
+        if (getOutputData().compare<fp32>(expected) >= minSimilarity) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    return factorize(lo);
+}
+
+// Factorize the loaded weights: A = W * V_r (in x r), B = V_r^T (r x out)
+std::size_t DenseLayer::factorize(std::size_t rank) {
+    computeSpectrum();
+    rank = clamp<std::size_t>(rank, 1, getMaxRank());
+
+    size_t in_chan  = weightParam.dims[0];
+    size_t out_chan = weightParam.dims[1];
+
+    factorA.reset(new LayerData({sizeof(fp32), {in_chan, rank}}));
+    factorB.reset(new LayerData({sizeof(fp32), {rank, out_chan}}));
+    factorA->setAccount(&getMemory(), MemoryKind::PACKED);
+    factorB->setAccount(&getMemory(), MemoryKind::PACKED);
+    if (weightAllocator) {
+        factorA->setAllocator(*weightAllocator);
+        factorB->setAllocator(*weightAllocator);
+    }
+    factorA->allocData();
+    factorB->allocData();
+
+    for (size_t c = 0; c < in_chan; c++) {
+        for (size_t k = 0; k < rank; k++) {
+            fp64 sum = 0;
+            for (size_t m = 0; m < out_chan; m++) {
+                sum += (fp64)weightData.get<fp32>(c * out_chan + m) * rightVectors[m * out_chan + k];
+            }
+            factorA->get<fp32>(c * rank + k) = (fp32)sum;
+        }
+    }
+
+    for (size_t k = 0; k < rank; k++) {
+        for (size_t m = 0; m < out_chan; m++) {
+            factorB->get<fp32>(k * out_chan + m) = (fp32)rightVectors[m * out_chan + k];
+        }
+    }
+
+    return rank;
+}
+
+// Drop the full weight matrix and spectrum, leaving only the factors
+void DenseLayer::releaseFullWeights() {
+    if (!isLowRank()) throw std::runtime_error("Cannot release the dense weights of a layer that is not factorized");
+    weightData.freeData();
+    spectrum.clear();
+    spectrum.shrink_to_fit();
+    rightVectors.clear();
+    rightVectors.shrink_to_fit();
+    spectrumCharge.reset();
+}
+
+// Go back to the full weight matrix
+void DenseLayer::clearLowRank() {
+    resetLowRank();
+    if (!weightData.isAlloced()) weightData.loadData();
+}
+
+void DenseLayer::resetLowRank() {
+    factorA.reset();
+    factorB.reset();
+    spectrum.clear();
+    spectrum.shrink_to_fit();
+    rightVectors.clear();
+    rightVectors.shrink_to_fit();
+    spectrumCharge.reset();
+}
+
+// Apply the factorization requested through setLowRank()
+void DenseLayer::applyLowRankConfig() {
+    if (lowRankRank > 0) {
+        factorize(lowRankRank);
+    } else if (lowRankEnergy < 1.0f) {
+        factorize(rankForEnergy(lowRankEnergy));
+    } else {
+        return;
+    }
+    releaseFullWeights();
+}
+
+std::size_t DenseLayer::weightBytes() const {
+    if (isLowRank()) return factorA->getParams().byte_size() + factorB->getParams().byte_size();
+    return weightParam.byte_size();
+}
+
+std::size_t DenseLayer::macCount() const {
+    size_t in_chan  = weightParam.dims[0];
+    size_t out_chan = weightParam.dims[1];
+    if (isLowRank()) return getRank() * (in_chan + out_chan);
+    return in_chan * out_chan;
+}
+
 // Compute the filly connected layer using threads
 void DenseLayer::computeThreaded(const LayerData& dataIn) const {
     // TODO: Your Code Here...
@@ -65,7 +248,24 @@ void DenseLayer::computeTiled(const LayerData& dataIn) const {
 }
 
 // Compute the fully connected layer using SIMD
+// A GEMV with register blocks of output channels (kernels/, level picked at runtime), the low-rank path is two of them
 void DenseLayer::computeSIMD(const LayerData& dataIn) const {
-    // TODO: Your Code Here...
+    const Kernels::KernelTable& kernels = Kernels::active();
+    const fp32* in = dataIn.ptr<fp32>();
+    const fp32* bias = getBiasData().ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+    size_t out_chan = getOutputParams().dims[0];
+
+    if (isLowRank()) {
+        size_t in_chan = factorA->getParams().dims[0];
+        size_t rank = factorA->getParams().dims[1];
+        std::vector<fp32> proj(rank);
+        MemoryCharge charge(getMemory(), MemoryKind::SCRATCH, rank * sizeof(fp32));
+        kernels.dense(in, factorA->ptr<fp32>(), nullptr, proj.data(), in_chan, rank, false);
+        kernels.dense(proj.data(), factorB->ptr<fp32>(), bias, out, rank, out_chan, use_relu);
+        return;
+    }
+
+    kernels.dense(in, getWeightData().ptr<fp32>(), bias, out, getInputParams().dims[0], out_chan, use_relu);
 }
 }  // namespace ML
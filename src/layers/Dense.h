@@ -1,5 +1,9 @@
 #pragma once
 
+#include <algorithm>
+#include <memory>
+#include <vector>
+
 #include "../Types.h"
 #include "../Utils.h"
 #include "Layer.h"
@@ -13,7 +17,10 @@ class DenseLayer : public Layer {
           weightData(weightParams),
           biasParam(biasParams),
           biasData(biasParams),
-          use_relu(use_relu) {}
+          use_relu(use_relu) {
+        weightData.setAccount(&getMemory(), MemoryKind::WEIGHTS);
+        biasData.setAccount(&getMemory(), MemoryKind::BIASES);
+    }
 
     // Getters
     const LayerParams& getWeightParams() const { return weightParam; }
@@ -26,6 +33,7 @@ class DenseLayer : public Layer {
         Layer::allocLayer();
         weightData.loadData();
         biasData.loadData();
+        applyLowRankConfig();
     }
 
     // Fre all resources allocated for the layer
@@ -33,8 +41,56 @@ class DenseLayer : public Layer {
         Layer::freeLayer();
         weightData.freeData();
         biasData.freeData();
+        resetLowRank();
     }
 
+    virtual void localizeBuffers() override {
+        Layer::localizeBuffers();
+        weightData.localize();
+        biasData.localize();
+        if (factorA) factorA->localize();
+        if (factorB) factorB->localize();
+    }
+
+    virtual void setWeightAllocator(Allocator& alloc) override {
+        weightAllocator = &alloc;
+        weightData.setAllocator(alloc);
+        biasData.setAllocator(alloc);
+    }
+
+    // --- Low-rank factorization (W ~= A * B, A is in x r, B is r x out) ---
+    // Request a factorization when the layer is allocated. A non-zero rank is used as is,
+    // otherwise the smallest rank keeping `energy` of the squared singular value spectrum is chosen.
+    // The full weight matrix is released once factorized
+    void setLowRank(const fp32 energy, const std::size_t rank = 0) {
+        lowRankEnergy = energy;
+        lowRankRank = rank;
+    }
+
+    // Factorize the loaded weights to the given rank (clamped to [1, getMaxRank()]), returns the rank used
+    std::size_t factorize(std::size_t rank);
+
+    // Smallest rank that keeps `energy` (0, 1] of the spectrum
+    std::size_t rankForEnergy(const fp32 energy);
+
+    // Factorize to the smallest rank whose output for `input` keeps a similarity of at least `minSimilarity` to
+    // `expected` (a reference output of the full layer), returns that rank. The full weights are kept
+    std::size_t tuneRank(const LayerData& input, const LayerData& expected, const fp32 minSimilarity);
+
+    // Drop the full weight matrix and spectrum, leaving only the factors
+    void releaseFullWeights();
+
+    // Go back to the full weight matrix (reloaded from disk if it was released)
+    void clearLowRank();
+
+    bool isLowRank() const { return factorA != nullptr; }
+    std::size_t getRank() const { return isLowRank() ? factorA->getParams().dims[1] : getMaxRank(); }
+    std::size_t getMaxRank() const { return std::min(weightParam.dims[0], weightParam.dims[1]); }
+
+    // Weight bytes and multiply-accumulates per inference with the current factorization
+    std::size_t weightBytes() const;
+    std::size_t macCount() const;
+
     // Virtual functions
     virtual void computeNaive(const LayerData& dataIn) const override;
     virtual void computeThreaded(const LayerData& dataIn) const override;
@@ -49,6 +105,21 @@ class DenseLayer : public Layer {
     LayerData biasData;
 
     bool use_relu;
+
+    // Low-rank state
+    void applyLowRankConfig();
+    void resetLowRank();
+    void computeSpectrum();
+    void computeLowRankNaive(const LayerData& dataIn) const;
+
+    fp32 lowRankEnergy = 1.0f;
+    std::size_t lowRankRank = 0;
+    std::vector<fp64> spectrum;      // Eigenvalues of W^T W (squared singular values), descending
+    std::vector<fp64> rightVectors;  // Right singular vectors V (out x out), column i pairs with spectrum[i]
+    MemoryCharge spectrumCharge;     // spectrum and rightVectors, charged as scratch while they are kept
+    std::unique_ptr<LayerData> factorA;
+    std::unique_ptr<LayerData> factorB;
+    Allocator* weightAllocator = nullptr;  // nullptr uses the default allocator
 };
 
 }  // namespace ML
\ No newline at end of file
@@ -5,28 +5,11 @@
 #include "Layer.h"
 
 namespace ML {
-class Flatten : public Layer {
+// NHWC activations are already stored in flattened order, so Flatten is a view of its input
+class Flatten : public ViewLayer {
    public:
     Flatten(const LayerParams inParams, const LayerParams outParams)
-        : Layer(inParams, outParams, LayerType::FLATTEN){}
-
-    // Allocate all resources needed for the layer & Load all of the required data for the layer
-    virtual void allocLayer() override {
-        Layer::allocLayer();
-    }
-
-    // Fre all resources allocated for the layer
-    virtual void freeLayer() override {
-        Layer::freeLayer();
-    }
-
-    // Virtual functions
-    virtual void computeNaive(const LayerData& dataIn) const override;
-    virtual void computeThreaded(const LayerData& dataIn) const override;
-    virtual void computeTiled(const LayerData& dataIn) const override;
-    virtual void computeSIMD(const LayerData& dataIn) const override;
-
-   private:
+        : ViewLayer(inParams, outParams, LayerType::FLATTEN){}
 };
 
-}  // namespace ML
\ No newline at end of file
+}  // namespace ML
@@ -1,10 +1,17 @@
 #include "Layer.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cmath>
 #include <iostream>
 #include <vector>
 
+#ifndef ZEDBOARD
+#include <thread>
+#endif
+
 #include "../Utils.h"
+#include "../kernels/Kernels.h"
 
 namespace ML {
 // Ensure that Layer params are compatible
@@ -22,4 +29,59 @@ bool LayerParams::isCompatible(const LayerParams& params) const {
 // Ensure that data being inputted is of the correct size and shape that the layer expects
 bool Layer::checkDataInputCompatibility(const LayerData& data) const { return inParams.isCompatible(data.getParams()); }
 
+// Arrays smaller than this are compared on the calling thread, starting threads costs more than the pass
+static const std::size_t PARALLEL_COMPARE_MIN = 1 << 20;
+
+CompareResult LayerData::compareResult(const LayerData& other) const {
+    checkComparable(other);
+    if (params.elementSize != sizeof(fp32)) throw std::runtime_error("compareResult needs fp32 LayerData");
+
+    const Kernels::KernelTable& kernels = Kernels::active();
+    const fp32* a = ptr<fp32>();
+    const fp32* b = other.ptr<fp32>();
+    std::size_t count = params.flat_count();
+
+    std::size_t chunks = 1;
+#ifndef ZEDBOARD
+    if (count >= PARALLEL_COMPARE_MIN) chunks = std::min<std::size_t>(std::max(std::thread::hardware_concurrency(), 1u), count / (PARALLEL_COMPARE_MIN / 4));
+#endif
+
+    // Chunks are merged in order, so the worst element is the first one with the largest difference as in one pass
+    std::vector<CompareSums> sums(chunks, CompareSums{0, 0, 0, 0, 0, 0});
+    std::size_t chunkSize = (count + chunks - 1) / chunks;
+    auto run = [&](std::size_t c) {
+        std::size_t first = std::min(c * chunkSize, count);
+        kernels.compare(a + first, b + first, std::min(chunkSize, count - first), first, sums[c]);
+    };
+#ifndef ZEDBOARD
+    std::vector<std::thread> threads;
+    for (std::size_t c = 1; c < chunks; c++) threads.emplace_back(run, c);
+    run(0);
+    for (std::thread& thread : threads) thread.join();
+#else
+    run(0);
+#endif
+
+    CompareSums total = sums[0];
+    for (std::size_t c = 1; c < chunks; c++) {
+        total.dot += sums[c].dot;
+        total.a_sq += sums[c].a_sq;
+        total.b_sq += sums[c].b_sq;
+        total.diff_sq += sums[c].diff_sq;
+        bool nan = sums[c].max_diff != sums[c].max_diff;
+        if (total.max_diff == total.max_diff && (nan || sums[c].max_diff > total.max_diff)) {
+            total.max_diff = sums[c].max_diff;
+            total.worst = sums[c].worst;
+        }
+    }
+
+    CompareResult result;
+    result.zeroMagnitude = total.a_sq == 0 && total.b_sq == 0;
+    result.cosine = result.zeroMagnitude ? 0 : total.dot / std::max(total.a_sq, total.b_sq);
+    result.maxAbsDiff = total.max_diff;
+    result.rmse = count ? std::sqrt(total.diff_sq / count) : 0;
+    result.worstIndex = total.worst;
+    return result;
+}
+
 }  // namespace ML
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <vector>
 #include <cstring>
 #include <memory>
 #include <sstream>
 
+#include "../Allocator.h"
 #include "../Config.h"
+#include "../Layout.h"
+#include "../Memory.h"
+#include "../TensorView.h"
 #include "../Utils.h"
 #include "../Types.h"
 
@@ -40,64 +45,161 @@ class LayerParams {
     }
 
    public:
-    const std::size_t elementSize;
-    const std::vector<std::size_t> dims;
-    const Path filePath;
+    std::size_t elementSize;
+    std::vector<std::size_t> dims;
+    Path filePath;
+};
+
+// Everything LayerData::compareResult measures, from one pass over both arrays
+struct CompareResult {
+    float cosine;           // Length weighted cosine similarity (LayerData::compare)
+    float maxAbsDiff;       // Largest |a - b|, NaN if any difference is NaN
+    float rmse;             // Root mean square of a - b
+    std::size_t worstIndex; // First flat element with the largest difference
+    bool zeroMagnitude;     // Both arrays are all zero, cosine is 0
 };
 
 // Output data container of a layer inference
 class LayerData {
    public:
-    inline LayerData(const LayerParams& params) : params(params) {}
-    inline LayerData(const LayerParams& params, const Path path) : params(params.elementSize, params.dims, path) {}
+    inline LayerData(const LayerParams& params) : params(params), data(nullptr, BufferDeleter()) {}
+    inline LayerData(const LayerParams& params, const Path path) : params(params.elementSize, params.dims, path), data(nullptr, BufferDeleter()) {}
 
-    inline LayerData(const LayerData& other) : params(other.params) {
+    inline LayerData(const LayerData& other) : params(other.params), data(nullptr, BufferDeleter()), allocator(other.allocator) {
         allocData();
-        std::memcpy(data.get(), other.data.get(), params.byte_size());
+        std::memcpy(buffer, other.buffer, params.byte_size());
+    }
+
+    // Moves hand over the buffer (owned or aliased), nothing is copied. The buffer stays charged to the account it
+    // was allocated under
+    inline LayerData(LayerData&& other) noexcept
+        : params(std::move(other.params)), data(std::move(other.data)), buffer(other.buffer), allocator(other.allocator),
+          account(other.account), kind(other.kind) {
+        other.buffer = nullptr;
+    }
+
+    inline LayerData& operator=(LayerData&& other) noexcept {
+        if (this == &other) return *this;
+        params = std::move(other.params);
+        data = std::move(other.data);
+        buffer = other.buffer;
+        allocator = other.allocator;
+        account = other.account;
+        kind = other.kind;
+        other.buffer = nullptr;
+        return *this;
     }
 
-    inline bool isAlloced() const { return data != nullptr; }
+    // The copy is charged to this object's account, copy construction charges the process (setAccount)
+    inline LayerData& operator=(const LayerData& other) {
+        if (this == &other) return *this;
+        LayerData copy(other.params);
+        copy.allocator = other.allocator;
+        copy.account = account;
+        copy.kind = kind;
+        copy.allocData();
+        std::memcpy(copy.buffer, other.buffer, other.params.byte_size());
+        return *this = std::move(copy);
+    }
+
+    inline bool isAlloced() const { return buffer != nullptr; }
+    inline bool isView() const { return buffer != nullptr && !data; }
     inline const LayerParams& getParams() const { return params; }
-    inline const void* raw() const { return data.get(); }
-    inline void* raw() { return data.get(); }
+    inline const void* raw() const { return buffer; }
+    inline void* raw() { return buffer; }
 
+    // Typed pointers to the buffer
+    template <typename T> T* ptr() {
+        if (Config::BOUNDS_CHECK) elementSizeCheck<T>();
+        return (T*)buffer;
+    }
+    template <typename T> const T* ptr() const {
+        if (Config::BOUNDS_CHECK) elementSizeCheck<T>();
+        return (const T*)buffer;
+    }
 
-    template <typename T> void boundsCheck(unsigned int flat_index) const {
+    // Typed non-owning views with the data's shape
+    template <typename T> TensorView<T> view() { return TensorView<T>(ptr<T>(), params.dims); }
+    template <typename T> TensorView<const T> view() const { return TensorView<const T>(ptr<T>(), params.dims); }
+
+
+    // Throws if T does not match the element size
+    template <typename T> void elementSizeCheck() const {
         if (sizeof(T) != params.elementSize) {
             std::ostringstream oss;
-            oss << "Accessing LayerData with incorrect element size in `" << params.filePath << "` (" << params.dims[0];
-            for (size_t i = 1; i < params.dims.size(); i++) {
-                oss << ", " << params.dims[i];
-            }
-            oss << "), accessed by size " << sizeof(T) << ", but elementSize is " << params.elementSize << ".\n";
+            oss << "Accessing LayerData with incorrect element size in `" << params.filePath << "` (" << dimString()
+                << "), accessed by size " << sizeof(T) << ", but elementSize is " << params.elementSize << ".\n";
             throw std::runtime_error(oss.str());
         }
+    }
+
+    // Throws if T does not match the element size or the index is out of bounds
+    template <typename T> void boundsCheck(unsigned int flat_index) const {
+        elementSizeCheck<T>();
         if (flat_index >= params.flat_count()) {
             std::ostringstream oss;
-            oss << "Index out of bounds in `" << params.filePath << "` (" << params.dims[0];
-            for (size_t i = 1; i < params.dims.size(); i++) {
-                oss << ", " << params.dims[i];
-            }
-            oss << "), accessed element " << flat_index << ", but there are only " << flat_index << " elements.\n";
+            oss << "Index out of bounds in `" << params.filePath << "` (" << dimString() << "), accessed element " << flat_index
+                << ", but there are only " << params.flat_count() << " elements.\n";
             throw std::runtime_error(oss.str());
         }
     }
 
     // Get the data pointer and cast it
+    // Checked only in builds with Config::BOUNDS_CHECK, release builds compile the check away
     template <typename T> T& get(unsigned int flat_index) {
-        // boundsCheck<T>(flat_index);
-        return ((T*)data.get())[flat_index];
+        if (Config::BOUNDS_CHECK) boundsCheck<T>(flat_index);
+        return ((T*)buffer)[flat_index];
     }
 
     template <typename T> T get(unsigned int flat_index) const {
-        // boundsCheck<T>(flat_index);
-        return ((T*)data.get())[flat_index];
+        if (Config::BOUNDS_CHECK) boundsCheck<T>(flat_index);
+        return ((T*)buffer)[flat_index];
     }
 
+    // Memory backing for the buffer, takes effect on the next allocation (defaults to Allocator::getDefault())
+    inline void setAllocator(Allocator& alloc) { allocator = &alloc; }
+
     // Allocate data values
     inline void allocData() {
         if (data) return;
-        data.reset((char*)(new ui64[(params.byte_size() + 7)/8])); // Assume elementSize <= sizeof(u64) for alignment
+        Allocator& alloc = allocator ? *allocator : Allocator::getDefault();
+        MemoryAccount& owner = account ? *account : MemoryAccount::process();
+        const std::size_t bytes = params.byte_size(), reserved = alloc.footprint(bytes);
+        data = std::unique_ptr<char, BufferDeleter>((char*)alloc.allocate(bytes), BufferDeleter{&alloc, bytes, &owner, kind, reserved});
+        owner.charge(kind, bytes, reserved);
+        buffer = data.get();
+    }
+
+    // Charge the buffer to `owner` (nullptr for the process account) as `newKind`, now and whenever it is reallocated
+    inline void setAccount(MemoryAccount* owner, const MemoryKind newKind) {
+        account = owner;
+        kind = newKind;
+        if (!data) return;
+        BufferDeleter& deleter = data.get_deleter();
+        MemoryAccount& now = owner ? *owner : MemoryAccount::process();
+        deleter.account->release(deleter.kind, deleter.bytes, deleter.reserved);
+        now.charge(newKind, deleter.bytes, deleter.reserved);
+        deleter.account = &now;
+        deleter.kind = newKind;
+    }
+
+    // Reinterpret another LayerData's buffer with this object's dims, nothing is allocated or copied
+    // Any owned buffer is released. The view is only valid while `other` keeps the same buffer
+    inline void aliasData(const LayerData& other) {
+        if (other.params.byte_size() != params.byte_size()) {
+            throw std::runtime_error("A LayerData view must cover the same number of bytes as the data it aliases");
+        }
+        data.reset();
+        buffer = other.buffer;
+    }
+
+    // Copy an owned buffer into a new allocation made by the calling thread. Pages are placed on first touch, so this
+    // moves the data to the NUMA node of the thread that uses it. Views and unallocated data are left alone
+    inline void localize() {
+        if (!data) return;
+        LayerData copy(*this);
+        copy.setAccount(account, kind);
+        *this = std::move(copy);
     }
 
     // Load data values
@@ -106,13 +208,17 @@ class LayerData {
 
     // Clean up data values
     inline void freeData() {
-        if (!data) return;
+        buffer = nullptr;
         data.reset();
     }
 
     // Get the max difference between two Layer Data arrays
     template <typename T> float compare(const LayerData& other) const;
 
+    // Cosine similarity, max difference, RMSE and the worst element of two fp32 arrays in a single vectorized pass
+    // (split over threads for large arrays). Throws like compare if the shapes differ
+    CompareResult compareResult(const LayerData& other) const;
+
     // Compare within an Epsilon to ensure layer datas are similar within reason
     template <typename T, typename T_EP = float> bool compareWithin(const LayerData& other, const T_EP epsilon = Config::EPSILON) const;
 
@@ -120,10 +226,82 @@ class LayerData {
     template <typename T, typename T_EP = float> bool compareWithinPrint(const LayerData& other, const T_EP epsilon = Config::EPSILON) const;
 
    private:
+    // Throws unless both arrays have the same element size and dims
+    void checkComparable(const LayerData& other) const {
+        const LayerParams& aParams = params;
+        const LayerParams& bParams = other.params;
+
+        // Warn if we are not comparing the same data type
+        if (aParams.elementSize != bParams.elementSize) {
+            throw std::runtime_error("Comparison between two LayerData arrays with different element size (and possibly data types) is not advised (" + std::to_string(aParams.elementSize)
+                      + " and " + std::to_string(bParams.elementSize) + ")\n");
+        }
+        if (aParams.dims.size() != bParams.dims.size()) {
+            throw std::runtime_error("LayerData arrays must have the same number of dimentions");
+        }
+
+        // Ensure each dimention size matches
+        for (std::size_t i = 0; i < aParams.dims.size(); i++) {
+            if (aParams.dims[i] != bParams.dims[i]) {
+                throw std::runtime_error("LayerData arrays must have the same size dimentions to be compared");
+            }
+        }
+    }
+
+    // "d0, d1, ..." for error messages
+    std::string dimString() const {
+        std::ostringstream oss;
+        for (size_t i = 0; i < params.dims.size(); i++) oss << (i ? ", " : "") << params.dims[i];
+        return oss.str();
+    }
+
+    // Returns an owned buffer to the allocator it came from and releases its charge
+    struct BufferDeleter {
+        Allocator* allocator;
+        std::size_t bytes;
+        MemoryAccount* account;
+        MemoryKind kind;
+        std::size_t reserved;
+        void operator()(char* ptr) const {
+            allocator->deallocate(ptr, bytes);
+            account->release(kind, bytes, reserved);
+        }
+    };
+
     LayerParams params;
-    std::unique_ptr<char[]> data;
+    std::unique_ptr<char, BufferDeleter> data;  // Owned storage, empty for views
+    char* buffer = nullptr;                     // Active buffer, either data or an aliased one
+    Allocator* allocator = nullptr;             // nullptr uses the default allocator
+    MemoryAccount* account = nullptr;           // nullptr charges the process account
+    MemoryKind kind = MemoryKind::ACTIVATIONS;
 };
 
+// Spatial rectangle of an activation, rows [h0, h1) x columns [w0, w1), all channels
+struct Region {
+    std::size_t h0, h1, w0, w1;
+
+    bool empty() const { return h0 >= h1 || w0 >= w1; }
+    std::size_t area() const { return empty() ? 0 : (h1 - h0) * (w1 - w0); }
+};
+
+// Outputs of a window `span` wide sliding `stride` apart over `in` inputs with `pad` padding in total (both sides
+// together), 0 when the window does not fit. Shared by the layers, the model loader and the verifier
+inline std::size_t windowOutputSize(const std::size_t in, const std::size_t pad, const std::size_t span, const std::size_t stride) {
+    return in + pad < span ? 0 : (in + pad - span) / stride + 1;
+}
+
+// Outputs [begin, end) of a sliding window along one dimension (window `span` wide, `stride` apart, starting `pad`
+// before the input) that read any of the inputs [in_begin, in_end)
+inline void dependentRange(const std::size_t in_begin, const std::size_t in_end, const std::size_t stride, const std::size_t pad,
+                           const std::size_t span, const std::size_t out, std::size_t& begin, std::size_t& end) {
+    begin = end = 0;
+    if (in_end <= in_begin) return;
+    long first = (long)in_begin + (long)pad - (long)span + 1;
+    begin = first <= 0 ? 0 : std::min(out, (std::size_t)(first + (long)stride - 1) / stride);
+    end = std::min(out, (in_end - 1 + pad) / stride + 1);
+    if (end < begin) end = begin;
+}
+
 // Base class all layers extend from
 class Layer {
    public:
@@ -136,7 +314,9 @@ class Layer {
    public:
     // Contructors
     Layer(const LayerParams inParams, const LayerParams outParams, LayerType lType)
-        : inParams(inParams), outParams(outParams), outData(outParams), lType(lType) {}
+        : inParams(inParams), outParams(outParams), outData(outParams), lType(lType) {
+        outData.setAccount(&memory, MemoryKind::ACTIVATIONS);
+    }
     virtual ~Layer() {}
 
 
@@ -146,8 +326,47 @@ class Layer {
     LayerData& getOutputData() const { return outData; }
     LayerType getLType() const { return lType; }
     bool isOutputBufferAlloced() const { return outData.isAlloced(); }
+
+    // Bytes held by the layer's buffers (output, weights, biases, prepacked copies), charged to the owning model
+    MemoryAccount& getMemory() const { return memory; }
     bool checkDataInputCompatibility(const LayerData& data) const;
 
+    // Whether the output is a view of the input buffer instead of an allocated buffer
+    virtual bool isView() const { return false; }
+
+    // Activation layouts the layer can compute in for an inference type, fastest first. Input and output
+    // share the layout. Anything but NHWC is only used by the SIMD backends
+    virtual std::vector<Layout> supportedLayouts(const InfType infType) const { return {Layout::NHWC}; }
+
+    // Layers that run equally fast in every supported layout (e.g. pooling) keep their producer's layout
+    virtual bool isLayoutTransparent() const { return false; }
+
+    // Layout the SIMD backend computes in, set by the model's layout plan (Model::planLayouts)
+    Layout getLayout() const { return layout; }
+    virtual void setLayout(const Layout newLayout) { layout = newLayout; }
+
+    // Layout of the input and output data when computing with an inference type
+    Layout layoutFor(const InfType infType) const {
+        for (Layout l : supportedLayouts(infType)) {
+            if (l == layout) return layout;
+        }
+        return Layout::NHWC;
+    }
+
+    // --- Delta inference (DeltaInference) ---
+    // Spatial layers that can recompute part of their NHWC output in place
+    virtual bool supportsRegions() const { return false; }
+
+    // Output region whose values depend on the input region `in`
+    virtual Region outputRegion(const Region& in) const {
+        return {0, outParams.dims[ParamIndex::HEIGHT], 0, outParams.dims[ParamIndex::WIDTH]};
+    }
+
+    // Recompute the output pixels of `region` from NHWC input, the rest of the output keeps its values
+    virtual void computeRegion(const LayerData& dataIn, const Region& region) const {
+        throw std::runtime_error("Layer does not support region inference");
+    }
+
     // Abstract/Virtual Functions
     virtual void allocLayer() {
         outData.allocData();
@@ -157,6 +376,16 @@ class Layer {
         outData.freeData();
     }
 
+    // Move the output buffer and any weights to the calling thread's NUMA node (LayerData::localize), called by the
+    // thread that computes the layer before its first inference
+    virtual void localizeBuffers() {
+        outData.localize();
+    }
+
+    // Memory backing for the weights and biases and the copies made from them, used from their next allocation. Keeps
+    // large read-only buffers apart from the activations, e.g. interleaved over the NUMA nodes (NumaAllocator)
+    virtual void setWeightAllocator(Allocator& alloc) {}
+
     virtual void computeNaive(const LayerData& dataIn) const = 0;
     virtual void computeThreaded(const LayerData& dataIn) const = 0;
     virtual void computeTiled(const LayerData& dataIn) const = 0;
@@ -166,9 +395,33 @@ class Layer {
     LayerParams inParams;
 
     LayerParams outParams;
+    // Declared before the buffers charged to it, so it is destroyed after them
+    mutable MemoryAccount memory;
     mutable LayerData outData;
 
     LayerType lType;
+    Layout layout = Layout::NHWC;
+};
+
+// Base class for layout preserving layers (reshapes such as Flatten)
+// The output is a view of the input buffer with the output dims, so there is no allocation and no copy.
+// The view follows the producer's buffer, it is only valid until that buffer is written or freed
+class ViewLayer : public Layer {
+   public:
+    ViewLayer(const LayerParams inParams, const LayerParams outParams, LayerType lType) : Layer(inParams, outParams, lType) {
+        if (inParams.byte_size() != outParams.byte_size()) throw std::runtime_error("A view layer must have the same input and output size");
+    }
+
+    // Nothing to allocate, the output is bound to the input when computed
+    virtual void allocLayer() override {}
+    virtual void freeLayer() override { getOutputData().freeData(); }
+
+    virtual bool isView() const override { return true; }
+
+    virtual void computeNaive(const LayerData& dataIn) const override { getOutputData().aliasData(dataIn); }
+    virtual void computeThreaded(const LayerData& dataIn) const override { getOutputData().aliasData(dataIn); }
+    virtual void computeTiled(const LayerData& dataIn) const override { getOutputData().aliasData(dataIn); }
+    virtual void computeSIMD(const LayerData& dataIn) const override { getOutputData().aliasData(dataIn); }
 };
 
 // Load data values
@@ -196,9 +449,9 @@ inline void LayerData::loadData(Path filePath) {
 
 #ifdef ZEDBOARD
     UINT bytes_read = 0;
-    if ((f_read(&file, data.get(), params.byte_size(), &bytes_read) != FR_OK) || (bytes_read != params.byte_size())) {
+    if ((f_read(&file, buffer, params.byte_size(), &bytes_read) != FR_OK) || (bytes_read != params.byte_size())) {
 #else
-    if (!file.read((char*)data.get(), params.byte_size())) {
+    if (!file.read(buffer, params.byte_size())) {
 #endif
         throw std::runtime_error("Failed to read file data");
     }
@@ -236,9 +489,9 @@ inline void LayerData::saveData(Path filePath) {
 
 #ifdef ZEDBOARD
     UINT bytes_written = 0;
-    if ((f_write(&file, data.get(), params.byte_size(), &bytes_written) != FR_OK) || (bytes_written != params.byte_size())) {
+    if ((f_write(&file, buffer, params.byte_size(), &bytes_written) != FR_OK) || (bytes_written != params.byte_size())) {
 #else
-    if (!file.read((char*)data.get(), params.byte_size())) {
+    if (!file.read(buffer, params.byte_size())) {
 #endif
         throw std::runtime_error("Failed to read file data");
     }
@@ -252,24 +505,7 @@ inline void LayerData::saveData(Path filePath) {
 
 // Get the max difference between two Layer Data arrays
 template <typename T> float LayerData::compare(const LayerData& other) const {
-    LayerParams aParams = getParams();
-    LayerParams bParams = other.getParams();
-
-    // Warn if we are not comparing the same data type
-    if (aParams.elementSize != bParams.elementSize) {
-        throw std::runtime_error("Comparison between two LayerData arrays with different element size (and possibly data types) is not advised (" + std::to_string(aParams.elementSize)
-                  + " and " + std::to_string(bParams.elementSize) + ")\n");
-    }
-    if (aParams.dims.size() != bParams.dims.size()) {
-        throw std::runtime_error("LayerData arrays must have the same number of dimentions");
-    }
-
-    // Ensure each dimention size matches
-    for (std::size_t i = 0; i < aParams.dims.size(); i++) {
-        if (aParams.dims[i] != bParams.dims[i]) {
-            throw std::runtime_error("LayerData arrays must have the same size dimentions to be compared");
-        }
-    }
+    checkComparable(other);
 
     size_t flat_count = params.flat_count();
 
@@ -301,8 +537,8 @@ template <typename T> float LayerData::compare(const LayerData& other) const {
     double b_magnitude_sq = 0;
 
 
-    T* a_vector = (T*)data.get();
-    T* b_vector = (T*)other.data.get();
+    T* a_vector = (T*)buffer;
+    T* b_vector = (T*)other.buffer;
     // Recurse as needed into each array
     for (std::size_t i = 0; i < flat_count; i++) {
         a_magnitude_sq += a_vector[i] * a_vector[i];
@@ -321,6 +557,13 @@ template <typename T> float LayerData::compare(const LayerData& other) const {
     return cosine_similarity;
 }
 
+// fp32 arrays take the vectorized single pass
+template <> inline float LayerData::compare<fp32>(const LayerData& other) const {
+    CompareResult result = compareResult(other);
+    if (result.zeroMagnitude) std::cout << "Zero Magnitude Vector Comparison" << std::endl;
+    return result.cosine;
+}
+
 // Compare within an Epsilon to ensure layer datas are similar within reason
 template <typename T, typename T_EP> bool LayerData::compareWithin(const LayerData& other, const T_EP epsilon) const {
     return epsilon > compare<T>(other);
@@ -342,7 +585,7 @@ template <typename T, typename T_EP> bool LayerData::compareWithinPrint(const La
 
     //LENGTH WEIGHTED COSINE SIMILARITY
     float cosine_similarity = compare<T>(other);
-    bool result = (compare<T>(other) > 0.8);
+    bool result = (cosine_similarity > 0.8);
 
     std::cout
         << "Comparing Outputs (Cosine Similarity): "
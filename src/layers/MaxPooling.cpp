@@ -1,12 +1,105 @@
 #include "MaxPooling.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
 #include <iostream>
+#include <sstream>
+#include <vector>
 
 #include "../Types.h"
 #include "../Utils.h"
+#include "../kernels/Kernels.h"
 #include "Layer.h"
 
 namespace ML {
+
+namespace {
+
+// Input range [begin, end) covered by output position `o` along one dimension, clipped to the unpadded input
+inline void windowRange(const size_t o, const size_t stride, const size_t pad, const size_t kernel, const size_t in, size_t& begin, size_t& end) {
+    long start = (long)(o * stride) - (long)pad;
+    begin = (size_t)std::max(start, 0L);
+    end = (size_t)std::min(start + (long)kernel, (long)in);
+}
+
+// Max over a window for `count` contiguous channels starting at `in`, rows are `row_stride` apart and pixels `num_channels` apart
+inline void windowMax(const fp32* in, fp32* out, const size_t count, const size_t rows, const size_t cols, const size_t row_stride,
+                      const size_t num_channels) {
+    for (size_t c = 0; c < count; c++) out[c] = -FLT_MAX;
+    for (size_t i = 0; i < rows; i++) {
+        for (size_t j = 0; j < cols; j++) {
+            const fp32* px = in + i * row_stride + j * num_channels;
+            for (size_t c = 0; c < count; c++) out[c] = std::max(out[c], px[c]);
+        }
+    }
+}
+
+}  // namespace
+
+MaxPoolingLayer::MaxPoolingLayer(const LayerParams inParams, const LayerParams outParams, const PoolParams poolParams)
+    : Layer(inParams, outParams, LayerType::MAX_POOLING), poolParams(poolParams) {
+    const PoolParams& p = poolParams;
+    if (p.kernelH == 0 || p.kernelW == 0 || p.strideH == 0 || p.strideW == 0) {
+        throw std::runtime_error("Max pooling window and stride must be non-zero");
+    }
+    if (p.padH >= p.kernelH || p.padW >= p.kernelW) {
+        throw std::runtime_error("Max pooling padding must be smaller than the window");
+    }
+    if (inParams.dims[ParamIndex::CHANNELS] != outParams.dims[ParamIndex::CHANNELS]) {
+        throw std::runtime_error("Max pooling input and output channels must match");
+    }
+
+    size_t exp_height = PoolParams::outputSize(inParams.dims[ParamIndex::HEIGHT], p.kernelH, p.strideH, p.padH);
+    size_t exp_width = PoolParams::outputSize(inParams.dims[ParamIndex::WIDTH], p.kernelW, p.strideW, p.padW);
+    if (exp_height == 0 || exp_width == 0) throw std::runtime_error("Max pooling window is larger than the padded input");
+    if (exp_height != outParams.dims[ParamIndex::HEIGHT] || exp_width != outParams.dims[ParamIndex::WIDTH]) {
+        std::ostringstream oss;
+        oss << "Max pooling output shape (" << outParams.dims[ParamIndex::HEIGHT] << ", " << outParams.dims[ParamIndex::WIDTH]
+            << ") does not match the window, expected (" << exp_height << ", " << exp_width << ")";
+        throw std::runtime_error(oss.str());
+    }
+}
+
+Region MaxPoolingLayer::outputRegion(const Region& in) const {
+    const PoolParams& pool = getPoolParams();
+    const dimVec& out = getOutputParams().dims;
+    Region region;
+    dependentRange(in.h0, in.h1, pool.strideH, pool.padH, pool.kernelH, out[ParamIndex::HEIGHT], region.h0, region.h1);
+    dependentRange(in.w0, in.w1, pool.strideW, pool.padW, pool.kernelW, out[ParamIndex::WIDTH], region.w0, region.w1);
+    return region;
+}
+
+// The SIMD kernel runs on a copy of the input window the region reads, padding never wins the max
+void MaxPoolingLayer::computeRegion(const LayerData& dataIn, const Region& region) const {
+    if (getLayout() != Layout::NHWC) throw std::runtime_error("Region inference needs NHWC activations");
+    if (region.empty()) return;
+    const PoolParams& pool = getPoolParams();
+    const dimVec& in = getInputParams().dims;
+    const dimVec& out = getOutputParams().dims;
+    size_t channels = in[ParamIndex::CHANNELS];
+
+    PoolShape sub = {0, 0, channels,
+                     region.h1 - region.h0, region.w1 - region.w0,
+                     pool.kernelH, pool.kernelW,
+                     pool.strideH, pool.strideW,
+                     0, 0};
+    sub.in_h = (sub.out_h - 1) * pool.strideH + pool.kernelH;
+    sub.in_w = (sub.out_w - 1) * pool.strideW + pool.kernelW;
+
+    std::vector<fp32> window(sub.in_h * sub.in_w * channels), result(sub.out_h * sub.out_w * channels);
+    MemoryCharge charge(getMemory(), MemoryKind::SCRATCH, (window.size() + result.size()) * sizeof(fp32));
+    copyWindow(dataIn.ptr<fp32>(), in[ParamIndex::HEIGHT], in[ParamIndex::WIDTH], channels, (long)(region.h0 * pool.strideH) - (long)pool.padH,
+               (long)(region.w0 * pool.strideW) - (long)pool.padW, sub.in_h, sub.in_w, -FLT_MAX, window.data());
+    Kernels::active().maxPool(sub, window.data(), result.data());
+
+    fp32* dst = getOutputData().ptr<fp32>();
+    for (size_t h = 0; h < sub.out_h; h++) {
+        std::memcpy(dst + ((region.h0 + h) * out[ParamIndex::WIDTH] + region.w0) * channels, result.data() + h * sub.out_w * channels,
+                    sub.out_w * channels * sizeof(fp32));
+    }
+}
+
 // --- Begin Student Code ---
 
 // Compute the max pooling layer for the layer data
@@ -14,6 +107,7 @@ void MaxPoolingLayer::computeNaive(const LayerData& dataIn) const {
 
     const LayerParams& in_params = getInputParams();
     const LayerParams& out_params = getOutputParams();
+    const PoolParams& pool = getPoolParams();
 
     size_t batch_size = 1;
 
@@ -26,10 +120,6 @@ void MaxPoolingLayer::computeNaive(const LayerData& dataIn) const {
     // in channels equals out channels
     size_t num_channels = in_params.dims[ParamIndex::CHANNELS];
 
-    // These should be integers and will be 2 in this scenario
-    size_t pool_vert_stride = in_height / out_height;
-    size_t pool_horz_stride = in_width / out_width;
-
     // For every batch, channel
     for(size_t n = 0; n < batch_size; n++)
     {
@@ -46,22 +136,21 @@ void MaxPoolingLayer::computeNaive(const LayerData& dataIn) const {
                                     + w * (num_channels )
                                     + c;
 
-                    // Find associated input index
-                    size_t in_ind =   n * (in_height * in_width * num_channels)
-                                    + (h * pool_vert_stride) * (in_width * num_channels)
-                                    + (w * pool_horz_stride) * (num_channels)
-                                    + c;
+                    // Window bounds, padded positions never win the max
+                    size_t h_begin, h_end, w_begin, w_end;
+                    windowRange(h, pool.strideH, pool.padH, pool.kernelH, in_height, h_begin, h_end);
+                    windowRange(w, pool.strideW, pool.padW, pool.kernelW, in_width, w_begin, w_end);
 
-                    fp32 max = dataIn.get<fp32>(in_ind);
+                    fp32 max = -FLT_MAX;
 
-                    // Find the max in vert_stride x horz_stride areas
-                    for(size_t i=0; i < pool_vert_stride; i++)
+                    // Find the max in the kernelH x kernelW window
+                    for(size_t i = h_begin; i < h_end; i++)
                     {
-                        for(size_t j=0; j < pool_horz_stride; j++)
+                        for(size_t j = w_begin; j < w_end; j++)
                         {
                             size_t in_ind =   n * (in_height * in_width * num_channels)
-                                            + (h * pool_vert_stride + i) * (in_width * num_channels)
-                                            + (w * pool_horz_stride + j) * (num_channels)
+                                            + i * (in_width * num_channels)
+                                            + j * (num_channels)
                                             + c;
 
                             if(dataIn.get<fp32>(in_ind) > max)
@@ -76,7 +165,6 @@ void MaxPoolingLayer::computeNaive(const LayerData& dataIn) const {
             }
         }
     }
-    // std::cout << dataIn.get<fp32>(0) << dataIn.get<fp32>(num_channels) << std::endl;
 }
 
 // Compute the max pooling layer using threads
@@ -85,12 +173,70 @@ void MaxPoolingLayer::computeThreaded(const LayerData& dataIn) const {
 }
 
 // Compute the max pooling layer using a tiled approach
+// Output rows are processed in tiles and channels in blocks, each block is reduced in a small local accumulator
 void MaxPoolingLayer::computeTiled(const LayerData& dataIn) const {
-    // TODO: Your Code Here...
+    const size_t TILE_ROWS = 4;
+    const size_t CHANNEL_BLOCK = 16;
+
+    const PoolParams& pool = getPoolParams();
+    const fp32* in = dataIn.ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+
+    size_t in_height = getInputParams().dims[ParamIndex::HEIGHT];
+    size_t in_width = getInputParams().dims[ParamIndex::WIDTH];
+    size_t out_height = getOutputParams().dims[ParamIndex::HEIGHT];
+    size_t out_width = getOutputParams().dims[ParamIndex::WIDTH];
+    size_t num_channels = getInputParams().dims[ParamIndex::CHANNELS];
+
+    for (size_t h0 = 0; h0 < out_height; h0 += TILE_ROWS) {
+        size_t h_tile_end = std::min(h0 + TILE_ROWS, out_height);
+        for (size_t c0 = 0; c0 < num_channels; c0 += CHANNEL_BLOCK) {
+            size_t count = std::min(CHANNEL_BLOCK, num_channels - c0);
+            for (size_t h = h0; h < h_tile_end; h++) {
+                size_t h_begin, h_end;
+                windowRange(h, pool.strideH, pool.padH, pool.kernelH, in_height, h_begin, h_end);
+                for (size_t w = 0; w < out_width; w++) {
+                    size_t w_begin, w_end;
+                    windowRange(w, pool.strideW, pool.padW, pool.kernelW, in_width, w_begin, w_end);
+
+                    fp32 acc[CHANNEL_BLOCK];
+                    windowMax(in + (h_begin * in_width + w_begin) * num_channels + c0, acc, count, h_end - h_begin, w_end - w_begin,
+                              in_width * num_channels, num_channels);
+                    std::copy(acc, acc + count, out + (h * out_width + w) * num_channels + c0);
+                }
+            }
+        }
+    }
 }
 
 // Compute the max pooling layer using SIMD
+// Iterates spatially and takes the max of a whole vector of contiguous NHWC channels at once (kernels/, level picked at runtime)
+// A blocked layout is a stack of small NHWC images, one per channel block
 void MaxPoolingLayer::computeSIMD(const LayerData& dataIn) const {
-    // TODO: Your Code Here...
+    const PoolParams& pool = getPoolParams();
+    const dimVec& in = getInputParams().dims;
+    const dimVec& out = getOutputParams().dims;
+    size_t block = getLayout() == Layout::NHWC ? in[ParamIndex::CHANNELS] : channelBlock(getLayout());
+    PoolShape sh = {in[ParamIndex::HEIGHT], in[ParamIndex::WIDTH], block,
+                    out[ParamIndex::HEIGHT], out[ParamIndex::WIDTH],
+                    pool.kernelH, pool.kernelW,
+                    pool.strideH, pool.strideW,
+                    pool.padH, pool.padW};
+
+    const fp32* src = dataIn.ptr<fp32>();
+    fp32* dst = getOutputData().ptr<fp32>();
+    for (size_t b = 0; b < in[ParamIndex::CHANNELS] / block; b++) {
+        Kernels::active().maxPool(sh, src + b * sh.in_h * sh.in_w * block, dst + b * sh.out_h * sh.out_w * block);
+    }
+}
+
+std::vector<Layout> MaxPoolingLayer::supportedLayouts(const InfType infType) const {
+    if (infType != InfType::SIMD) return {Layout::NHWC};
+
+    std::vector<Layout> layouts;
+    for (Layout l : {Layout::NHWC, Layout::NCHW8c, Layout::NCHW16c}) {
+        if (layoutFits(l, getInputParams().dims)) layouts.push_back(l);
+    }
+    return layouts;
 }
 }  // namespace ML
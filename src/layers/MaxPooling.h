@@ -5,10 +5,39 @@
 #include "Layer.h"
 
 namespace ML {
+
+// Pooling window description, padding is applied on both sides of each spatial dimension
+struct PoolParams {
+    PoolParams(const std::size_t size, const std::size_t stride, const std::size_t padding = 0)
+        : PoolParams(size, size, stride, stride, padding, padding) {}
+    PoolParams(const std::size_t kernelH, const std::size_t kernelW, const std::size_t strideH, const std::size_t strideW,
+               const std::size_t padH, const std::size_t padW)
+        : kernelH(kernelH), kernelW(kernelW), strideH(strideH), strideW(strideW), padH(padH), padW(padW) {}
+
+    // Output size of one spatial dimension, 0 when the window is larger than the padded input
+    static std::size_t outputSize(const std::size_t in, const std::size_t kernel, const std::size_t stride, const std::size_t pad) {
+        return windowOutputSize(in, 2 * pad, kernel, stride);
+    }
+
+    std::size_t kernelH, kernelW;
+    std::size_t strideH, strideW;
+    std::size_t padH, padW;
+};
+
 class MaxPoolingLayer : public Layer {
    public:
+    // Non-overlapping pooling, the window is inferred from the input/output size ratio
     MaxPoolingLayer(const LayerParams inParams, const LayerParams outParams)
-        : Layer(inParams, outParams, LayerType::MAX_POOLING){}
+        : MaxPoolingLayer(inParams, outParams,
+                          PoolParams(inParams.dims[ParamIndex::HEIGHT] / outParams.dims[ParamIndex::HEIGHT],
+                                     inParams.dims[ParamIndex::WIDTH] / outParams.dims[ParamIndex::WIDTH],
+                                     inParams.dims[ParamIndex::HEIGHT] / outParams.dims[ParamIndex::HEIGHT],
+                                     inParams.dims[ParamIndex::WIDTH] / outParams.dims[ParamIndex::WIDTH], 0, 0)) {}
+
+    MaxPoolingLayer(const LayerParams inParams, const LayerParams outParams, const PoolParams poolParams);
+
+    // Getters
+    const PoolParams& getPoolParams() const { return poolParams; }
 
     // Allocate all resources needed for the layer & Load all of the required data for the layer
     virtual void allocLayer() override {
@@ -20,6 +49,15 @@ class MaxPoolingLayer : public Layer {
         Layer::freeLayer();
     }
 
+    // Every channel is pooled on its own, so the SIMD backend runs in any layout with whole channel blocks
+    virtual std::vector<Layout> supportedLayouts(const InfType infType) const override;
+    virtual bool isLayoutTransparent() const override { return true; }
+
+    // Output pixels only read their window, so a changed input region maps to an output region
+    virtual bool supportsRegions() const override { return true; }
+    virtual Region outputRegion(const Region& in) const override;
+    virtual void computeRegion(const LayerData& dataIn, const Region& region) const override;
+
     // Virtual functions
     virtual void computeNaive(const LayerData& dataIn) const override;
     virtual void computeThreaded(const LayerData& dataIn) const override;
@@ -27,6 +65,7 @@ class MaxPoolingLayer : public Layer {
     virtual void computeSIMD(const LayerData& dataIn) const override;
 
    private:
+    PoolParams poolParams;
 };
 
-}  // namespace ML
\ No newline at end of file
+}  // namespace ML
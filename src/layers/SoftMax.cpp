@@ -1,12 +1,33 @@
 #include "SoftMax.h"
 
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
 #include <iostream>
+#include <numeric>
 
 #include "../Types.h"
 #include "../Utils.h"
+#include "../kernels/Kernels.h"
 #include "Layer.h"
 
 namespace ML {
+
+// The k highest scores of a flat LayerData, highest first
+std::vector<Prediction> topK(const LayerData& scores, const std::size_t k) {
+    const fp32* data = scores.ptr<fp32>();
+    std::size_t count = scores.getParams().flat_count();
+    std::size_t n = std::min(k, count);
+
+    std::vector<std::size_t> idx(count);
+    std::iota(idx.begin(), idx.end(), 0);
+    std::partial_sort(idx.begin(), idx.begin() + n, idx.end(), [&](std::size_t a, std::size_t b) { return data[a] > data[b]; });
+
+    std::vector<Prediction> result(n);
+    for (std::size_t i = 0; i < n; i++) result[i] = {idx[i], data[idx[i]]};
+    return result;
+}
+
 // --- Begin Student Code ---
 
 // Compute the  soft max layer for the layer data
@@ -19,33 +40,58 @@ void SoftMaxLayer::computeNaive(const LayerData& dataIn) const {
     // number of inputs should equal number of outputs
     size_t num_inputs = in_params.dims[0];
 
-    // std::cout << dataIn.get<fp32>(0) << std::endl;
-    // std::cout << dataIn.get<fp32>(1) << std::endl;
-    // std::cout << dataIn.get<fp32>(2) << std::endl;
-    // std::cout << dataIn.get<fp32>(3) << std::endl;
-    // std::cout << dataIn.get<fp32>(4) << std::endl;
-
     for(size_t n = 0; n < batch_size; n++)
     {
-        fp32 sum_e = 0;
+        // Subtract the max before exponentiating so large logits can't overflow
+        fp32 max_in = dataIn.get<fp32>(n * num_inputs);
+        size_t i;
+        for(i = 1; i < num_inputs; i++)
+        {
+            max_in = std::max(max_in, dataIn.get<fp32>(n * num_inputs + i));
+        }
 
         // Calculate sum of exponents
-        size_t i;
+        fp32 sum_e = 0;
         for(i = 0; i < num_inputs; i++)
         {
-            sum_e += exp(dataIn.get<fp32>(n * num_inputs + i));
+            fp32 e = exp(dataIn.get<fp32>(n * num_inputs + i) - max_in);
+            getOutputData().get<fp32>(n * num_inputs + i) = e;
+            sum_e += e;
         }
-        for(i = 0; i < num_inputs; i++)
+
+        if(use_log)
+        {
+            fp32 log_sum = std::log(sum_e);
+            for(i = 0; i < num_inputs; i++)
+            {
+                getOutputData().get<fp32>(n * num_inputs + i) = dataIn.get<fp32>(n * num_inputs + i) - max_in - log_sum;
+            }
+        }
+        else
         {
-            getOutputData().get<fp32>(n * num_inputs + i) = exp(dataIn.get<fp32>(n* num_inputs + i)) / sum_e;
+            for(i = 0; i < num_inputs; i++)
+            {
+                getOutputData().get<fp32>(n * num_inputs + i) /= sum_e;
+            }
         }
     }
+}
+
+// Fused softmax + top-k, only the k selected scores are normalized
+std::vector<Prediction> SoftMaxLayer::computeTopK(const LayerData& dataIn, const std::size_t k) const {
+    const fp32* in = dataIn.ptr<fp32>();
+    std::size_t count = getInputParams().dims[0];
 
-    // std::cout << getOutputData().get<fp32>(0) << std::endl;
-    // std::cout << getOutputData().get<fp32>(1) << std::endl;
-    // std::cout << getOutputData().get<fp32>(2) << std::endl;
-    // std::cout << getOutputData().get<fp32>(3) << std::endl;
-    // std::cout << getOutputData().get<fp32>(4) << std::endl;
+    fp32 max, sum;
+    Kernels::active().softmaxStats(in, count, max, sum);
+
+    // Softmax is monotonic, so the top logits are the top probabilities
+    std::vector<Prediction> result = topK(dataIn, k);
+    fp32 log_sum = std::log(sum);
+    for (Prediction& p : result) {
+        p.score = use_log ? p.score - max - log_sum : std::exp(p.score - max) / sum;
+    }
+    return result;
 }
 
 // Compute the soft max layer using threads
@@ -59,7 +105,18 @@ void SoftMaxLayer::computeTiled(const LayerData& dataIn) const {
 }
 
 // Compute the soft max layer using SIMD
+// One pass for the max and the normalizer, one for the output (kernels/, level picked at runtime)
 void SoftMaxLayer::computeSIMD(const LayerData& dataIn) const {
-    // TODO: Your Code Here...
+    const fp32* in = dataIn.ptr<fp32>();
+    fp32* out = getOutputData().ptr<fp32>();
+    std::size_t count = getInputParams().dims[0];
+    const Kernels::KernelTable& kernels = Kernels::active();
+
+    fp32 max, sum;
+    kernels.softmaxStats(in, count, max, sum);
+
+    // Log-softmax only needs a shift, softmax needs one more exp per element
+    fp32 shift = use_log ? max + std::log(sum) : max;
+    kernels.softmaxOut(in, out, count, shift, 1.0f / sum, use_log);
 }
 }  // namespace ML
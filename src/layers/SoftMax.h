@@ -1,14 +1,26 @@
 #pragma once
 
+#include <vector>
+
 #include "../Types.h"
 #include "../Utils.h"
 #include "Layer.h"
 
 namespace ML {
+
+// A single classification result
+struct Prediction {
+    std::size_t index;
+    fp32 score;
+};
+
+// The k highest scores of a flat LayerData (probabilities or log-probabilities), highest first
+std::vector<Prediction> topK(const LayerData& scores, const std::size_t k);
+
 class SoftMaxLayer : public Layer {
    public:
-    SoftMaxLayer(const LayerParams inParams, const LayerParams outParams)
-        : Layer(inParams, outParams, LayerType::SOFTMAX){}
+    SoftMaxLayer(const LayerParams inParams, const LayerParams outParams, const bool use_log=false)
+        : Layer(inParams, outParams, LayerType::SOFTMAX), use_log(use_log) {}
 
     // Allocate all resources needed for the layer & Load all of the required data for the layer
     virtual void allocLayer() override {
@@ -20,6 +32,12 @@ class SoftMaxLayer : public Layer {
         Layer::freeLayer();
     }
 
+    // Outputs log-probabilities instead of probabilities
+    bool isLogSoftMax() const { return use_log; }
+
+    // Fused softmax + top-k straight from the logits, only the k selected scores are normalized
+    std::vector<Prediction> computeTopK(const LayerData& dataIn, const std::size_t k) const;
+
     // Virtual functions
     virtual void computeNaive(const LayerData& dataIn) const override;
     virtual void computeThreaded(const LayerData& dataIn) const override;
@@ -27,6 +45,7 @@ class SoftMaxLayer : public Layer {
     virtual void computeSIMD(const LayerData& dataIn) const override;
 
    private:
+    bool use_log;
 };
 
-}  // namespace ML
\ No newline at end of file
+}  // namespace ML